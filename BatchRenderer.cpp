@@ -0,0 +1,255 @@
+#include "BatchRenderer.h"
+#include <algorithm>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+/// Groups requests that can share one bind, with instances of the same range next to each other.
+struct BatchRenderer::DrawRequestOrder {
+	bool operator()(const DrawRequest& a, const DrawRequest& b) const {
+		if(a.vertices->GetFormat() != b.vertices->GetFormat()) {
+			return a.vertices->GetFormat() < b.vertices->GetFormat();
+		}
+		if(a.vertices != b.vertices) {
+			return a.vertices < b.vertices;
+		}
+		if(a.indices != b.indices) {
+			return a.indices < b.indices;
+		}
+		if(a.primitiveType != b.primitiveType) {
+			return a.primitiveType < b.primitiveType;
+		}
+		bool aInstanced = (a.instanceOffset >= 0);
+		bool bInstanced = (b.instanceOffset >= 0);
+		if(aInstanced != bInstanced) {
+			return bInstanced; // plain draws first
+		}
+		if(a.startIndex != b.startIndex) {
+			return a.startIndex < b.startIndex;
+		}
+		return a.indexCount < b.indexCount;
+	}
+};
+
+/// Byte offset of an index, as the pointer GL wants for buffer-backed index arrays
+static inline const GLvoid* IndexOffset(unsigned int index) {
+	return (const GLvoid*)(index * sizeof(IndexType));
+}
+
+//--------------------------------------------------------------------------
+
+BatchRenderer::BatchRenderer() {
+	this->instanceAttributeIndex = 0;
+	this->instanceComponents = 0;
+	this->instanceBuffer = 0;
+}
+
+BatchRenderer::~BatchRenderer() {
+	if(this->instanceBuffer != 0) {
+		glDeleteBuffersARB(1, &this->instanceBuffer);
+	}
+}
+
+void BatchRenderer::SetInstanceAttribute(GLuint attributeIndex, unsigned int components) {
+	assert(components >= 1 && components <= 4);
+	assert(this->instanceData.empty()); // Can't change shape with instances queued
+	this->instanceAttributeIndex = attributeIndex;
+	this->instanceComponents = components;
+}
+
+void BatchRenderer::Submit(VertexBuffer* vertices, IndexBuffer* indices, unsigned int startIndex, unsigned int indexCount,
+						   GLenum primitiveType) {
+	assert(vertices != NULL && indices != NULL);
+	assert(IsRangeWithin(startIndex, indexCount, indices->getSize()));
+
+	DrawRequest request;
+	request.vertices = vertices;
+	request.indices = indices;
+	request.primitiveType = primitiveType;
+	request.startIndex = startIndex;
+	request.indexCount = indexCount;
+	request.instanceOffset = -1;
+	this->requests.push_back(request);
+
+	this->statistics.drawsSubmitted++;
+}
+
+void BatchRenderer::SubmitInstance(VertexBuffer* vertices, IndexBuffer* indices, unsigned int startIndex, unsigned int indexCount,
+								   const float* instanceData, GLenum primitiveType) {
+	assert(vertices != NULL && indices != NULL && instanceData != NULL);
+	assert(IsRangeWithin(startIndex, indexCount, indices->getSize()));
+	assert(this->instanceComponents > 0); // Call SetInstanceAttribute first
+
+	DrawRequest request;
+	request.vertices = vertices;
+	request.indices = indices;
+	request.primitiveType = primitiveType;
+	request.startIndex = startIndex;
+	request.indexCount = indexCount;
+	request.instanceOffset = (int)this->instanceData.size();
+	this->requests.push_back(request);
+
+	this->instanceData.insert(this->instanceData.end(), instanceData, instanceData + this->instanceComponents);
+
+	this->statistics.drawsSubmitted++;
+	this->statistics.instancesSubmitted++;
+}
+
+void BatchRenderer::Clear() {
+	this->requests.clear();
+	this->instanceData.clear();
+}
+
+void BatchRenderer::Flush() {
+	if(this->requests.empty()) {
+		return;
+	}
+
+	// Stable so that draws of the same range keep their submission order
+	std::stable_sort(this->requests.begin(), this->requests.end(), DrawRequestOrder());
+
+	glPushAttrib(GL_ALL_ATTRIB_BITS); // Once per flush rather than per draw
+	RENDER_COUNT(CountPushAttrib());
+
+	size_t groupBegin = 0;
+	while(groupBegin < this->requests.size()) {
+		const DrawRequest& first = this->requests[groupBegin];
+		size_t groupEnd = groupBegin + 1;
+		while(groupEnd < this->requests.size()
+			  && this->requests[groupEnd].vertices == first.vertices
+			  && this->requests[groupEnd].indices == first.indices
+			  && this->requests[groupEnd].primitiveType == first.primitiveType) {
+			groupEnd++;
+		}
+
+		this->DrawGroup(groupBegin, groupEnd);
+		groupBegin = groupEnd;
+	}
+
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+	RENDER_COUNT(CountBind());
+	RENDER_COUNT(CountBind());
+	glPopAttrib();
+	RENDER_COUNT(CountPopAttrib());
+
+	this->Clear();
+}
+
+void BatchRenderer::DrawGroup(size_t begin, size_t end) {
+	const DrawRequest& first = this->requests[begin];
+
+	first.vertices->BeginDraw(first.indices);
+	// Restart-joined strips need restart on for the draws below, which don't go through IndexBuffer
+	first.indices->BeginRestart();
+	this->statistics.groups++;
+
+	// Plain draws sort ahead of instances, so they're a prefix of the group
+	size_t instancesBegin = begin;
+	while(instancesBegin < end && this->requests[instancesBegin].instanceOffset < 0) {
+		instancesBegin++;
+	}
+
+	if(instancesBegin > begin) {
+		size_t drawCount = instancesBegin - begin;
+		if(drawCount > 1 && BatchRenderer::IsMultiDrawSupported()) {
+			this->counts.resize(drawCount);
+			this->offsets.resize(drawCount);
+			for(size_t i = 0; i < drawCount; i++) {
+				this->counts[i] = this->requests[begin + i].indexCount;
+				this->offsets[i] = IndexOffset(this->requests[begin + i].startIndex);
+			}
+			glMultiDrawElements(first.primitiveType, &this->counts[0], GL_INDEX_TYPE, &this->offsets[0], (GLsizei)drawCount);
+			RENDER_COUNT(CountMultiDraw(first.primitiveType, &this->counts[0], drawCount));
+			this->statistics.multiDrawCalls++;
+		}
+		else {
+			for(size_t i = begin; i < instancesBegin; i++) {
+				glDrawElements(first.primitiveType, this->requests[i].indexCount, GL_INDEX_TYPE, IndexOffset(this->requests[i].startIndex));
+				RENDER_COUNT(CountDraw(first.primitiveType, this->requests[i].indexCount));
+				this->statistics.singleDrawCalls++;
+			}
+		}
+	}
+
+	// Instances of the same index range go out together
+	size_t runBegin = instancesBegin;
+	while(runBegin < end) {
+		size_t runEnd = runBegin + 1;
+		while(runEnd < end
+			  && this->requests[runEnd].startIndex == this->requests[runBegin].startIndex
+			  && this->requests[runEnd].indexCount == this->requests[runBegin].indexCount) {
+			runEnd++;
+		}
+		this->DrawInstances(&this->requests[runBegin], runEnd - runBegin);
+		runBegin = runEnd;
+	}
+
+	first.indices->EndRestart();
+	first.vertices->EndDraw();
+}
+
+void BatchRenderer::DrawInstances(const DrawRequest* requests, size_t count) {
+	const DrawRequest& first = requests[0];
+
+	if(!BatchRenderer::IsInstancingSupported()) {
+		// Fall back to one draw per instance, passing its data as a constant attribute
+		for(size_t i = 0; i < count; i++) {
+			this->SetInstanceConstant(&this->instanceData[requests[i].instanceOffset]);
+			glDrawElements(first.primitiveType, first.indexCount, GL_INDEX_TYPE, IndexOffset(first.startIndex));
+			RENDER_COUNT(CountDraw(first.primitiveType, first.indexCount));
+			this->statistics.singleDrawCalls++;
+		}
+		return;
+	}
+
+	// Gather this run's instance data so it can go up in one piece
+	this->instanceStaging.resize(count * this->instanceComponents);
+	for(size_t i = 0; i < count; i++) {
+		std::copy(this->instanceData.begin() + requests[i].instanceOffset,
+				  this->instanceData.begin() + requests[i].instanceOffset + this->instanceComponents,
+				  this->instanceStaging.begin() + i * this->instanceComponents);
+	}
+
+	if(this->instanceBuffer == 0) {
+		glGenBuffersARB(1, &this->instanceBuffer);
+		assert(this->instanceBuffer != 0);
+	}
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, this->instanceBuffer);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, this->instanceStaging.size() * sizeof(float), &this->instanceStaging[0], GL_STREAM_DRAW_ARB);
+	RENDER_COUNT(CountBind());
+	RENDER_COUNT(CountUpload(this->instanceStaging.size() * sizeof(float)));
+
+	glEnableVertexAttribArrayARB(this->instanceAttributeIndex);
+	RENDER_COUNT(CountClientStateToggle());
+	glVertexAttribPointerARB(this->instanceAttributeIndex, this->instanceComponents, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribDivisorARB(this->instanceAttributeIndex, 1);
+
+	glDrawElementsInstancedARB(first.primitiveType, first.indexCount, GL_INDEX_TYPE, IndexOffset(first.startIndex), (GLsizei)count);
+	RENDER_COUNT(CountDraw(first.primitiveType, first.indexCount, count));
+	this->statistics.instancedDrawCalls++;
+
+	glVertexAttribDivisorARB(this->instanceAttributeIndex, 0);
+	glDisableVertexAttribArrayARB(this->instanceAttributeIndex);
+	RENDER_COUNT(CountClientStateToggle());
+}
+
+void BatchRenderer::SetInstanceConstant(const float* data) const {
+	switch(this->instanceComponents) {
+		case 1:
+			glVertexAttrib1fvARB(this->instanceAttributeIndex, data);
+			break;
+		case 2:
+			glVertexAttrib2fvARB(this->instanceAttributeIndex, data);
+			break;
+		case 3:
+			glVertexAttrib3fvARB(this->instanceAttributeIndex, data);
+			break;
+		case 4:
+			glVertexAttrib4fvARB(this->instanceAttributeIndex, data);
+			break;
+		default:
+			assert(false); // SetInstanceAttribute never called
+			break;
+	}
+}
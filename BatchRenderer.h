@@ -0,0 +1,128 @@
+#ifndef _585_BATCHRENDERER_H_
+#define _585_BATCHRENDERER_H_
+
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include <vector>
+
+/// What a BatchRenderer did with the draws it was given, since the statistics were last reset.
+struct BatchStatistics {
+	BatchStatistics() {
+		this->Reset();
+	}
+	void Reset() {
+		drawsSubmitted = instancesSubmitted = groups = 0;
+		multiDrawCalls = instancedDrawCalls = singleDrawCalls = 0;
+	}
+	/// The number of calls to Submit and SubmitInstance
+	unsigned int drawsSubmitted;
+	/// How many of those were instances
+	unsigned int instancesSubmitted;
+	/// The number of (vertex buffer, index buffer, primitive) groups bound
+	unsigned int groups;
+	/// glMultiDrawElements calls issued
+	unsigned int multiDrawCalls;
+	/// glDrawElementsInstanced calls issued
+	unsigned int instancedDrawCalls;
+	/// glDrawElements calls issued
+	unsigned int singleDrawCalls;
+
+	/// The total number of GL draw calls issued
+	unsigned int GetDrawCallsIssued() const {
+		return multiDrawCalls + instancedDrawCalls + singleDrawCalls;
+	}
+};
+
+/**
+	\brief Collects indexed draws for a frame and submits them with as few GL calls as possible.
+	Draws are sorted by vertex format, vertex buffer, index buffer and primitive type. Each group
+	is bound once and submitted with a single glMultiDrawElements. Instances of the same index
+	range are drawn with one instanced call, with their per-instance data fed to a generic vertex
+	attribute (so the shader needs to read it). Index buffers set to use primitive restart draw
+	with it on, so restart-joined strips batch like anything else.
+*/
+class BatchRenderer {
+public:
+	/// Whether glMultiDrawElements is available (OpenGL 1.4).
+	static bool IsMultiDrawSupported() {
+		return (_GLEE_VERSION_1_4 != 0);
+	}
+	/// Whether instanced draws with per-instance attributes are available.
+	static bool IsInstancingSupported() {
+		return (_GLEE_ARB_draw_instanced != 0 && _GLEE_ARB_instanced_arrays != 0);
+	}
+public:
+	BatchRenderer();
+	~BatchRenderer();
+public:
+	/**
+		\brief Choose where per-instance data goes.
+		\param attributeIndex	The generic vertex attribute the shader reads per-instance data from.
+		\param components		The number of floats of data per instance (1 to 4).
+	*/
+	void SetInstanceAttribute(GLuint attributeIndex, unsigned int components);
+	/**
+		\brief Queue a range of an index buffer to be drawn.
+		\param vertices			The vertex buffer to draw from. Must outlive the next Flush.
+		\param indices			The index buffer to draw with. Must outlive the next Flush.
+		\param startIndex		The first index to draw.
+		\param indexCount		The number of indices to draw.
+		\param primitiveType	The OpenGL geometric primitive type.
+	*/
+	void Submit(VertexBuffer* vertices, IndexBuffer* indices, unsigned int startIndex, unsigned int indexCount,
+				GLenum primitiveType = GL_TRIANGLES);
+	/**
+		\brief Queue one instance of a range of an index buffer.
+		\param instanceData		The per-instance data; as many floats as SetInstanceAttribute asked for. Copied.
+		The other parameters are as for Submit.
+	*/
+	void SubmitInstance(VertexBuffer* vertices, IndexBuffer* indices, unsigned int startIndex, unsigned int indexCount,
+						const float* instanceData, GLenum primitiveType = GL_TRIANGLES);
+	/// Sort and draw everything queued since the last Flush, then empty the queue.
+	void Flush();
+	/// Forget everything queued without drawing it.
+	void Clear();
+public:
+	const BatchStatistics& GetStatistics() const {
+		return this->statistics;
+	}
+	void ResetStatistics() {
+		this->statistics.Reset();
+	}
+private:
+	struct DrawRequest {
+		VertexBuffer* vertices;
+		IndexBuffer* indices;
+		GLenum primitiveType;
+		unsigned int startIndex;
+		unsigned int indexCount;
+		/// Offset into instanceData, or -1 for a plain draw
+		int instanceOffset;
+	};
+	struct DrawRequestOrder;
+
+	void DrawGroup(size_t begin, size_t end);
+	void DrawInstances(const DrawRequest* requests, size_t count);
+	void SetInstanceConstant(const float* data) const;
+private:
+	// Owns a GL buffer, no copying
+	BatchRenderer(const BatchRenderer&);
+	BatchRenderer& operator=(const BatchRenderer&);
+private:
+	std::vector<DrawRequest> requests;
+	std::vector<float> instanceData;
+
+	GLuint instanceAttributeIndex;
+	unsigned int instanceComponents;
+	/// Streamed per-instance data. Created the first time it's needed.
+	GLuint instanceBuffer;
+
+	// Scratch arrays for glMultiDrawElements and instance uploads, kept between flushes
+	std::vector<GLsizei> counts;
+	std::vector<const GLvoid*> offsets;
+	std::vector<float> instanceStaging;
+
+	BatchStatistics statistics;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef _591_BOUNDS_H_
+#define _591_BOUNDS_H_
+
+#include "Vector.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+
+/// An axis-aligned bounding box. Starts out empty; Extend it with points.
+struct BoundingBox {
+	BoundingBox() {
+		float big = std::numeric_limits<float>::max();
+		minimum = Vector3(big, big, big);
+		maximum = Vector3(-big, -big, -big);
+	}
+	BoundingBox(const Vector3& minimum, const Vector3& maximum) : minimum(minimum), maximum(maximum) { }
+	/// The box around count points, stride floats apart, with xyz first.
+	static BoundingBox Enclosing(const float* points, size_t stride, size_t count) {
+		BoundingBox box;
+		for(size_t i = 0; i < count; i++, points += stride) {
+			box.Extend(Vector3(points[0], points[1], points[2]));
+		}
+		return box;
+	}
+	/// Grow to take in a point
+	void Extend(const Vector3& p) {
+		for(size_t i = 0; i < 3; i++) {
+			minimum[i] = std::min(minimum[i], p[i]);
+			maximum[i] = std::max(maximum[i], p[i]);
+		}
+	}
+	/// Grow to take in another box
+	void Extend(const BoundingBox& box) {
+		if(!box.IsEmpty()) {
+			this->Extend(box.minimum);
+			this->Extend(box.maximum);
+		}
+	}
+	bool IsEmpty() const {
+		return minimum[0] > maximum[0];
+	}
+	Vector3 GetCentre() const {
+		return (minimum + maximum) * 0.5;
+	}
+	/// Half the size along each axis
+	Vector3 GetExtents() const {
+		return (maximum - minimum) * 0.5;
+	}
+
+	Vector3 minimum;
+	Vector3 maximum;
+};
+
+/// A bounding sphere. A negative radius means it encloses nothing.
+struct BoundingSphere {
+	BoundingSphere() {
+		radius = -1.0f;
+	}
+	BoundingSphere(const Vector3& centre, float radius) : centre(centre), radius(radius) { }
+	/**
+		\brief The sphere centred on a box that takes in count points, stride floats apart.
+		Tighter than the sphere through the box's corners whenever the points don't reach them.
+	*/
+	static BoundingSphere Enclosing(const BoundingBox& box, const float* points, size_t stride, size_t count) {
+		if(box.IsEmpty()) {
+			return BoundingSphere();
+		}
+		Vector3 centre = box.GetCentre();
+		float radiusSquared = 0.0f;
+		for(size_t i = 0; i < count; i++, points += stride) {
+			Vector3 offset = Vector3(points[0], points[1], points[2]) - centre;
+			radiusSquared = std::max(radiusSquared, offset.dot(offset));
+		}
+		return BoundingSphere(centre, std::sqrt(radiusSquared));
+	}
+	bool IsEmpty() const {
+		return radius < 0.0f;
+	}
+
+	Vector3 centre;
+	float radius;
+};
+
+#endif
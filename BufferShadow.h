@@ -0,0 +1,31 @@
+#ifndef _585_BUFFERSHADOW_H_
+#define _585_BUFFERSHADOW_H_
+
+/// What a buffer does with its CPU-side shadow array once it has been written to the GPU.
+enum ShadowPolicy {
+	/// Keep the shadow array for the life of the buffer. Reads and writes never touch the GPU.
+	ShadowRetained = 0,
+	/// Free the shadow array after every Commit. It is read back from the GPU if it's touched again.
+	ShadowReleasedAfterCommit = 1
+};
+
+/// How a new buffer's shadow array starts out.
+enum ShadowStart {
+	/// Allocated and zeroed, ready to be written and committed.
+	ShadowZeroed = 0,
+	/// Not allocated, for a buffer about to be written whole through MapForWriting. If it's touched
+	/// any other way first, a zeroed shadow array is made then.
+	ShadowDeferred = 1
+};
+
+/// Where the contents of a buffer currently live.
+enum BufferResidency {
+	/// Only the shadow array holds the data (or nothing does, while it's deferred); nothing has been committed yet.
+	ResidentCPU = 0,
+	/// The data is on the GPU and mirrored in the shadow array.
+	ResidentCPUAndGPU = 1,
+	/// The data is only on the GPU; the shadow array has been released.
+	ResidentGPU = 2
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _591_CHECKEDSIZE_H_
+#define _591_CHECKEDSIZE_H_
+
+#include <cstddef>
+#include <climits>
+
+/*
+	Size and offset arithmetic that says when it overflows instead of wrapping. Counts read from files
+	go through these before anything is allocated, so a mesh too big for size_t (or for the GL types
+	the draws take) is refused rather than silently truncated.
+*/
+
+/// a * b, or false if it doesn't fit in a size_t
+inline bool MultiplySizes(size_t a, size_t b, size_t& product) {
+	if(b != 0 && a > (size_t)-1 / b) {
+		return false;
+	}
+	product = a * b;
+	return true;
+}
+
+/// a + b, or false if it doesn't fit in a size_t
+inline bool AddSizes(size_t a, size_t b, size_t& sum) {
+	if(a > (size_t)-1 - b) {
+		return false;
+	}
+	sum = a + b;
+	return true;
+}
+
+/// Whether count items from first lie within size items, without first + count wrapping
+inline bool IsRangeWithin(size_t first, size_t count, size_t size) {
+	return first <= size && count <= size - first;
+}
+
+/// Whether count fits the GLsizei (a signed int) that draw calls take
+inline bool FitsDrawCount(size_t count) {
+	return count <= (size_t)INT_MAX;
+}
+
+#endif
@@ -0,0 +1,176 @@
+#include "CommandList.h"
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+CommandList::CommandList() {
+	this->boundVertices = NULL;
+	this->boundIndices = NULL;
+}
+
+Command& CommandList::Add(CommandType type) {
+	Command command;
+	command.type = type;
+	command.vertices = NULL;
+	command.storage = NULL;
+	command.indices = NULL;
+	command.primitiveType = GL_TRIANGLES;
+	command.first = command.count = 0;
+	this->commands.push_back(command);
+	return this->commands.back();
+}
+
+void CommandList::Commit(VertexBufferStorage* vertices) {
+	assert(vertices != NULL);
+	this->Add(CommandCommitVertices).storage = vertices;
+}
+
+void CommandList::CommitRange(VertexBufferStorage* vertices, size_t firstComponent, size_t count) {
+	assert(vertices != NULL && IsRangeWithin(firstComponent, count, vertices->GetSize()));
+	Command& command = this->Add(CommandCommitVertexRange);
+	command.storage = vertices;
+	command.first = firstComponent;
+	command.count = count;
+}
+
+void CommandList::Commit(IndexBuffer* indices) {
+	assert(indices != NULL);
+	this->Add(CommandCommitIndices).indices = indices;
+}
+
+void CommandList::BeginDraw(VertexBuffer* vertices, IndexBuffer* indices) {
+	assert(vertices != NULL);
+	assert(this->boundVertices == NULL); // The last BeginDraw wasn't ended
+	Command& command = this->Add(CommandBeginDraw);
+	command.vertices = vertices;
+	command.indices = indices;
+	this->boundVertices = vertices;
+	this->boundIndices = indices;
+}
+
+void CommandList::DrawRange(GLenum primitiveType, size_t startIndex, size_t indexCount) {
+	assert(this->boundIndices != NULL); // BeginDraw with an index buffer first
+	assert(IsRangeWithin(startIndex, indexCount, this->boundIndices->getSize()));
+	Command& command = this->Add(CommandDrawRange);
+	command.vertices = this->boundVertices;
+	command.indices = this->boundIndices;
+	command.primitiveType = primitiveType;
+	command.first = startIndex;
+	command.count = indexCount;
+}
+
+void CommandList::EndDraw() {
+	assert(this->boundVertices != NULL); // Nothing to end
+	this->Add(CommandEndDraw).vertices = this->boundVertices;
+	this->boundVertices = NULL;
+	this->boundIndices = NULL;
+}
+
+void CommandList::Draw(VertexBuffer* vertices, GLenum primitiveType) {
+	assert(vertices != NULL);
+	Command& command = this->Add(CommandDraw);
+	command.vertices = vertices;
+	command.primitiveType = primitiveType;
+}
+
+void CommandList::DrawIndexed(VertexBuffer* vertices, IndexBuffer* indices, GLenum primitiveType) {
+	assert(vertices != NULL && indices != NULL);
+	Command& command = this->Add(CommandDrawIndexed);
+	command.vertices = vertices;
+	command.indices = indices;
+	command.primitiveType = primitiveType;
+}
+
+void CommandList::DrawIndexed(VertexBuffer* vertices, IndexBuffer* indices, size_t startIndex, size_t indexCount,
+							  GLenum primitiveType) {
+	assert(vertices != NULL && indices != NULL);
+	assert(indexCount > 0 && IsRangeWithin(startIndex, indexCount, indices->getSize()));
+	Command& command = this->Add(CommandDrawIndexed);
+	command.vertices = vertices;
+	command.indices = indices;
+	command.primitiveType = primitiveType;
+	command.first = startIndex;
+	command.count = indexCount;
+}
+
+void CommandList::Replay() const {
+	assert(this->boundVertices == NULL); // A BeginDraw was never ended
+	for(size_t i = 0; i < this->commands.size(); i++) {
+		const Command& command = this->commands[i];
+		switch(command.type) {
+			case CommandCommitVertices:
+				command.storage->Commit();
+				break;
+			case CommandCommitVertexRange:
+				command.storage->CommitRange(command.first, command.count);
+				break;
+			case CommandCommitIndices:
+				command.indices->Commit();
+				break;
+			case CommandBeginDraw:
+				command.vertices->BeginDraw(command.indices);
+				break;
+			case CommandDrawRange:
+				command.indices->DrawRange(command.primitiveType, command.first, command.count);
+				break;
+			case CommandEndDraw:
+				command.vertices->EndDraw();
+				break;
+			case CommandDraw:
+				command.vertices->Draw(command.primitiveType);
+				break;
+			case CommandDrawIndexed:
+				if(command.count == 0) {
+					command.vertices->DrawIndexed(*command.indices, command.primitiveType);
+				}
+				else {
+					command.vertices->DrawIndexed(*command.indices, command.first, command.count, command.primitiveType);
+				}
+				break;
+		}
+	}
+}
+
+void CommandList::Clear() {
+	assert(this->boundVertices == NULL); // A BeginDraw was never ended
+	this->commands.clear();
+}
+
+//--------------------------------------------------------------------------
+
+CommandQueue::CommandQueue(size_t listCount) {
+	assert(listCount > 0);
+	this->lists.reserve(listCount);
+	for(size_t i = 0; i < listCount; i++) {
+		this->lists.push_back(new CommandList());
+	}
+}
+
+CommandQueue::~CommandQueue() {
+	for(size_t i = 0; i < this->lists.size(); i++) {
+		delete this->lists[i];
+	}
+}
+
+size_t CommandQueue::GetCommandCount() const {
+	size_t count = 0;
+	for(size_t i = 0; i < this->lists.size(); i++) {
+		count += this->lists[i]->GetCommandCount();
+	}
+	return count;
+}
+
+void CommandQueue::Replay(bool clear) {
+	for(size_t i = 0; i < this->lists.size(); i++) {
+		this->lists[i]->Replay();
+	}
+	if(clear) {
+		this->Clear();
+	}
+}
+
+void CommandQueue::Clear() {
+	for(size_t i = 0; i < this->lists.size(); i++) {
+		this->lists[i]->Clear();
+	}
+}
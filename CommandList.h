@@ -0,0 +1,144 @@
+#ifndef _591_COMMANDLIST_H_
+#define _591_COMMANDLIST_H_
+
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include <vector>
+#include <cstddef>
+
+/*
+	Recording draws on any thread and issuing them on the one thread that owns the GL context.
+	Each recording thread (or job) gets a CommandList of its own from a CommandQueue and records
+	binds, draws and commits into it with no locking, since nothing else touches that list until
+	the recording is over. Once every recorder has finished (joined, or otherwise synchronised with),
+	the GL thread replays the lists in index order, each in the order it was recorded, so the GL
+	calls come out the same however the recording was scheduled.
+	Commands only hold pointers; the buffers have to outlive the replay. Recording threads may
+	fill shadow arrays before recording a commit, as long as the shadow is there to fill: a released
+	shadow is read back from GL, which only the GL thread may do. The buffers themselves can be built
+	on recording threads too, since they make no GL calls until they're first committed or drawn.
+*/
+
+/// What a recorded command does when it's replayed
+enum CommandType {
+	/// VertexBufferStorage::Commit
+	CommandCommitVertices = 0,
+	/// VertexBufferStorage::CommitRange
+	CommandCommitVertexRange,
+	/// IndexBuffer::Commit
+	CommandCommitIndices,
+	/// TypedVertexBuffer::BeginDraw, binding the buffers for the draws that follow
+	CommandBeginDraw,
+	/// IndexBuffer::DrawRange on the buffers bound by the last CommandBeginDraw
+	CommandDrawRange,
+	/// TypedVertexBuffer::EndDraw
+	CommandEndDraw,
+	/// TypedVertexBuffer::Draw
+	CommandDraw,
+	/// TypedVertexBuffer::DrawIndexed, all of the indices or a range of them
+	CommandDrawIndexed
+};
+
+/// One recorded command. Which fields mean anything depends on the type.
+struct Command {
+	CommandType type;
+	VertexBuffer* vertices;
+	/// The buffer committed by the commit commands, which may be any vertex buffer
+	VertexBufferStorage* storage;
+	IndexBuffer* indices;
+	GLenum primitiveType;
+	/// The first index and the index count of a range draw, or the first component and the component count of a range commit.
+	/// A count of 0 for CommandDrawIndexed means all of the indices.
+	size_t first;
+	size_t count;
+};
+
+/**
+	\brief Commands recorded by one thread, to be replayed on the GL thread.
+	Clearing keeps the list's memory, so a list reused every frame stops allocating once it's big enough.
+*/
+class CommandList {
+public:
+	CommandList();
+public:
+	/// Record a VertexBufferStorage::Commit
+	void Commit(VertexBufferStorage* vertices);
+	/// Record a VertexBufferStorage::CommitRange
+	void CommitRange(VertexBufferStorage* vertices, size_t firstComponent, size_t count);
+	/// Record an IndexBuffer::Commit
+	void Commit(IndexBuffer* indices);
+	/**
+		\brief Record binding a vertex buffer, and optionally an index buffer, for DrawRange commands that follow.
+		Pair it with EndDraw in the same list.
+	*/
+	void BeginDraw(VertexBuffer* vertices, IndexBuffer* indices = NULL);
+	/// Record drawing a range of the index buffer bound by BeginDraw
+	void DrawRange(GLenum primitiveType, size_t startIndex, size_t indexCount);
+	/// Record undoing the last BeginDraw
+	void EndDraw();
+	/// Record a TypedVertexBuffer::Draw
+	void Draw(VertexBuffer* vertices, GLenum primitiveType = GL_TRIANGLES);
+	/// Record a TypedVertexBuffer::DrawIndexed of all of the indices
+	void DrawIndexed(VertexBuffer* vertices, IndexBuffer* indices, GLenum primitiveType = GL_TRIANGLES);
+	/// Record a TypedVertexBuffer::DrawIndexed of a range of the indices
+	void DrawIndexed(VertexBuffer* vertices, IndexBuffer* indices, size_t startIndex, size_t indexCount,
+					 GLenum primitiveType = GL_TRIANGLES);
+public:
+	/// Issue every command in the order it was recorded. GL thread only.
+	void Replay() const;
+	/// Forget every command, keeping the memory.
+	void Clear();
+	size_t GetCommandCount() const {
+		return this->commands.size();
+	}
+	const Command& GetCommand(size_t index) const {
+		return this->commands[index];
+	}
+private:
+	Command& Add(CommandType type);
+	// Lists are handed out by reference; copying one by accident would lose its commands
+	CommandList(const CommandList&);
+	CommandList& operator=(const CommandList&);
+private:
+	std::vector<Command> commands;
+	/// The buffers of the open BeginDraw, recorded into the DrawRange and EndDraw commands that follow it
+	VertexBuffer* boundVertices;
+	IndexBuffer* boundIndices;
+};
+
+/**
+	\brief A fixed set of command lists, recorded in parallel and replayed in order.
+	Give each recording job its own list by index, e.g. its chunk number, rather than by which thread
+	happens to run it; the replay order then depends only on the indices.
+*/
+class CommandQueue {
+public:
+	/// \param listCount	The number of lists to record into at once.
+	explicit CommandQueue(size_t listCount);
+	~CommandQueue();
+public:
+	/// The list for recorder index to record into. Safe from any thread, as long as no two use the same index at once.
+	CommandList& GetList(size_t index) {
+		return *this->lists[index];
+	}
+	size_t GetListCount() const {
+		return this->lists.size();
+	}
+	/// The commands recorded in every list
+	size_t GetCommandCount() const;
+	/**
+		\brief Issue every list's commands, list 0 first. GL thread only, once recording is over.
+		\param clear	Whether to clear the lists afterwards, ready for the next frame.
+	*/
+	void Replay(bool clear = true);
+	/// Forget every command without issuing it.
+	void Clear();
+private:
+	CommandQueue(const CommandQueue&);
+	CommandQueue& operator=(const CommandQueue&);
+private:
+	/// Allocated one by one, so lists recorded on different threads don't share cache lines as they grow
+	std::vector<CommandList*> lists;
+};
+
+#endif
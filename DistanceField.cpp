@@ -0,0 +1,313 @@
+#include "DistanceField.h"
+#include "Parallel.h"
+#include "CheckedSize.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+namespace {
+
+/// Grid points left around the mesh's box, so marches have room to come out the other side
+const size_t FieldPadding = 2;
+
+/// The closest point to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+Vector3 ClosestPointOnTriangle(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c) {
+	Vector3 ab = b - a;
+	Vector3 ac = c - a;
+	Vector3 ap = p - a;
+	float d1 = ab.dot(ap);
+	float d2 = ac.dot(ap);
+	if(d1 <= 0.0f && d2 <= 0.0f) {
+		return a;
+	}
+
+	Vector3 bp = p - b;
+	float d3 = ab.dot(bp);
+	float d4 = ac.dot(bp);
+	if(d3 >= 0.0f && d4 <= d3) {
+		return b;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		return a + ab * (d1 / (d1 - d3));
+	}
+
+	Vector3 cp = p - c;
+	float d5 = ab.dot(cp);
+	float d6 = ac.dot(cp);
+	if(d6 >= 0.0f && d5 <= d6) {
+		return c;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		return a + ac * (d2 / (d2 - d6));
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	float denominator = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+/// Every distance along a ray where it crosses the mesh. Hits a hair apart are one crossing through an edge.
+void FindCrossings(const MeshRayQuery& query, Ray ray, float hair, std::vector<float>& crossings) {
+	crossings.clear();
+	RayHit hit;
+	while(query.ClosestHit(ray, hit)) {
+		crossings.push_back(hit.distance);
+		ray.minimumDistance = hit.distance + hair;
+	}
+}
+
+float DistanceSquared(const Vector3& a, const Vector3& b) {
+	Vector3 d = a - b;
+	return d.dot(d);
+}
+
+}
+
+//--------------------------------------------------------------------------
+
+DistanceField::DistanceField() {
+	this->cellSize = 0.0f;
+	this->size[0] = this->size[1] = this->size[2] = 0;
+}
+
+size_t DistanceField::GetBuildBytes(size_t resolution) {
+	// The closest points and the flooded copy of them, then the distances; a grid point more than the resolution
+	// along each axis, and the padding around it
+	size_t side = resolution + 1 + FieldPadding * 2;
+	size_t points = 0;
+	size_t bytes = 0;
+	if(!MultiplySizes(side, side, points) || !MultiplySizes(points, side, points)
+	   || !MultiplySizes(points, 2 * sizeof(Vector3) + sizeof(float), bytes)) {
+		return (size_t)-1;
+	}
+	return bytes;
+}
+
+void DistanceField::Build(const MeshRayQuery& query, const float* positions, size_t stride, const unsigned int* indices,
+						  size_t triangleCount, size_t resolution) {
+	assert(resolution >= 2);
+	this->distances.clear();
+	BoundingBox bounds = query.GetBounds();
+	if(triangleCount == 0 || bounds.IsEmpty()) {
+		return;
+	}
+
+	// Lay the grid over the box with a little room around it
+	Vector3 extent = bounds.maximum - bounds.minimum;
+	float longest = std::max(extent[0], std::max(extent[1], extent[2]));
+	this->cellSize = (longest > 0.0f) ? longest / (resolution - 1) : 1.0f;
+	this->origin = bounds.minimum - Vector3(1.0f, 1.0f, 1.0f) * (FieldPadding * this->cellSize);
+	for(size_t axis = 0; axis < 3; axis++) {
+		this->size[axis] = (size_t)std::ceil(extent[axis] / this->cellSize) + 1 + FieldPadding * 2;
+	}
+	size_t pointCount = this->size[0] * this->size[1] * this->size[2];
+
+	// The closest point on the surface found so far for every grid point. Far away until found.
+	const float far = std::numeric_limits<float>::max();
+	std::vector<Vector3> closest(pointCount, Vector3(far, far, far));
+
+	// Seed the grid points at the corners of the cells each triangle passes through with their exact closest point. Each thread
+	// takes a slab of the grid and writes only into it, so no two threads touch the same point.
+	ParallelFor(this->size[2], 2, 1, [&](size_t zBegin, size_t zEnd) {
+		for(size_t t = 0; t < triangleCount; t++) {
+			const float* p0 = positions + indices[t * 3] * stride;
+			const float* p1 = positions + indices[t * 3 + 1] * stride;
+			const float* p2 = positions + indices[t * 3 + 2] * stride;
+			Vector3 a(p0[0], p0[1], p0[2]), b(p1[0], p1[1], p1[2]), c(p2[0], p2[1], p2[2]);
+
+			size_t lower[3], upper[3];
+			for(size_t axis = 0; axis < 3; axis++) {
+				float low = (std::min(a[axis], std::min(b[axis], c[axis])) - this->origin[axis]) / this->cellSize;
+				float high = (std::max(a[axis], std::max(b[axis], c[axis])) - this->origin[axis]) / this->cellSize;
+				lower[axis] = (size_t)std::max(0.0f, std::floor(low));
+				upper[axis] = std::min(this->size[axis] - 1, (size_t)std::ceil(high));
+			}
+			lower[2] = std::max(lower[2], zBegin);
+			upper[2] = std::min(upper[2], zEnd - 1);
+
+			for(size_t z = lower[2]; z <= upper[2] && z < zEnd; z++) {
+				for(size_t y = lower[1]; y <= upper[1]; y++) {
+					for(size_t x = lower[0]; x <= upper[0]; x++) {
+						Vector3 p = this->Position(x, y, z);
+						Vector3 candidate = ClosestPointOnTriangle(p, a, b, c);
+						size_t i = this->Index(x, y, z);
+						if(DistanceSquared(p, candidate) < DistanceSquared(p, closest[i])) {
+							closest[i] = candidate;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	// Jump flood the closest points out to the rest of the grid, halving the jump each pass. Each jump is
+	// done one axis at a time, looking 2 neighbours away instead of 26, which misses very little. One last
+	// round of 1 cleans up most of what the halving gets wrong.
+	size_t largest = std::max(this->size[0], std::max(this->size[1], this->size[2]));
+	std::vector<size_t> jumps;
+	for(size_t jump = 1; jump < largest; jump *= 2) {
+		jumps.insert(jumps.begin(), jump);
+	}
+	jumps.push_back(1);
+
+	std::vector<Vector3> flooded(pointCount);
+	for(size_t pass = 0; pass < jumps.size() * 3; pass++) {
+		size_t jump = jumps[pass / 3];
+		size_t axis = pass % 3;
+		size_t axisStride = (axis == 0) ? 1 : (axis == 1 ? this->size[0] : this->size[0] * this->size[1]);
+		size_t offset = jump * axisStride;
+		ParallelFor(this->size[2], 2, 1, [&](size_t zBegin, size_t zEnd) {
+			Vector3 step(this->cellSize, 0.0f, 0.0f);
+			for(size_t z = zBegin; z < zEnd; z++) {
+				for(size_t y = 0; y < this->size[1]; y++) {
+					size_t i = this->Index(0, y, z);
+					Vector3 p = this->Position(0, y, z);
+					// Along x the neighbours come and go with x; along y and z they're there for the whole row or not
+					bool lowRow = (axis == 1 && y >= jump) || (axis == 2 && z >= jump);
+					bool highRow = (axis == 1 && y + jump < this->size[1]) || (axis == 2 && z + jump < this->size[2]);
+					for(size_t x = 0; x < this->size[0]; x++, i++, p += step) {
+						Vector3 best = closest[i];
+						float bestDistance = DistanceSquared(p, best);
+						if(axis == 0 ? x >= jump : lowRow) {
+							const Vector3& candidate = closest[i - offset];
+							float distance = DistanceSquared(p, candidate);
+							if(distance < bestDistance) {
+								bestDistance = distance;
+								best = candidate;
+							}
+						}
+						if(axis == 0 ? x + jump < this->size[0] : highRow) {
+							const Vector3& candidate = closest[i + offset];
+							if(DistanceSquared(p, candidate) < bestDistance) {
+								best = candidate;
+							}
+						}
+						flooded[i] = best;
+					}
+				}
+			}
+		});
+		closest.swap(flooded);
+	}
+
+	this->distances.resize(pointCount);
+	for(size_t i = 0; i < pointCount; i++) {
+		size_t x = i % this->size[0];
+		size_t y = (i / this->size[0]) % this->size[1];
+		size_t z = i / (this->size[0] * this->size[1]);
+		this->distances[i] = std::sqrt(DistanceSquared(this->Position(x, y, z), closest[i]));
+	}
+
+	// Sign each row of points by the number of times a ray along it has crossed the surface. The ray is
+	// nudged off the grid line so it doesn't run along edges and count them twice. A closed mesh is crossed
+	// an even number of times, so an odd count means the ray slipped between two triangles or grazed the
+	// surface; nudge it again, and if that keeps happening, sign each point in the row with a ray across it.
+	const float nudges[3][2] = { { 0.000123f, 0.000071f }, { -0.000317f, 0.000219f }, { 0.000273f, -0.000431f } };
+	const float hair = this->cellSize * 0.0001f;
+	size_t rows = this->size[1] * this->size[2];
+	ParallelFor(rows, 2, 1, [&](size_t rowBegin, size_t rowEnd) {
+		std::vector<float> crossings;
+		for(size_t row = rowBegin; row < rowEnd; row++) {
+			size_t y = row % this->size[1];
+			size_t z = row / this->size[1];
+			for(size_t attempt = 0; attempt < 3; attempt++) {
+				Vector3 nudge(0.0f, nudges[attempt][0], nudges[attempt][1]);
+				Ray ray(this->Position(0, y, z) + nudge * this->cellSize, Vector3(1.0f, 0.0f, 0.0f));
+				ray.maximumDistance = this->cellSize * this->size[0];
+				FindCrossings(query, ray, hair, crossings);
+				if(crossings.size() % 2 == 0) {
+					break;
+				}
+			}
+
+			if(crossings.size() % 2 == 0) {
+				size_t crossed = 0;
+				for(size_t x = 0; x < this->size[0]; x++) {
+					float along = x * this->cellSize;
+					while(crossed < crossings.size() && crossings[crossed] < along) {
+						crossed++;
+					}
+					if(crossed % 2 == 1) {
+						this->distances[this->Index(x, y, z)] *= -1.0f;
+					}
+				}
+				continue;
+			}
+
+			for(size_t x = 0; x < this->size[0]; x++) {
+				Vector3 nudge(nudges[0][0], 0.0f, nudges[0][1]);
+				Ray ray(this->Position(x, y, z) + nudge * this->cellSize, Vector3(0.0f, 1.0f, 0.0f));
+				ray.maximumDistance = this->cellSize * this->size[1];
+				FindCrossings(query, ray, hair, crossings);
+				if(crossings.size() % 2 == 1) {
+					this->distances[this->Index(x, y, z)] *= -1.0f;
+				}
+			}
+		}
+	});
+}
+
+float DistanceField::Sample(const Vector3& p) const {
+	assert(!this->IsEmpty());
+	float g[3];
+	size_t lower[3];
+	float fraction[3];
+	for(size_t axis = 0; axis < 3; axis++) {
+		g[axis] = (p[axis] - this->origin[axis]) / this->cellSize;
+		g[axis] = std::min(std::max(g[axis], 0.0f), (float)(this->size[axis] - 1));
+		lower[axis] = std::min((size_t)g[axis], this->size[axis] - 2);
+		fraction[axis] = g[axis] - lower[axis];
+	}
+
+	const float* d = &this->distances[this->Index(lower[0], lower[1], lower[2])];
+	size_t dy = this->size[0];
+	size_t dz = this->size[0] * this->size[1];
+	float x00 = d[0] + (d[1] - d[0]) * fraction[0];
+	float x10 = d[dy] + (d[dy + 1] - d[dy]) * fraction[0];
+	float x01 = d[dz] + (d[dz + 1] - d[dz]) * fraction[0];
+	float x11 = d[dz + dy] + (d[dz + dy + 1] - d[dz + dy]) * fraction[0];
+	float y0 = x00 + (x10 - x00) * fraction[1];
+	float y1 = x01 + (x11 - x01) * fraction[1];
+	return y0 + (y1 - y0) * fraction[2];
+}
+
+float DistanceField::DistanceThrough(const Vector3& origin, const Vector3& direction) const {
+	// Inside, nothing is nearer than the distance read there, so the march can jump that far (sphere tracing).
+	// Steps never drop below half a cell, though, or it would crawl along next to the surface.
+	float minimumStep = this->cellSize * 0.5f;
+	float limit = this->cellSize * (this->size[0] + this->size[1] + this->size[2]);
+	float t = 0.0f;
+	float d = this->Sample(origin);
+	bool inside = false;
+
+	while(t < limit) {
+		float step = std::max(std::fabs(d), minimumStep);
+		float nextT = t + step;
+		float nextD = this->Sample(origin + direction * nextT);
+		if(nextD < 0.0f) {
+			inside = true;
+		}
+		else if(inside) {
+			// Out the other side somewhere in this step; put it where the distance crosses zero
+			return t + step * (-d / (nextD - d));
+		}
+		else if(nextT >= this->cellSize * 2.0f) {
+			// Never got inside, so it's thinner than the grid can see
+			return this->cellSize;
+		}
+		t = nextT;
+		d = nextD;
+	}
+	return std::numeric_limits<float>::max();
+}
@@ -0,0 +1,66 @@
+#ifndef _591_DISTANCEFIELD_H_
+#define _591_DISTANCEFIELD_H_
+
+#include "MeshRayQuery.h"
+#include <vector>
+#include <cstddef>
+
+/// Grid points along the longest side of a mesh's box, unless asked otherwise
+const size_t DefaultDistanceFieldResolution = 32;
+
+/**
+	\brief A signed distance field of a closed triangle mesh, sampled on a regular grid: negative inside,
+	positive outside. Distances are exact at the grid points next to the surface and spread out from
+	there with a jump flood, then signed by counting surface crossings along each row of the grid.
+	Building and jumping run on all hardware threads.
+*/
+class DistanceField {
+public:
+	DistanceField();
+public:
+	/**
+		\brief Voxelize a mesh, replacing anything built before.
+		\param query			A query built over the same triangles, used to tell inside from outside.
+		\param positions		The first vertex's x. y and z follow it.
+		\param stride			Floats from one vertex to the next, at least 3.
+		\param indices			Three zero-indexed vertices per triangle.
+		\param triangleCount	The number of triangles.
+		\param resolution		Grid points along the longest side of the mesh's box. Memory grows with its cube.
+	*/
+	void Build(const MeshRayQuery& query, const float* positions, size_t stride, const unsigned int* indices,
+			   size_t triangleCount, size_t resolution = DefaultDistanceFieldResolution);
+	/// The most main memory Build holds at once at a resolution, which a mesh as deep and tall as it is wide comes to.
+	static size_t GetBuildBytes(size_t resolution);
+	bool IsEmpty() const {
+		return this->distances.empty();
+	}
+	/// The distance between neighbouring grid points, which is about how far off samples can be
+	float GetCellSize() const {
+		return this->cellSize;
+	}
+	/// The signed distance at a point, trilinearly interpolated. Points off the grid read its nearest edge.
+	float Sample(const Vector3& p) const;
+	/**
+		\brief March from a point on the surface inwards along a direction until coming out the other side.
+		Features thinner than a cell read as a cell thick.
+		\param origin		A point on the surface.
+		\param direction	The way in, unit length.
+		\return				How far it is to the other side, or the largest float if the march leaves the grid first.
+	*/
+	float DistanceThrough(const Vector3& origin, const Vector3& direction) const;
+private:
+	size_t Index(size_t x, size_t y, size_t z) const {
+		return (z * this->size[1] + y) * this->size[0] + x;
+	}
+	Vector3 Position(size_t x, size_t y, size_t z) const {
+		return this->origin + Vector3((float)x, (float)y, (float)z) * this->cellSize;
+	}
+private:
+	/// Where grid point (0, 0, 0) is
+	Vector3 origin;
+	float cellSize;
+	size_t size[3];
+	std::vector<float> distances;
+};
+
+#endif
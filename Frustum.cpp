@@ -0,0 +1,129 @@
+#include "Frustum.h"
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+Frustum::Frustum() {
+	for(size_t i = 0; i < FrustumPlaneCount; i++) {
+		// 0 * p + 1 >= 0 everywhere
+		this->planes[i] = Vector4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const Matrix4& viewProjection) {
+	const Matrix4& m = viewProjection;
+	// Clip space is inside when -w <= x, y, z <= w, so each plane is the last row plus or minus another
+	for(size_t axis = 0; axis < 3; axis++) {
+		for(size_t side = 0; side < 2; side++) {
+			float sign = (side == 0) ? 1.0f : -1.0f;
+			Vector4 plane(
+				m(3, 0) + sign * m(axis, 0),
+				m(3, 1) + sign * m(axis, 1),
+				m(3, 2) + sign * m(axis, 2),
+				m(3, 3) + sign * m(axis, 3));
+			// Normalize so plane distances are real distances, which the sphere test needs
+			float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			assert(length > 0.0f);
+			this->planes[axis * 2 + side] = plane / length;
+		}
+	}
+}
+
+bool Frustum::Intersects(const BoundingSphere& sphere) const {
+	unsigned char visible;
+	return this->CullSpheres(&sphere, 1, &visible) == 1;
+}
+
+bool Frustum::Intersects(const BoundingBox& box) const {
+	unsigned char visible;
+	return this->CullBoxes(&box, 1, &visible) == 1;
+}
+
+size_t Frustum::CullSpheres(const BoundingSphere* spheres, size_t count, unsigned char* visible, size_t strideBytes) const {
+	const unsigned char* bytes = (const unsigned char*)spheres;
+	size_t visibleCount = 0;
+
+	for(size_t first = 0; first < count; first += 4) {
+		size_t lanes = std::min((size_t)4, count - first);
+
+		// Gather up to four spheres into lanes. Missing lanes get an empty sphere and are ignored.
+		alignas(16) float centres[3][4] = { { 0 } };
+		alignas(16) float radii[4] = { -1.0f, -1.0f, -1.0f, -1.0f };
+		for(size_t lane = 0; lane < lanes; lane++) {
+			const BoundingSphere& sphere = *(const BoundingSphere*)(bytes + (first + lane) * strideBytes);
+			centres[0][lane] = sphere.centre[0];
+			centres[1][lane] = sphere.centre[1];
+			centres[2][lane] = sphere.centre[2];
+			radii[lane] = sphere.radius;
+		}
+		Float4 x = Float4Load(centres[0]);
+		Float4 y = Float4Load(centres[1]);
+		Float4 z = Float4Load(centres[2]);
+		Float4 radius = Float4Load(radii);
+		Float4 negativeRadius = Float4Negate(radius);
+
+		// Outside if the centre is more than a radius behind any plane. Empty spheres are always outside.
+		int outside = Float4LessMask(radius, Float4Splat(0.0f));
+		for(size_t p = 0; p < FrustumPlaneCount && outside != 0xF; p++) {
+			const Vector4& plane = this->planes[p];
+			Float4 distance = Float4Add(Float4Add(Float4Mul(x, Float4Splat(plane[0])), Float4Mul(y, Float4Splat(plane[1]))),
+										Float4Add(Float4Mul(z, Float4Splat(plane[2])), Float4Splat(plane[3])));
+			outside |= Float4LessMask(distance, negativeRadius);
+		}
+
+		for(size_t lane = 0; lane < lanes; lane++) {
+			visible[first + lane] = ((outside >> lane) & 1) ? 0 : 1;
+			visibleCount += visible[first + lane];
+		}
+	}
+	return visibleCount;
+}
+
+size_t Frustum::CullBoxes(const BoundingBox* boxes, size_t count, unsigned char* visible, size_t strideBytes) const {
+	const unsigned char* bytes = (const unsigned char*)boxes;
+	size_t visibleCount = 0;
+
+	for(size_t first = 0; first < count; first += 4) {
+		size_t lanes = std::min((size_t)4, count - first);
+
+		alignas(16) float minima[3][4] = { { 0 } };
+		alignas(16) float maxima[3][4] = { { 0 } };
+		int empty = 0;
+		for(size_t lane = 0; lane < 4; lane++) {
+			if(lane >= lanes) {
+				empty |= 1 << lane;
+				continue;
+			}
+			const BoundingBox& box = *(const BoundingBox*)(bytes + (first + lane) * strideBytes);
+			if(box.IsEmpty()) {
+				empty |= 1 << lane;
+			}
+			for(size_t axis = 0; axis < 3; axis++) {
+				minima[axis][lane] = box.minimum[axis];
+				maxima[axis][lane] = box.maximum[axis];
+			}
+		}
+		Float4 minimum[3] = { Float4Load(minima[0]), Float4Load(minima[1]), Float4Load(minima[2]) };
+		Float4 maximum[3] = { Float4Load(maxima[0]), Float4Load(maxima[1]), Float4Load(maxima[2]) };
+
+		// Outside if even the corner furthest along a plane's normal is behind it
+		int outside = empty;
+		for(size_t p = 0; p < FrustumPlaneCount && outside != 0xF; p++) {
+			const Vector4& plane = this->planes[p];
+			Float4 distance = Float4Splat(plane[3]);
+			for(size_t axis = 0; axis < 3; axis++) {
+				const Float4& corner = (plane[axis] >= 0.0f) ? maximum[axis] : minimum[axis];
+				distance = Float4Add(distance, Float4Mul(corner, Float4Splat(plane[axis])));
+			}
+			outside |= Float4LessMask(distance, Float4Splat(0.0f));
+		}
+
+		for(size_t lane = 0; lane < lanes; lane++) {
+			visible[first + lane] = ((outside >> lane) & 1) ? 0 : 1;
+			visibleCount += visible[first + lane];
+		}
+	}
+	return visibleCount;
+}
@@ -0,0 +1,59 @@
+#ifndef _591_FRUSTUM_H_
+#define _591_FRUSTUM_H_
+
+#include "Matrix.h"
+#include "Bounds.h"
+#include <cstddef>
+
+/// The planes of a Frustum
+enum FrustumPlane {
+	FrustumLeft = 0,
+	FrustumRight,
+	FrustumBottom,
+	FrustumTop,
+	FrustumNear,
+	FrustumFar,
+	FrustumPlaneCount
+};
+
+/**
+	\brief A view frustum as six inward-facing planes, for culling bounds on the CPU before they're drawn.
+	The batch tests work on four bounds at a time with packed float math. They can read bounds straight
+	out of an array of larger structs, like MeshGeometry, by giving the distance between them in bytes.
+*/
+class Frustum {
+public:
+	/// A frustum that contains everything
+	Frustum();
+	/**
+		\brief Pull the planes out of a projection * view (* model) matrix, as given to OpenGL.
+		Bounds are tested in the space the matrix transforms from.
+	*/
+	explicit Frustum(const Matrix4& viewProjection);
+public:
+	/// Plane i as (normal, distance): a point p is inside it when dot(normal, p) + distance >= 0.
+	const Vector4& GetPlane(FrustumPlane plane) const {
+		return this->planes[plane];
+	}
+	/// Whether any of the sphere might be inside
+	bool Intersects(const BoundingSphere& sphere) const;
+	/// Whether any of the box might be inside
+	bool Intersects(const BoundingBox& box) const;
+	/**
+		\brief Test many spheres at once.
+		\param spheres		The first sphere.
+		\param count		The number of spheres.
+		\param visible		Receives 1 for each sphere that might be visible and 0 for each that isn't.
+		\param strideBytes	Bytes from one sphere to the next.
+		\return				The number of visible spheres.
+	*/
+	size_t CullSpheres(const BoundingSphere* spheres, size_t count, unsigned char* visible,
+					   size_t strideBytes = sizeof(BoundingSphere)) const;
+	/// Test many boxes at once, like CullSpheres.
+	size_t CullBoxes(const BoundingBox* boxes, size_t count, unsigned char* visible,
+					 size_t strideBytes = sizeof(BoundingBox)) const;
+private:
+	Vector4 planes[FrustumPlaneCount];
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "GeometryPool.h"
+#include <algorithm>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+OffsetAllocator::OffsetAllocator(unsigned int capacity) {
+	assert(capacity > 0 && capacity != InvalidOffset);
+	this->capacity = capacity;
+	this->freeCount = capacity;
+	this->freeBlocks[0] = capacity;
+}
+
+unsigned int OffsetAllocator::Allocate(unsigned int count) {
+	assert(count > 0);
+	for(std::map<unsigned int, unsigned int>::iterator block = this->freeBlocks.begin(); block != this->freeBlocks.end(); ++block) {
+		if(block->second >= count) {
+			unsigned int offset = block->first;
+			unsigned int remaining = block->second - count;
+			this->freeBlocks.erase(block);
+			if(remaining > 0) {
+				this->freeBlocks[offset + count] = remaining;
+			}
+			this->freeCount -= count;
+			return offset;
+		}
+	}
+	return InvalidOffset;
+}
+
+void OffsetAllocator::Free(unsigned int offset, unsigned int count) {
+	assert(count > 0 && offset + count <= this->capacity);
+	this->freeCount += count;
+
+	std::map<unsigned int, unsigned int>::iterator next = this->freeBlocks.lower_bound(offset);
+	assert(next == this->freeBlocks.end() || next->first >= offset + count); // Double free?
+
+	// Swallow the block after us
+	if(next != this->freeBlocks.end() && next->first == offset + count) {
+		count += next->second;
+		this->freeBlocks.erase(next++);
+	}
+
+	// Grow the block before us if we touch it, otherwise start a new one
+	if(next != this->freeBlocks.begin()) {
+		std::map<unsigned int, unsigned int>::iterator previous = next;
+		--previous;
+		assert(previous->first + previous->second <= offset); // Double free?
+		if(previous->first + previous->second == offset) {
+			previous->second += count;
+			return;
+		}
+	}
+	this->freeBlocks[offset] = count;
+}
+
+void OffsetAllocator::Reset(unsigned int used) {
+	assert(used <= this->capacity);
+	this->freeBlocks.clear();
+	if(used < this->capacity) {
+		this->freeBlocks[used] = this->capacity - used;
+	}
+	this->freeCount = this->capacity - used;
+}
+
+unsigned int OffsetAllocator::GetLargestFreeBlock() const {
+	unsigned int largest = 0;
+	for(std::map<unsigned int, unsigned int>::const_iterator block = this->freeBlocks.begin(); block != this->freeBlocks.end(); ++block) {
+		largest = std::max(largest, block->second);
+	}
+	return largest;
+}
+
+//--------------------------------------------------------------------------
+
+GeometryPool::GeometryPool(VertexFormat format, unsigned int vertexCapacity, unsigned int indexCapacity,
+						   ShadowPolicy shadowPolicy)
+	: vertexAllocator(vertexCapacity), indexAllocator(indexCapacity) {
+	unsigned int stride = GetVertexLayoutDescriptor(format).stride;
+	this->vertices = new VertexBuffer(vertexCapacity * stride, format, shadowPolicy);
+	this->indices = new IndexBuffer(indexCapacity, shadowPolicy);
+	// Meshes share the pool's buffers, so they're counted as one
+	MemoryTag* memoryTag = MemoryAccounting::GetTag("GeometryPool");
+	this->vertices->SetMemoryTag(memoryTag);
+	this->indices->SetMemoryTag(memoryTag);
+}
+
+GeometryPool::~GeometryPool() {
+	delete this->vertices;
+	delete this->indices;
+}
+
+GeometryHandle GeometryPool::Allocate(unsigned int vertexCount, unsigned int indexCount) {
+	GeometryHandle handle;
+
+	unsigned int firstVertex = this->vertexAllocator.Allocate(vertexCount);
+	if(firstVertex == OffsetAllocator::InvalidOffset) {
+		return handle;
+	}
+	unsigned int firstIndex = this->indexAllocator.Allocate(indexCount);
+	if(firstIndex == OffsetAllocator::InvalidOffset) {
+		this->vertexAllocator.Free(firstVertex, vertexCount);
+		return handle;
+	}
+
+	GeometryRange range;
+	range.firstVertex = firstVertex;
+	range.vertexCount = vertexCount;
+	range.firstIndex = firstIndex;
+	range.indexCount = indexCount;
+
+	if(!this->freeIds.empty()) {
+		handle.id = this->freeIds.back();
+		this->freeIds.pop_back();
+		this->ranges[handle.id] = range;
+		this->live[handle.id] = true;
+	}
+	else {
+		handle.id = (unsigned int)this->ranges.size();
+		this->ranges.push_back(range);
+		this->live.push_back(true);
+		this->generations.push_back(0);
+	}
+	handle.generation = this->generations[handle.id];
+	handle.pool = this;
+	return handle;
+}
+
+void GeometryPool::Free(GeometryHandle handle) {
+	assert(this->IsLive(handle)); // Freed already, or from another pool
+	if(!this->IsLive(handle)) {
+		// Don't free the mesh that took over the id
+		return;
+	}
+
+	const GeometryRange& range = this->ranges[handle.id];
+	this->vertexAllocator.Free(range.firstVertex, range.vertexCount);
+	this->indexAllocator.Free(range.firstIndex, range.indexCount);
+
+	this->live[handle.id] = false;
+	this->generations[handle.id]++;
+	this->freeIds.push_back(handle.id);
+}
+
+const GeometryRange& GeometryPool::GetRange(GeometryHandle handle) const {
+	assert(this->IsLive(handle)); // Freed already, or from another pool
+	return this->ranges[handle.id];
+}
+
+/// Sorts handle ids by where their data starts, so ranges can be packed down in order.
+struct GeometryRangeOrder {
+	GeometryRangeOrder(const std::vector<GeometryRange>& ranges, bool byIndex) : ranges(ranges), byIndex(byIndex) { }
+	bool operator()(unsigned int a, unsigned int b) const {
+		return byIndex ? (ranges[a].firstIndex < ranges[b].firstIndex) : (ranges[a].firstVertex < ranges[b].firstVertex);
+	}
+	const std::vector<GeometryRange>& ranges;
+	bool byIndex;
+};
+
+void GeometryPool::Defragment() {
+	std::vector<unsigned int> order;
+	for(unsigned int id = 0; id < this->ranges.size(); id++) {
+		if(this->live[id]) {
+			order.push_back(id);
+		}
+	}
+
+	// Vertices. Each range only ever moves down, and in ascending order, so nothing is overwritten before it moves.
+	unsigned int stride = this->vertices->GetVertexStride();
+	std::sort(order.begin(), order.end(), GeometryRangeOrder(this->ranges, false));
+	unsigned int nextVertex = 0;
+	for(size_t i = 0; i < order.size(); i++) {
+		GeometryRange& range = this->ranges[order[i]];
+		if(range.firstVertex != nextVertex) {
+			this->vertices->Move(nextVertex * stride, range.firstVertex * stride, range.vertexCount * stride);
+			range.firstVertex = nextVertex;
+		}
+		nextVertex += range.vertexCount;
+	}
+	this->vertexAllocator.Reset(nextVertex);
+
+	// Indices are relative to the first vertex, so they move without being rewritten.
+	std::sort(order.begin(), order.end(), GeometryRangeOrder(this->ranges, true));
+	unsigned int nextIndex = 0;
+	for(size_t i = 0; i < order.size(); i++) {
+		GeometryRange& range = this->ranges[order[i]];
+		if(range.firstIndex != nextIndex) {
+			this->indices->Move(nextIndex, range.firstIndex, range.indexCount);
+			range.firstIndex = nextIndex;
+		}
+		nextIndex += range.indexCount;
+	}
+	this->indexAllocator.Reset(nextIndex);
+}
+
+void GeometryPool::Commit() {
+	this->vertices->Commit();
+	this->indices->Commit();
+}
+
+void GeometryPool::CommitRange(GeometryHandle handle) {
+	const GeometryRange& range = this->GetRange(handle);
+	unsigned int stride = this->vertices->GetVertexStride();
+	this->vertices->CommitRange((size_t)range.firstVertex * stride, (size_t)range.vertexCount * stride);
+	this->indices->CommitRange(range.firstIndex, range.indexCount);
+}
+
+//--------------------------------------------------------------------------
+
+void GeometryPool::BeginDraw() const {
+	this->vertices->BeginDraw(this->indices);
+	// DrawMesh draws straight from the buffers, so restart-joined strips need restart on here
+	this->indices->BeginRestart();
+}
+
+void GeometryPool::DrawMesh(GeometryHandle handle, GLenum primitiveType) const {
+	assert(this->IsLive(handle)); // Freed already, or from another pool
+	if(!this->IsLive(handle)) {
+		// Don't draw the mesh that took over the id
+		return;
+	}
+	const GeometryRange& range = this->GetRange(handle);
+	const GLvoid* firstIndex = (const GLvoid*)(range.firstIndex * sizeof(IndexType));
+
+	if(_GLEE_ARB_draw_elements_base_vertex) {
+		glDrawElementsBaseVertex(primitiveType, range.indexCount, GL_INDEX_TYPE, (GLvoid*)firstIndex, range.firstVertex);
+		RENDER_COUNT(CountDraw(primitiveType, range.indexCount));
+	}
+	else {
+		// Point the attributes at the mesh's first vertex instead
+		this->vertices->SetBaseVertex(range.firstVertex);
+		glDrawElements(primitiveType, range.indexCount, GL_INDEX_TYPE, firstIndex);
+		RENDER_COUNT(CountDraw(primitiveType, range.indexCount));
+	}
+}
+
+void GeometryPool::EndDraw() const {
+	this->indices->EndRestart();
+	this->vertices->EndDraw();
+}
+
+void GeometryPool::Draw(GeometryHandle handle, GLenum primitiveType) const {
+	glPushAttrib(GL_ALL_ATTRIB_BITS);
+	RENDER_COUNT(CountPushAttrib());
+	this->BeginDraw();
+	this->DrawMesh(handle, primitiveType);
+	this->EndDraw();
+	glPopAttrib();
+	RENDER_COUNT(CountPopAttrib());
+}
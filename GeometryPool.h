@@ -0,0 +1,161 @@
+#ifndef _585_GEOMETRYPOOL_H_
+#define _585_GEOMETRYPOOL_H_
+
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include <map>
+#include <vector>
+
+/**
+	\brief Hands out ranges of a fixed-size array. First-fit over a free list kept sorted by offset,
+	so neighbouring free blocks merge as soon as they're freed.
+*/
+class OffsetAllocator {
+public:
+	/// Returned by Allocate when there's no block big enough.
+	static const unsigned int InvalidOffset = 0xFFFFFFFFu;
+public:
+	OffsetAllocator(unsigned int capacity);
+	/// Reserve count elements, returning the offset of the first or InvalidOffset.
+	unsigned int Allocate(unsigned int count);
+	/// Return a range handed out by Allocate.
+	void Free(unsigned int offset, unsigned int count);
+	/// Mark [0, used) allocated and the rest free, for after everything has been packed down.
+	void Reset(unsigned int used);
+public:
+	unsigned int GetCapacity() const {
+		return this->capacity;
+	}
+	unsigned int GetFreeCount() const {
+		return this->freeCount;
+	}
+	/// The size of the biggest single allocation that would succeed right now.
+	unsigned int GetLargestFreeBlock() const;
+	/// The number of separate free blocks. More than one means the space is fragmented.
+	size_t GetFreeBlockCount() const {
+		return this->freeBlocks.size();
+	}
+private:
+	/// Free blocks, offset -> length
+	std::map<unsigned int, unsigned int> freeBlocks;
+	unsigned int capacity;
+	unsigned int freeCount;
+};
+
+//--------------------------------------------------------------------------
+
+class GeometryPool;
+
+/// A mesh living in a GeometryPool. Stays valid when the pool is defragmented.
+struct GeometryHandle {
+	GeometryHandle() {
+		pool = NULL;
+		id = 0;
+		generation = 0;
+	}
+	bool IsValid() const {
+		return pool != NULL;
+	}
+	GeometryPool* pool;
+	unsigned int id;
+	/// Which use of the id this is. Ids are reused after Free, so a handle kept past its mesh's Free is caught rather than reaching the next mesh.
+	unsigned int generation;
+};
+
+/// Where a mesh's data currently sits in its pool. Indices are relative to firstVertex.
+struct GeometryRange {
+	unsigned int firstVertex;
+	unsigned int vertexCount;
+	unsigned int firstIndex;
+	unsigned int indexCount;
+};
+
+/**
+	\brief One large vertex buffer and one large index buffer shared by many small meshes.
+	Meshes are (pool, range) handles instead of owning buffers, so a whole pool draws with a single
+	bind. Indices are stored relative to the mesh's first vertex and drawn with a base-vertex offset.
+*/
+class GeometryPool {
+public:
+	/**
+		\brief Create a pool.
+		\param format			The vertex format of every mesh in the pool.
+		\param vertexCapacity	The number of vertices (not components) the pool holds.
+		\param indexCapacity	The number of indices the pool holds.
+		\param shadowPolicy		What the pool's buffers do with their shadow arrays on Commit.
+	*/
+	GeometryPool(VertexFormat format, unsigned int vertexCapacity, unsigned int indexCapacity,
+				 ShadowPolicy shadowPolicy = ShadowRetained);
+	~GeometryPool();
+public:
+	/// Reserve space for a mesh. Returns an invalid handle if the pool is out of room.
+	GeometryHandle Allocate(unsigned int vertexCount, unsigned int indexCount);
+	/// Give a mesh's space back to the pool.
+	void Free(GeometryHandle handle);
+	/// Whether the handle refers to a mesh in this pool that hasn't been freed.
+	bool IsLive(GeometryHandle handle) const {
+		return handle.pool == this && handle.id < this->ranges.size() && this->live[handle.id]
+			&& this->generations[handle.id] == handle.generation;
+	}
+	/// Where the mesh's data currently sits.
+	const GeometryRange& GetRange(GeometryHandle handle) const;
+	/// Slide every mesh down to close the gaps between them. Handles stay valid; remember to Commit.
+	void Defragment();
+	/// Upload any changes made to the pool's buffers.
+	void Commit();
+	/**
+		\brief Upload just one mesh's vertices and indices, for after writing a mesh into a pool that's already up.
+		Keeps the shadow arrays whatever the shadow policy, so meshes can go in one after another without the
+		pool being read back each time; Commit once they're in to apply the policy.
+	*/
+	void CommitRange(GeometryHandle handle);
+public:
+	/**
+		\brief Bind the pool's buffers, ready for any number of DrawMesh calls. Pair with EndDraw.
+		Doesn't save GL state.
+	*/
+	void BeginDraw() const;
+	/// Draw one mesh between BeginDraw and EndDraw.
+	void DrawMesh(GeometryHandle handle, GLenum primitiveType = GL_TRIANGLES) const;
+	/// Undo BeginDraw.
+	void EndDraw() const;
+	/// Draw a single mesh, saving and restoring GL state around it.
+	void Draw(GeometryHandle handle, GLenum primitiveType = GL_TRIANGLES) const;
+public:
+	/// The pool's vertex buffer. Write a mesh's vertices starting at GetRange(handle).firstVertex.
+	VertexBuffer* GetVertices() const {
+		return this->vertices;
+	}
+	/// The pool's index buffer. Write a mesh's indices starting at GetRange(handle).firstIndex.
+	IndexBuffer* GetIndices() const {
+		return this->indices;
+	}
+	const OffsetAllocator& GetVertexAllocator() const {
+		return this->vertexAllocator;
+	}
+	const OffsetAllocator& GetIndexAllocator() const {
+		return this->indexAllocator;
+	}
+	/// The number of meshes currently in the pool.
+	size_t GetMeshCount() const {
+		return this->ranges.size() - this->freeIds.size();
+	}
+private:
+	// Owns buffers, no copying
+	GeometryPool(const GeometryPool&);
+	GeometryPool& operator=(const GeometryPool&);
+private:
+	VertexBuffer* vertices;
+	IndexBuffer* indices;
+	OffsetAllocator vertexAllocator;
+	OffsetAllocator indexAllocator;
+	/// Indexed by handle id
+	std::vector<GeometryRange> ranges;
+	std::vector<bool> live;
+	/// Bumped each time an id is freed, so handles from before don't match
+	std::vector<unsigned int> generations;
+	/// Ids of freed handles, for reuse
+	std::vector<unsigned int> freeIds;
+};
+
+#endif
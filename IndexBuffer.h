@@ -2,41 +2,114 @@
 #define _585_INDEXBUFFER_H_
 
 #include "GLee.h"
+#include "BufferShadow.h"
+#include "CheckedSize.h"
+#include "MemoryAccounting.h"
+#include "RenderCounters.h"
 #include <vector>
+#include <atomic>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
-/// The C type of the indices in the index buffer. Smaller types save GPU and main memory.
-typedef unsigned short IndexType;
+#ifndef OBJLOADER_16BIT_INDICES
+/// The C type of the indices in the index buffer. 32 bits, so one buffer can address the billions of corners of a scanned mesh.
+typedef unsigned int IndexType;
 /// The IndexType as OpenGL understands it.
+#define GL_INDEX_TYPE GL_UNSIGNED_INT
+#else
+/// 16-bit indices, for programs whose meshes all stay under 65535 corners. Half the index memory.
+typedef unsigned short IndexType;
 #define GL_INDEX_TYPE GL_UNSIGNED_SHORT
+#endif
+/// The index that ends one strip and starts the next when primitive restart is on. Never a real vertex.
+const IndexType PrimitiveRestartIndex = (IndexType)~0;
+/// The most vertices one run of indices can address: every IndexType value but PrimitiveRestartIndex
+const size_t MaxIndexedVertices = (size_t)PrimitiveRestartIndex;
+
+/// Something that keeps GL objects made for particular index buffers, told when one of them is destroyed. See IndexBuffer::AddUser.
+class IndexBufferUser {
+public:
+	virtual ~IndexBufferUser() { }
+	/// The index buffer with this serial is going away; let go of anything made for it.
+	virtual void IndexBufferDestroyed(unsigned int serial) = 0;
+};
 
 class IndexBuffer {
 public:
 	/// Constant index operator, for fetching a single index
 	IndexType operator[](size_t index) const {
 		assert(index >= 0 && index < this->size);
+		this->EnsureShadow();
 		return this->rawStorage[index];
 	}
 	/// Non-constant operator, for writing or reading a single index
 	IndexType& operator[](size_t index) {
 		assert(index >= 0 && index < this->size);
+		this->EnsureShadow();
 		return this->rawStorage[index];
 	}
 	/// Write the index buffer to the GPU, allocating the space we need
 	void Commit() const {
+		assert(this->mapping == NULL);
+		if(this->rawStorage == NULL && this->isCommitted) {
+			// Nothing was touched since the shadow was released, so the GPU copy is current.
+			return;
+		}
+		this->EnsureShadow(); // A deferred shadow goes up blank
+		this->Upload();
+		
+		if(this->shadowPolicy == ShadowReleasedAfterCommit) {
+			this->ReleaseShadow();
+		}
+	}
+	/// Commit if the indices have never gone to the GPU, so a draw doesn't read storage GL never allocated.
+	void EnsureCommitted() const {
+		if(!this->isCommitted) {
+			this->Commit();
+		}
+	}
+	/**
+		\brief Writes a run of indices to the GPU, for when only part of the buffer changed.
+		The rest of the buffer must already be current on the GPU; before the first upload the whole
+		buffer goes up instead. Keeps the shadow array whatever the shadow policy, so several runs
+		can go up in a row; Commit or ReleaseShadow afterwards.
+		\param firstIndex	The first index to upload.
+		\param count		The number of indices to upload.
+	*/
+	void CommitRange(size_t firstIndex, size_t count) const {
+		assert(IsRangeWithin(firstIndex, count, this->size));
+		if(this->rawStorage == NULL || count == 0) {
+			return;
+		}
+		if(!this->isCommitted) {
+			// Nothing on the GPU yet, so the first upload has to be all of it
+			this->Upload();
+			return;
+		}
 		this->Bind();
-		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, this->size * sizeof(IndexType), rawStorage, GL_STATIC_DRAW_ARB);
+		glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, firstIndex * sizeof(IndexType), count * sizeof(IndexType), this->rawStorage + firstIndex);
+		RENDER_COUNT(CountUpload(count * sizeof(IndexType)));
 	}
-	/// Bind the index buffer to the GPU state, preparing it for rendering
+	/// Bind the index buffer to the GPU state, preparing it for rendering. Creates the GL buffer the first time.
 	void Bind() const {
+		if(this->handle == 0) {
+			glGenBuffersARB(1, &this->handle);
+			assert(this->handle != 0);
+		}
 		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, this->handle);
+		RENDER_COUNT(CountBind());
 	}
 	/**
 	 	\brief Draw all elements of the bound vertex buffer using this (bound) index buffer
 		\param primitiveType	The GL primitive type to draw
 	*/
 	void DrawAll(GLenum primitiveType = GL_TRIANGLES) const {
-		glDrawElements(primitiveType, this->size, GL_INDEX_TYPE, NULL);
+		assert(FitsDrawCount(this->size)); // GL counts indices in an int
+		this->BeginRestart();
+		glDrawElements(primitiveType, (GLsizei)this->size, GL_INDEX_TYPE, NULL);
+		RENDER_COUNT(CountDraw(primitiveType, this->size));
+		this->EndRestart();
 	}
 	/**
 		\brief Draw a selected set of elements on the bound vertex buffer using the (bound) index buffer
@@ -44,32 +117,75 @@ public:
 		\param startIndex		The index in the index buffer to start drawing at
 		\param vertexCount		The number of indices in the index buffer to use (i.e. the number of vertices drawn)
 	*/
-	void DrawRange(GLenum primitiveType, unsigned int startIndex, unsigned int vertexCount) const {
-		glDrawRangeElements(primitiveType, startIndex, startIndex + vertexCount, vertexCount, GL_INDEX_TYPE, NULL);
+	void DrawRange(GLenum primitiveType, size_t startIndex, size_t vertexCount) const {
+		assert(IsRangeWithin(startIndex, vertexCount, this->size) && FitsDrawCount(vertexCount));
+		this->BeginRestart();
+		glDrawElements(primitiveType, (GLsizei)vertexCount, GL_INDEX_TYPE, (const GLvoid*)(startIndex * sizeof(IndexType)));
+		RENDER_COUNT(CountDraw(primitiveType, vertexCount));
+		this->EndRestart();
 	}
 	/**
-		\brief Instantiate the index buffer.
-		\param size	The number of indices to be stored in the buffer.
+		\brief Draw a selected set of elements, telling GL which vertices they use so it can fetch only those.
+		\param primitiveType	The GL primitive type to draw
+		\param startIndex		The index in the index buffer to start drawing at
+		\param vertexCount		The number of indices in the index buffer to use
+		\param firstVertex		The lowest vertex the indices refer to
+		\param lastVertex		The highest vertex the indices refer to
 	*/
-	IndexBuffer(unsigned int size) {
+	void DrawRange(GLenum primitiveType, size_t startIndex, size_t vertexCount,
+				   size_t firstVertex, size_t lastVertex) const {
+		assert(IsRangeWithin(startIndex, vertexCount, this->size) && FitsDrawCount(vertexCount));
+		assert(firstVertex <= lastVertex && lastVertex < MaxIndexedVertices); // No index can reach further
+		this->BeginRestart();
+		glDrawRangeElements(primitiveType, (GLuint)firstVertex, (GLuint)lastVertex, (GLsizei)vertexCount, GL_INDEX_TYPE,
+							(const GLvoid*)(startIndex * sizeof(IndexType)));
+		RENDER_COUNT(CountDraw(primitiveType, vertexCount));
+		this->EndRestart();
+	}
+	/**
+		\brief Instantiate the index buffer. Makes no GL calls, so it can be built and filled on any thread.
+		\param size			The number of indices to be stored in the buffer.
+		\param shadowPolicy	What to do with the shadow array once the buffer is committed.
+		\param shadowStart	Whether to skip making the shadow array, for a buffer about to go through MapForWriting.
+	*/
+	IndexBuffer(size_t size, ShadowPolicy shadowPolicy = ShadowRetained, ShadowStart shadowStart = ShadowZeroed) {
 		assert(size > 0);
+		assert(size <= (size_t)-1 / sizeof(IndexType)); // So every byte offset into the buffer fits a size_t
 		
 		this->handle = 0;
+		this->serial = IndexBuffer::NextSerial();
+		this->isCommitted = false;
+		this->mapping = NULL;
+		this->shadowPolicy = shadowPolicy;
+		this->primitiveRestart = false;
+		this->memoryTag = MemoryAccounting::GetDefaultTag();
+		this->gpuBytes = 0;
+		MemoryAccounting::AddBuffer(this->memoryTag);
 		
 		this->size = size;
 		// Allocate shadow storage
-		this->rawStorage = new IndexType[this->size];
-		for(size_t i = 0; i < this->size; i++) {
-			this->rawStorage[i] = 0;
+		this->rawStorage = NULL;
+		if(shadowStart == ShadowZeroed) {
+			this->rawStorage = new IndexType[this->size];
+			for(size_t i = 0; i < this->size; i++) {
+				this->rawStorage[i] = 0;
+			}
+			MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
 		}
-		glGenBuffersARB(1, &this->handle);
+		// No GL calls here: the handle and the GPU storage wait for the first Commit or draw.
 	}
 	/// Destroy the index buffer, its shadow array, its handle and its storage on GPU
 	~IndexBuffer() {
+		for(size_t i = 0; i < this->users.size(); i++) {
+			this->users[i]->IndexBufferDestroyed(this->serial);
+		}
 		if(this->handle != 0) {
 			glDeleteBuffersARB(1, &this->handle);
 		}
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, -(ptrdiff_t)this->GetShadowBytes());
 		delete[] this->rawStorage;
+		MemoryAccounting::ChangeGPUBytes(this->memoryTag, -(ptrdiff_t)this->gpuBytes);
+		MemoryAccounting::RemoveBuffer(this->memoryTag);
 	}
 public:
 	/**
@@ -78,17 +194,269 @@ public:
 	*/
 	void SetData(const std::vector<IndexType>& data) {
 		assert(data.size() <= this->size);
-		for(unsigned int i = 0; i < data.size(); i++) {
-			this->rawStorage[i] = data[i];
+		if(!data.empty()) {
+			this->Write(0, &data[0], data.size());
+		}
+	}
+	/**
+		\brief Copy a run of indices into the buffer. Will not commit.
+		\param firstIndex	The index to start writing at.
+		\param indices		The indices to write.
+		\param count		The number of indices to write.
+	*/
+	void Write(size_t firstIndex, const IndexType* indices, size_t count) {
+		assert(IsRangeWithin(firstIndex, count, this->size));
+		this->EnsureShadow();
+		memcpy(this->rawStorage + firstIndex, indices, count * sizeof(IndexType));
+	}
+	/// Write firstValue, firstValue + 1, ... into a run of indices. Will not commit.
+	void WriteSequence(size_t firstIndex, size_t count, IndexType firstValue) {
+		assert(IsRangeWithin(firstIndex, count, this->size));
+		assert(IsRangeWithin(firstValue, count, (size_t)(IndexType)~0 + 1)); // Would wrap
+		this->EnsureShadow();
+		for(size_t i = 0; i < count; i++) {
+			this->rawStorage[firstIndex + i] = (IndexType)(firstValue + i);
+		}
+	}
+	/**
+		\brief Move a run of indices within the buffer. The runs may overlap. Will not commit.
+		\param destination	The index to move the run to.
+		\param source		The first index of the run.
+		\param count		The number of indices to move.
+	*/
+	void Move(size_t destination, size_t source, size_t count) {
+		assert(IsRangeWithin(destination, count, this->size) && IsRangeWithin(source, count, this->size));
+		this->EnsureShadow();
+		memmove(this->rawStorage + destination, this->rawStorage + source, count * sizeof(IndexType));
+	}
+	/**
+		\brief Allocate fresh GL storage and map all of it, so the indices can be written straight into
+		GPU-visible memory instead of through the shadow array and Commit. Everything in the buffer is replaced,
+		so the shadow array is dropped. With ShadowRetained the shadow array is what's handed out, and Unmap
+		commits it. Nothing else may touch the buffer until Unmap.
+		\return	Where to write all the indices, or NULL if GL couldn't map the buffer. The buffer keeps
+				its shadow array then (blank if it had none) to be written the usual way.
+	*/
+	IndexType* MapForWriting() {
+		assert(this->mapping == NULL);
+		if(this->shadowPolicy == ShadowRetained) {
+			// The shadow array is kept anyway, so it's written instead and goes up on Unmap, rather than
+			// the mapping being read back into it later. Everything is replaced, so it needn't be zeroed.
+			if(this->rawStorage == NULL) {
+				this->rawStorage = new IndexType[this->size];
+				MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
+			}
+			this->mapping = this->rawStorage;
+			return this->mapping;
+		}
+		this->Bind();
+		size_t bytes = this->size * sizeof(IndexType);
+		// The storage is brand new, so nothing can be drawing from it and the mapping needn't wait for the GPU
+		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, bytes, NULL, GL_STATIC_DRAW_ARB);
+		MemoryAccounting::ChangeGPUBytes(this->memoryTag, (ptrdiff_t)bytes - (ptrdiff_t)this->gpuBytes);
+		this->gpuBytes = bytes;
+		if(IndexBuffer::IsMapRangeSupported()) {
+			this->mapping = (IndexType*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER_ARB, 0, bytes,
+														 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		}
+		else {
+			this->mapping = (IndexType*)glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+		}
+		if(this->mapping == NULL) {
+			// The new storage is blank, so whatever the shadow array holds has to go up again
+			this->isCommitted = false;
+			if(this->rawStorage == NULL) {
+				this->CreateBlankShadow();
+			}
+			return NULL;
 		}
+
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, -(ptrdiff_t)this->GetShadowBytes());
+		delete[] this->rawStorage;
+		this->rawStorage = NULL;
+		return this->mapping;
 	}
-	unsigned int getSize() {
+	/**
+		\brief Finish writing through MapForWriting. The indices are then only on the GPU, as if the shadow
+		had been released, unless the shadow array was written under ShadowRetained.
+		\return	False if GL lost the contents while they were mapped. The buffer is then blank, with a shadow
+				array, and has to be written again.
+	*/
+	bool Unmap() {
+		assert(this->mapping != NULL);
+		if(this->mapping == this->rawStorage) {
+			// MapForWriting handed out the retained shadow array
+			this->mapping = NULL;
+			this->Upload();
+			return true;
+		}
+		this->Bind();
+		this->mapping = NULL;
+		if(glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB) == GL_FALSE) {
+			this->CreateBlankShadow();
+			this->isCommitted = false;
+			return false;
+		}
+		RENDER_COUNT(CountUpload(this->size * sizeof(IndexType)));
+		this->isCommitted = true;
+		return true;
+	}
+	/// Whether the buffer is mapped by MapForWriting
+	bool IsMapped() const {
+		return this->mapping != NULL;
+	}
+	size_t getSize() {
 		return size;
 	}
+	/// A number unique to this index buffer for the life of the program, never reused like GL handles are.
+	unsigned int GetSerial() const {
+		return this->serial;
+	}
+	/// Tell user when this buffer is destroyed, until RemoveUser. GL thread only, like the destructor.
+	void AddUser(IndexBufferUser* user) const {
+		assert(std::find(this->users.begin(), this->users.end(), user) == this->users.end());
+		this->users.push_back(user);
+	}
+	/// Stop telling user about this buffer, for when it lets go of what it made for it first.
+	void RemoveUser(IndexBufferUser* user) const {
+		this->users.erase(std::remove(this->users.begin(), this->users.end(), user), this->users.end());
+	}
+public:
+	/// Whether MapForWriting can map without waiting on the GPU. It falls back to glMapBufferARB otherwise.
+	static bool IsMapRangeSupported() {
+		return (_GLEE_ARB_map_buffer_range != 0 || _GLEE_VERSION_3_0 != 0);
+	}
+	/// Whether the GPU can restart primitives at PrimitiveRestartIndex.
+	static bool IsPrimitiveRestartSupported() {
+		return _GLEE_VERSION_3_1 != 0;
+	}
+	/**
+		\brief Treat PrimitiveRestartIndex as the end of one strip and the start of the next when drawing,
+		so many strips draw as one. For buffers filled by Stripify with StripJoinRestart.
+		Needs IsPrimitiveRestartSupported; join with StripJoinDegenerate otherwise.
+	*/
+	void SetPrimitiveRestart(bool enabled) {
+		assert(!enabled || IndexBuffer::IsPrimitiveRestartSupported());
+		this->primitiveRestart = enabled;
+	}
+	bool UsesPrimitiveRestart() const {
+		return this->primitiveRestart;
+	}
+	/**
+		\brief Turn primitive restart on for draws from this buffer, if it uses it. The draw calls here do
+		this themselves; renderers that call glDrawElements and friends on the bound buffer bracket their
+		draws with BeginRestart and EndRestart.
+	*/
+	void BeginRestart() const {
+		if(this->primitiveRestart) {
+			glEnable(GL_PRIMITIVE_RESTART);
+			glPrimitiveRestartIndex(PrimitiveRestartIndex);
+		}
+	}
+	/// Undo BeginRestart
+	void EndRestart() const {
+		if(this->primitiveRestart) {
+			glDisable(GL_PRIMITIVE_RESTART);
+		}
+	}
+public:
+	/// Change what happens to the shadow array on the next Commit.
+	void SetShadowPolicy(ShadowPolicy shadowPolicy) {
+		this->shadowPolicy = shadowPolicy;
+	}
+	/// Get what happens to the shadow array on Commit.
+	ShadowPolicy GetShadowPolicy() const {
+		return this->shadowPolicy;
+	}
+	/// Where the index data currently lives.
+	BufferResidency GetResidency() const {
+		if(!this->isCommitted) {
+			return ResidentCPU;
+		}
+		return (this->rawStorage != NULL) ? ResidentCPUAndGPU : ResidentGPU;
+	}
+	/// The number of bytes of main memory held by the shadow array right now.
+	size_t GetShadowBytes() const {
+		return (this->rawStorage != NULL) ? this->size * sizeof(IndexType) : 0;
+	}
+	/**
+		\brief Free the shadow array, leaving the indices only on the GPU.
+		The buffer must have been committed first. Touching the indices afterwards reads them back.
+	*/
+	void ReleaseShadow() const {
+		assert(this->isCommitted); // We'd be throwing the only copy away
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, -(ptrdiff_t)this->GetShadowBytes());
+		delete[] this->rawStorage;
+		this->rawStorage = NULL;
+	}
+public:
+	/// Count this buffer's memory under a tag, such as the asset it was loaded from. See MemoryAccounting.
+	void SetMemoryTag(MemoryTag* memoryTag) {
+		MemoryAccounting::Retag(this->memoryTag, memoryTag, this->GetShadowBytes(), this->gpuBytes);
+		this->memoryTag = memoryTag;
+	}
+	MemoryTag* GetMemoryTag() const {
+		return this->memoryTag;
+	}
+private:
+	static unsigned int NextSerial() {
+		static std::atomic<unsigned int> nextSerial(1);
+		return nextSerial++;
+	}
+	/// Hand the whole shadow array to GL, allocating the GPU storage.
+	void Upload() const {
+		this->Bind();
+		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, this->size * sizeof(IndexType), this->rawStorage, GL_STATIC_DRAW_ARB);
+		RENDER_COUNT(CountUpload(this->size * sizeof(IndexType)));
+		this->isCommitted = true;
+		MemoryAccounting::ChangeGPUBytes(this->memoryTag, (ptrdiff_t)(this->size * sizeof(IndexType)) - (ptrdiff_t)this->gpuBytes);
+		this->gpuBytes = this->size * sizeof(IndexType);
+	}
+	/// Start a zeroed shadow array, for when the GPU copy is gone.
+	void CreateBlankShadow() {
+		assert(this->rawStorage == NULL);
+		this->rawStorage = new IndexType[this->size];
+		memset(this->rawStorage, 0, this->size * sizeof(IndexType));
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
+	}
+	/// Bring the shadow array back from the GPU if it was released.
+	void EnsureShadow() const {
+		assert(this->mapping == NULL); // Write through the mapping until Unmap
+		if(this->rawStorage != NULL) {
+			return;
+		}
+		this->rawStorage = new IndexType[this->size];
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
+		if(!this->isCommitted) {
+			// The shadow was deferred and there's nothing on the GPU to read back
+			memset(this->rawStorage, 0, this->size * sizeof(IndexType));
+			return;
+		}
+		this->Bind();
+		glGetBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0, this->size * sizeof(IndexType), this->rawStorage);
+	}
 private:
-	GLuint handle;
-	unsigned int size;
-	IndexType* rawStorage;
+	/// The GL buffer, or 0 until the first Commit or draw creates it
+	mutable GLuint handle;
+	/// See GetSerial
+	unsigned int serial;
+	/// Told when this buffer is destroyed; see AddUser
+	mutable std::vector<IndexBufferUser*> users;
+	/// Size (in indices)
+	size_t size;
+	/// The shadow array. NULL while the indices only live on the GPU.
+	mutable IndexType* rawStorage;
+	/// Whether the GPU has a copy of the indices yet
+	mutable bool isCommitted;
+	/// Where MapForWriting mapped the GL storage, or NULL while it isn't mapped
+	IndexType* mapping;
+	ShadowPolicy shadowPolicy;
+	/// See SetPrimitiveRestart
+	bool primitiveRestart;
+	/// Where this buffer's memory is counted
+	MemoryTag* memoryTag;
+	/// The bytes of GL storage counted against memoryTag
+	mutable size_t gpuBytes;
 };
 
 #endif
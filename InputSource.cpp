@@ -0,0 +1,379 @@
+#include "InputSource.h"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+
+#ifdef OBJLOADER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OBJLOADER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+//--------------------------------------------------------------------------
+
+FileInputSource::FileInputSource(const std::string& path) {
+	this->file = fopen(path.c_str(), "rb");
+}
+
+FileInputSource::~FileInputSource() {
+	if(this->file != NULL) {
+		fclose((FILE*)this->file);
+	}
+}
+
+size_t FileInputSource::Read(char* buffer, size_t size) {
+	if(this->file == NULL) {
+		return 0;
+	}
+	return fread(buffer, 1, size, (FILE*)this->file);
+}
+
+bool FileInputSource::HasFailed() const {
+	return this->file == NULL || ferror((FILE*)this->file) != 0;
+}
+
+//--------------------------------------------------------------------------
+
+#ifdef OBJLOADER_HAVE_ZLIB
+
+GzipInputSource::GzipInputSource(InputSource* compressed) : input(InputChunkSize) {
+	assert(compressed != NULL);
+	this->compressed = compressed;
+	this->pending = false;
+	this->finished = false;
+	this->failed = false;
+
+	z_stream* stream = new z_stream();
+	stream->zalloc = Z_NULL;
+	stream->zfree = Z_NULL;
+	stream->opaque = Z_NULL;
+	stream->next_in = Z_NULL;
+	stream->avail_in = 0;
+	// 15 for the largest window, plus 32 to recognise either a gzip or a zlib header
+	if(inflateInit2(stream, 15 + 32) != Z_OK) {
+		this->failed = true;
+	}
+	this->stream = stream;
+}
+
+GzipInputSource::~GzipInputSource() {
+	z_stream* stream = (z_stream*)this->stream;
+	inflateEnd(stream);
+	delete stream;
+	delete this->compressed;
+}
+
+size_t GzipInputSource::Read(char* buffer, size_t size) {
+	z_stream* stream = (z_stream*)this->stream;
+	size_t produced = 0;
+	while(produced < size && !this->finished && !this->failed) {
+		if(stream->avail_in == 0 && !this->pending) {
+			size_t read = this->compressed->Read(&this->input[0], this->input.size());
+			if(read == 0) {
+				// The compressed stream ran out. Fine between members, truncated in the middle of one.
+				this->failed = this->compressed->HasFailed() || stream->total_in != 0;
+				this->finished = true;
+				break;
+			}
+			stream->next_in = (Bytef*)&this->input[0];
+			stream->avail_in = (uInt)read;
+		}
+
+		stream->next_out = (Bytef*)(buffer + produced);
+		stream->avail_out = (uInt)(size - produced);
+		int result = inflate(stream, Z_NO_FLUSH);
+		produced = size - stream->avail_out;
+		this->pending = (stream->avail_out == 0);
+
+		if(result == Z_STREAM_END) {
+			// Another member may follow, as with concatenated gzip files
+			inflateReset(stream);
+		}
+		else if(result != Z_OK && result != Z_BUF_ERROR) {
+			std::cerr << "Corrupt gzip data: " << (stream->msg != NULL ? stream->msg : "unknown error") << std::endl;
+			this->failed = true;
+		}
+	}
+	return produced;
+}
+
+#endif
+
+//--------------------------------------------------------------------------
+
+#ifdef OBJLOADER_HAVE_ZSTD
+
+ZstdInputSource::ZstdInputSource(InputSource* compressed) : input(ZSTD_DStreamInSize()) {
+	assert(compressed != NULL);
+	this->compressed = compressed;
+	this->inputPosition = 0;
+	this->inputSize = 0;
+	this->pending = false;
+	this->betweenFrames = true;
+	this->finished = false;
+	this->failed = false;
+
+	ZSTD_DStream* stream = ZSTD_createDStream();
+	if(stream == NULL || ZSTD_isError(ZSTD_initDStream(stream))) {
+		this->failed = true;
+	}
+	this->stream = stream;
+}
+
+ZstdInputSource::~ZstdInputSource() {
+	ZSTD_freeDStream((ZSTD_DStream*)this->stream);
+	delete this->compressed;
+}
+
+size_t ZstdInputSource::Read(char* buffer, size_t size) {
+	ZSTD_DStream* stream = (ZSTD_DStream*)this->stream;
+	ZSTD_outBuffer output = { buffer, size, 0 };
+	while(output.pos < size && !this->finished && !this->failed) {
+		if(this->inputPosition == this->inputSize && !this->pending) {
+			this->inputSize = this->compressed->Read(&this->input[0], this->input.size());
+			this->inputPosition = 0;
+			if(this->inputSize == 0) {
+				// Ending between frames is fine, ending inside one isn't
+				this->failed = this->compressed->HasFailed() || !this->betweenFrames;
+				this->finished = true;
+				break;
+			}
+		}
+
+		ZSTD_inBuffer input = { &this->input[0], this->inputSize, this->inputPosition };
+		// 0 once a frame is decoded and flushed, otherwise a hint at how much more input it wants
+		size_t result = ZSTD_decompressStream(stream, &output, &input);
+		this->inputPosition = input.pos;
+		this->pending = (output.pos == output.size);
+		this->betweenFrames = (result == 0);
+		if(ZSTD_isError(result)) {
+			std::cerr << "Corrupt zstd data: " << ZSTD_getErrorName(result) << std::endl;
+			this->failed = true;
+		}
+	}
+	return output.pos;
+}
+
+#endif
+
+//--------------------------------------------------------------------------
+
+/// Chunks filled by the reading thread, handed over to Read, then recycled
+struct PipelinedInputSource::Pipeline {
+	struct Chunk {
+		std::vector<char> data;
+		size_t size;
+	};
+
+	InputSource* source;
+	std::thread reader;
+	std::mutex lock;
+	std::condition_variable filled;
+	std::condition_variable emptied;
+	/// Read ahead and waiting for Read
+	std::deque<Chunk*> full;
+	/// Consumed and waiting to be filled again
+	std::vector<Chunk*> empty;
+	/// The chunk Read is working through, and how far into it
+	Chunk* current;
+	size_t position;
+	bool finished;
+	bool failed;
+	bool stopping;
+
+	void ReadAhead() {
+		for(;;) {
+			Chunk* chunk = NULL;
+			{
+				std::unique_lock<std::mutex> guard(this->lock);
+				this->emptied.wait(guard, [this]() { return this->stopping || !this->empty.empty(); });
+				if(this->stopping) {
+					return;
+				}
+				chunk = this->empty.back();
+				this->empty.pop_back();
+			}
+
+			// The slow part, outside the lock
+			chunk->size = this->source->Read(&chunk->data[0], chunk->data.size());
+			bool ended = chunk->size < chunk->data.size();
+
+			std::lock_guard<std::mutex> guard(this->lock);
+			if(chunk->size > 0) {
+				this->full.push_back(chunk);
+			}
+			else {
+				this->empty.push_back(chunk);
+			}
+			if(ended) {
+				this->failed = this->source->HasFailed();
+				this->finished = true;
+			}
+			this->filled.notify_one();
+			if(ended) {
+				return;
+			}
+		}
+	}
+};
+
+PipelinedInputSource::PipelinedInputSource(InputSource* source, size_t chunkCount) {
+	assert(source != NULL && chunkCount > 0);
+	this->pipeline = new Pipeline();
+	this->pipeline->source = source;
+	this->pipeline->current = NULL;
+	this->pipeline->position = 0;
+	this->pipeline->finished = false;
+	this->pipeline->failed = false;
+	this->pipeline->stopping = false;
+	for(size_t i = 0; i < chunkCount; i++) {
+		Pipeline::Chunk* chunk = new Pipeline::Chunk();
+		chunk->data.resize(InputChunkSize);
+		chunk->size = 0;
+		this->pipeline->empty.push_back(chunk);
+	}
+	this->pipeline->reader = std::thread(&Pipeline::ReadAhead, this->pipeline);
+}
+
+PipelinedInputSource::~PipelinedInputSource() {
+	{
+		std::lock_guard<std::mutex> guard(this->pipeline->lock);
+		this->pipeline->stopping = true;
+	}
+	this->pipeline->emptied.notify_one();
+	this->pipeline->reader.join();
+
+	delete this->pipeline->current;
+	for(size_t i = 0; i < this->pipeline->full.size(); i++) {
+		delete this->pipeline->full[i];
+	}
+	for(size_t i = 0; i < this->pipeline->empty.size(); i++) {
+		delete this->pipeline->empty[i];
+	}
+	delete this->pipeline->source;
+	delete this->pipeline;
+}
+
+size_t PipelinedInputSource::Read(char* buffer, size_t size) {
+	Pipeline* pipeline = this->pipeline;
+	size_t copied = 0;
+	while(copied < size) {
+		if(pipeline->current == NULL) {
+			std::unique_lock<std::mutex> guard(pipeline->lock);
+			pipeline->filled.wait(guard, [pipeline]() { return pipeline->finished || !pipeline->full.empty(); });
+			if(pipeline->full.empty()) {
+				// Finished, and everything read ahead has been consumed
+				break;
+			}
+			pipeline->current = pipeline->full.front();
+			pipeline->full.pop_front();
+			pipeline->position = 0;
+		}
+
+		size_t count = std::min(size - copied, pipeline->current->size - pipeline->position);
+		memcpy(buffer + copied, &pipeline->current->data[pipeline->position], count);
+		copied += count;
+		pipeline->position += count;
+
+		if(pipeline->position == pipeline->current->size) {
+			// Give the chunk back to be filled again
+			std::lock_guard<std::mutex> guard(pipeline->lock);
+			pipeline->empty.push_back(pipeline->current);
+			pipeline->current = NULL;
+			pipeline->emptied.notify_one();
+		}
+	}
+	return copied;
+}
+
+bool PipelinedInputSource::HasFailed() const {
+	std::lock_guard<std::mutex> guard(this->pipeline->lock);
+	return this->pipeline->failed;
+}
+
+//--------------------------------------------------------------------------
+
+namespace {
+
+bool EndsWith(const std::string& str, const std::string& ending) {
+	return str.size() >= ending.size() && str.compare(str.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+}
+
+InputSource* OpenInputSource(const std::string& path) {
+	FileInputSource* file = new FileInputSource(path);
+	if(!file->IsOpen()) {
+		delete file;
+		return NULL;
+	}
+
+	if(EndsWith(path, ".gz")) {
+#ifdef OBJLOADER_HAVE_ZLIB
+		return new PipelinedInputSource(new GzipInputSource(file));
+#else
+		std::cerr << "Can't read \"" + path + "\": built without OBJLOADER_HAVE_ZLIB" << std::endl;
+		delete file;
+		return NULL;
+#endif
+	}
+	if(EndsWith(path, ".zst")) {
+#ifdef OBJLOADER_HAVE_ZSTD
+		return new PipelinedInputSource(new ZstdInputSource(file));
+#else
+		std::cerr << "Can't read \"" + path + "\": built without OBJLOADER_HAVE_ZSTD" << std::endl;
+		delete file;
+		return NULL;
+#endif
+	}
+	return file;
+}
+
+//--------------------------------------------------------------------------
+
+LineReader::LineReader(InputSource& source) : source(source), buffer(InputChunkSize) {
+	this->position = 0;
+	this->size = 0;
+	this->finished = false;
+}
+
+bool LineReader::ReadLine(std::string& line) {
+	line.clear();
+	bool any = false;
+	for(;;) {
+		if(this->position == this->size) {
+			if(this->finished) {
+				return any;
+			}
+			this->size = this->source.Read(&this->buffer[0], this->buffer.size());
+			this->position = 0;
+			if(this->size == 0) {
+				this->finished = true;
+				return any;
+			}
+		}
+
+		// Take everything up to the end of the line, or the end of what we have
+		const char* start = &this->buffer[this->position];
+		const char* end = (const char*)memchr(start, '\n', this->size - this->position);
+		size_t count = (end != NULL) ? (size_t)(end - start) : this->size - this->position;
+		line.append(start, count);
+		this->position += count;
+		any = true;
+
+		if(end != NULL) {
+			this->position++;
+			if(!line.empty() && line[line.size() - 1] == '\r') {
+				line.erase(line.size() - 1);
+			}
+			return true;
+		}
+	}
+}
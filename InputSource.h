@@ -0,0 +1,159 @@
+#ifndef _591_INPUTSOURCE_H_
+#define _591_INPUTSOURCE_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/*
+	Where loaders read their bytes from. A source is a forward-only stream of bytes: a file, a
+	decompressor wrapped around another source, or anything else a program keeps its assets in.
+	Compressed sources are only built when their library is available; define OBJLOADER_HAVE_ZLIB
+	(link with -lz) for .gz and OBJLOADER_HAVE_ZSTD (link with -lzstd) for .zst.
+*/
+
+/// Bytes a PipelinedInputSource reads ahead at a time
+const size_t InputChunkSize = 256 * 1024;
+
+/// A forward-only stream of bytes.
+class InputSource {
+public:
+	virtual ~InputSource() { }
+	/**
+		\brief Read the next bytes.
+		\param buffer	Where to put them.
+		\param size		The most to read.
+		\return			The number read. Less than size only at the end of the stream or on failure.
+	*/
+	virtual size_t Read(char* buffer, size_t size) = 0;
+	/// Whether something went wrong, as opposed to the stream simply ending
+	virtual bool HasFailed() const = 0;
+};
+
+/// Reads a file straight from disk.
+class FileInputSource : public InputSource {
+public:
+	explicit FileInputSource(const std::string& path);
+	~FileInputSource();
+	/// Whether the file could be opened
+	bool IsOpen() const {
+		return this->file != NULL;
+	}
+	size_t Read(char* buffer, size_t size);
+	bool HasFailed() const;
+private:
+	// Owns the file, no copying
+	FileInputSource(const FileInputSource&);
+	FileInputSource& operator=(const FileInputSource&);
+private:
+	/// A FILE*, kept opaque so <cstdio> stays out of the header
+	void* file;
+};
+
+#ifdef OBJLOADER_HAVE_ZLIB
+/// Inflates gzip (or zlib) data read from another source, including gzip files of several members.
+class GzipInputSource : public InputSource {
+public:
+	/// \param compressed	The compressed bytes. Deleted with this source.
+	explicit GzipInputSource(InputSource* compressed);
+	~GzipInputSource();
+	size_t Read(char* buffer, size_t size);
+	bool HasFailed() const {
+		return this->failed;
+	}
+private:
+	GzipInputSource(const GzipInputSource&);
+	GzipInputSource& operator=(const GzipInputSource&);
+private:
+	InputSource* compressed;
+	/// A z_stream, kept opaque so <zlib.h> stays out of the header
+	void* stream;
+	std::vector<char> input;
+	/// Whether the last inflate filled its output, so it may still hold more without new input
+	bool pending;
+	bool finished;
+	bool failed;
+};
+#endif
+
+#ifdef OBJLOADER_HAVE_ZSTD
+/// Decompresses Zstandard data read from another source, including files of several frames.
+class ZstdInputSource : public InputSource {
+public:
+	/// \param compressed	The compressed bytes. Deleted with this source.
+	explicit ZstdInputSource(InputSource* compressed);
+	~ZstdInputSource();
+	size_t Read(char* buffer, size_t size);
+	bool HasFailed() const {
+		return this->failed;
+	}
+private:
+	ZstdInputSource(const ZstdInputSource&);
+	ZstdInputSource& operator=(const ZstdInputSource&);
+private:
+	InputSource* compressed;
+	/// A ZSTD_DStream, kept opaque so <zstd.h> stays out of the header
+	void* stream;
+	std::vector<char> input;
+	/// The unread part of input
+	size_t inputPosition;
+	size_t inputSize;
+	/// Whether the last call filled its output, so it may still hold more without new input
+	bool pending;
+	/// Whether the last frame has been decoded completely, so the input may end here
+	bool betweenFrames;
+	bool finished;
+	bool failed;
+};
+#endif
+
+/**
+	\brief Reads another source ahead on a thread of its own, so whatever that source does (usually
+	decompressing) overlaps with whoever reads from this one. Keeps a few chunks of InputChunkSize in
+	flight and recycles them, so reading allocates nothing once it's going.
+*/
+class PipelinedInputSource : public InputSource {
+public:
+	/**
+		\param source		The source to read ahead. Deleted with this source.
+		\param chunkCount	The most chunks read ahead and not yet consumed.
+	*/
+	explicit PipelinedInputSource(InputSource* source, size_t chunkCount = 4);
+	~PipelinedInputSource();
+	size_t Read(char* buffer, size_t size);
+	bool HasFailed() const;
+private:
+	PipelinedInputSource(const PipelinedInputSource&);
+	PipelinedInputSource& operator=(const PipelinedInputSource&);
+	/// The threading half, kept out of the header
+	struct Pipeline;
+private:
+	Pipeline* pipeline;
+};
+
+/**
+	\brief Open a file for reading, decompressing it if its name ends in .gz or .zst and the library for it
+	was built in. Compressed files are decompressed on another thread while they're being read.
+	\return	The source, to be deleted by the caller, or NULL if the file couldn't be opened or can't be decompressed.
+*/
+InputSource* OpenInputSource(const std::string& path);
+
+/// Splits a source into lines, reading it a chunk at a time.
+class LineReader {
+public:
+	explicit LineReader(InputSource& source);
+	/**
+		\brief Read the next line, without its line ending. Reuses the line's capacity.
+		\return	False once there are no lines left.
+	*/
+	bool ReadLine(std::string& line);
+private:
+	InputSource& source;
+	std::vector<char> buffer;
+	/// The unread part of buffer
+	size_t position;
+	size_t size;
+	bool finished;
+};
+
+#endif
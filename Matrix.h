@@ -0,0 +1,214 @@
+#ifndef _591_MATRIX_H_
+#define _591_MATRIX_H_
+
+#include "Vector.h"
+#include <cmath>
+#include <cstddef>
+#include <cassert>
+#include <iostream>
+
+/**
+	\brief A 3x3 float matrix, for rotating, scaling and transforming normals.
+	Stored column-major like OpenGL, so m_Data[column * 3 + row]. Constructs to the identity.
+*/
+class Matrix3 {
+public:
+	/// Raw data, column-major
+	float m_Data[9];
+	/// Identity
+	Matrix3() {
+		for(size_t i = 0; i < 9; i++) {
+			m_Data[i] = (i % 4 == 0) ? 1.0f : 0.0f;
+		}
+	}
+	/// Build from three columns
+	Matrix3(const Vector3& c0, const Vector3& c1, const Vector3& c2) {
+		for(size_t r = 0; r < 3; r++) {
+			m_Data[r] = c0[r];
+			m_Data[3 + r] = c1[r];
+			m_Data[6 + r] = c2[r];
+		}
+	}
+	/// A scale along each axis
+	static Matrix3 scale(float x, float y, float z) {
+		Matrix3 ret;
+		ret(0, 0) = x;
+		ret(1, 1) = y;
+		ret(2, 2) = z;
+		return ret;
+	}
+	/// The same scale along every axis
+	static Matrix3 scale(float s) {
+		return Matrix3::scale(s, s, s);
+	}
+	/// Accessor
+	inline float& operator()(size_t row, size_t column) {
+		return m_Data[column * 3 + row];
+	}
+	/// Const accessor
+	inline float operator()(size_t row, size_t column) const {
+		return m_Data[column * 3 + row];
+	}
+	Matrix3 operator*(const Matrix3& m) const {
+		Matrix3 ret;
+		for(size_t c = 0; c < 3; c++) {
+			for(size_t r = 0; r < 3; r++) {
+				ret(r, c) = (*this)(r, 0) * m(0, c) + (*this)(r, 1) * m(1, c) + (*this)(r, 2) * m(2, c);
+			}
+		}
+		return ret;
+	}
+	Vector3 operator*(const Vector3& v) const {
+		return Vector3(
+			m_Data[0] * v[0] + m_Data[3] * v[1] + m_Data[6] * v[2],
+			m_Data[1] * v[0] + m_Data[4] * v[1] + m_Data[7] * v[2],
+			m_Data[2] * v[0] + m_Data[5] * v[1] + m_Data[8] * v[2]);
+	}
+	Matrix3 transpose() const {
+		Matrix3 ret;
+		for(size_t c = 0; c < 3; c++) {
+			for(size_t r = 0; r < 3; r++) {
+				ret(r, c) = (*this)(c, r);
+			}
+		}
+		return ret;
+	}
+	float determinant() const {
+		const Matrix3& m = *this;
+		return m(0, 0) * (m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1))
+			 - m(0, 1) * (m(1, 0) * m(2, 2) - m(1, 2) * m(2, 0))
+			 + m(0, 2) * (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0));
+	}
+	/// Get the inverse. The matrix must not be singular.
+	Matrix3 inverse() const {
+		const Matrix3& m = *this;
+		float det = this->determinant();
+		assert(det != 0.0f); // Singular, no inverse
+		float invDet = 1.0f / det;
+
+		Matrix3 ret;
+		ret(0, 0) = (m(1, 1) * m(2, 2) - m(1, 2) * m(2, 1)) * invDet;
+		ret(0, 1) = (m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2)) * invDet;
+		ret(0, 2) = (m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1)) * invDet;
+		ret(1, 0) = (m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2)) * invDet;
+		ret(1, 1) = (m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0)) * invDet;
+		ret(1, 2) = (m(0, 2) * m(1, 0) - m(0, 0) * m(1, 2)) * invDet;
+		ret(2, 0) = (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0)) * invDet;
+		ret(2, 1) = (m(0, 1) * m(2, 0) - m(0, 0) * m(2, 1)) * invDet;
+		ret(2, 2) = (m(0, 0) * m(1, 1) - m(0, 1) * m(1, 0)) * invDet;
+		return ret;
+	}
+};
+
+/**
+	\brief A 4x4 float matrix, for affine and projective transforms.
+	Stored column-major like OpenGL, so m_Data can go straight to glLoadMatrixf. Constructs to the identity.
+*/
+class Matrix4 {
+public:
+	/// Raw data, column-major
+	float m_Data[16];
+	/// Identity
+	Matrix4() {
+		for(size_t i = 0; i < 16; i++) {
+			m_Data[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+		}
+	}
+	/// An affine transform: a linear part, then a translation
+	explicit Matrix4(const Matrix3& linear, const Vector3& translation = Vector3()) {
+		for(size_t c = 0; c < 3; c++) {
+			for(size_t r = 0; r < 3; r++) {
+				(*this)(r, c) = linear(r, c);
+			}
+			(*this)(3, c) = 0.0f;
+			(*this)(c, 3) = translation[c];
+		}
+		(*this)(3, 3) = 1.0f;
+	}
+	/// A move by an offset
+	static Matrix4 translation(const Vector3& offset) {
+		return Matrix4(Matrix3(), offset);
+	}
+	/// The same scale along every axis
+	static Matrix4 scale(float s) {
+		return Matrix4(Matrix3::scale(s));
+	}
+	/// A scale along each axis
+	static Matrix4 scale(float x, float y, float z) {
+		return Matrix4(Matrix3::scale(x, y, z));
+	}
+	/// Accessor
+	inline float& operator()(size_t row, size_t column) {
+		return m_Data[column * 4 + row];
+	}
+	/// Const accessor
+	inline float operator()(size_t row, size_t column) const {
+		return m_Data[column * 4 + row];
+	}
+	Matrix4 operator*(const Matrix4& m) const {
+		Matrix4 ret;
+		for(size_t c = 0; c < 4; c++) {
+			for(size_t r = 0; r < 4; r++) {
+				ret(r, c) = (*this)(r, 0) * m(0, c) + (*this)(r, 1) * m(1, c) + (*this)(r, 2) * m(2, c) + (*this)(r, 3) * m(3, c);
+			}
+		}
+		return ret;
+	}
+	Vector4 operator*(const Vector4& v) const {
+		Vector4 ret;
+		for(size_t r = 0; r < 4; r++) {
+			ret[r] = m_Data[r] * v[0] + m_Data[4 + r] * v[1] + m_Data[8 + r] * v[2] + m_Data[12 + r] * v[3];
+		}
+		return ret;
+	}
+	/// Transform a point, i.e. with w = 1. Assumes the matrix is affine.
+	Vector3 transformPoint(const Vector3& p) const {
+		return Vector3(
+			m_Data[0] * p[0] + m_Data[4] * p[1] + m_Data[8] * p[2] + m_Data[12],
+			m_Data[1] * p[0] + m_Data[5] * p[1] + m_Data[9] * p[2] + m_Data[13],
+			m_Data[2] * p[0] + m_Data[6] * p[1] + m_Data[10] * p[2] + m_Data[14]);
+	}
+	/// Transform a direction, i.e. with w = 0, so translation is ignored.
+	Vector3 transformDirection(const Vector3& d) const {
+		return this->linear() * d;
+	}
+	/// The upper-left 3x3: rotation, scale and shear without the translation
+	Matrix3 linear() const {
+		Matrix3 ret;
+		for(size_t c = 0; c < 3; c++) {
+			for(size_t r = 0; r < 3; r++) {
+				ret(r, c) = (*this)(r, c);
+			}
+		}
+		return ret;
+	}
+	/// The matrix that transforms normals the way this transforms points: the inverse transpose of linear().
+	Matrix3 normalMatrix() const {
+		return this->linear().inverse().transpose();
+	}
+	Matrix4 transpose() const {
+		Matrix4 ret;
+		for(size_t c = 0; c < 4; c++) {
+			for(size_t r = 0; r < 4; r++) {
+				ret(r, c) = (*this)(c, r);
+			}
+		}
+		return ret;
+	}
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Matrix3& m) {
+	for(size_t r = 0; r < 3; r++) {
+		os << "[ " << m(r, 0) << " " << m(r, 1) << " " << m(r, 2) << " ]\n";
+	}
+	return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Matrix4& m) {
+	for(size_t r = 0; r < 4; r++) {
+		os << "[ " << m(r, 0) << " " << m(r, 1) << " " << m(r, 2) << " " << m(r, 3) << " ]\n";
+	}
+	return os;
+}
+
+#endif
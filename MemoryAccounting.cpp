@@ -0,0 +1,168 @@
+#include "MemoryAccounting.h"
+#include <map>
+#include <mutex>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+namespace {
+
+/// Every tag ever made. Tags are looked up under the lock but counted without it.
+struct MemoryRegistry {
+	std::mutex lock;
+	std::map<std::string, MemoryTag*> byName;
+	/// In the order they were made
+	std::vector<MemoryTag*> tags;
+};
+
+MemoryRegistry& Registry() {
+	static MemoryRegistry registry;
+	return registry;
+}
+
+/// Raise a peak to a new value if it's higher
+void RaisePeak(std::atomic<size_t>& peak, size_t value) {
+	size_t current = peak.load(std::memory_order_relaxed);
+	while(value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+		// current was reloaded; try again
+	}
+}
+
+}
+
+//--------------------------------------------------------------------------
+
+MemoryTag::MemoryTag(const std::string& name)
+	: name(name), bufferCount(0), shadowBytes(0), gpuBytes(0), peakShadowBytes(0), peakGPUBytes(0) {
+}
+
+MemoryUsage MemoryTag::GetUsage() const {
+	MemoryUsage usage;
+	usage.bufferCount = this->bufferCount.load(std::memory_order_relaxed);
+	usage.shadowBytes = this->shadowBytes.load(std::memory_order_relaxed);
+	usage.gpuBytes = this->gpuBytes.load(std::memory_order_relaxed);
+	usage.peakShadowBytes = this->peakShadowBytes.load(std::memory_order_relaxed);
+	usage.peakGPUBytes = this->peakGPUBytes.load(std::memory_order_relaxed);
+	return usage;
+}
+
+void MemoryTag::Change(std::atomic<size_t>& bytes, std::atomic<size_t>& peak, ptrdiff_t change) {
+	// Unsigned wraparound makes adding a negative change a subtraction
+	size_t now = bytes.fetch_add((size_t)change, std::memory_order_relaxed) + (size_t)change;
+	if(change > 0) {
+		RaisePeak(peak, now);
+	}
+}
+
+//--------------------------------------------------------------------------
+
+void MemorySnapshot::Write(std::ostream& output) const {
+	output << "tag, buffers, shadow bytes, GPU bytes, peak shadow bytes, peak GPU bytes" << std::endl;
+	for(size_t i = 0; i < this->tags.size(); i++) {
+		const MemoryUsage& usage = this->tags[i];
+		output << this->names[i] << ", " << usage.bufferCount << ", " << usage.shadowBytes << ", " << usage.gpuBytes
+			   << ", " << usage.peakShadowBytes << ", " << usage.peakGPUBytes << std::endl;
+	}
+	output << "total, " << this->total.bufferCount << ", " << this->total.shadowBytes << ", " << this->total.gpuBytes
+		   << ", " << this->total.peakShadowBytes << ", " << this->total.peakGPUBytes << std::endl;
+}
+
+//--------------------------------------------------------------------------
+
+MemoryTag* MemoryAccounting::GetTotalTag() {
+	// Counted like a tag, but kept out of the registry so snapshots don't list it
+	static MemoryTag* total = new MemoryTag("total");
+	return total;
+}
+
+MemoryTag* MemoryAccounting::GetTag(const std::string& name) {
+	MemoryRegistry& registry = Registry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	std::map<std::string, MemoryTag*>::iterator found = registry.byName.find(name);
+	if(found != registry.byName.end()) {
+		return found->second;
+	}
+	MemoryTag* tag = new MemoryTag(name);
+	registry.byName[name] = tag;
+	registry.tags.push_back(tag);
+	return tag;
+}
+
+MemoryTag* MemoryAccounting::GetDefaultTag() {
+	static MemoryTag* untagged = MemoryAccounting::GetTag("untagged");
+	return untagged;
+}
+
+MemoryUsage MemoryAccounting::GetTotal() {
+	return MemoryAccounting::GetTotalTag()->GetUsage();
+}
+
+MemorySnapshot MemoryAccounting::TakeSnapshot() {
+	MemorySnapshot snapshot;
+	snapshot.total = MemoryAccounting::GetTotal();
+	MemoryRegistry& registry = Registry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	snapshot.names.reserve(registry.tags.size());
+	snapshot.tags.reserve(registry.tags.size());
+	for(size_t i = 0; i < registry.tags.size(); i++) {
+		snapshot.names.push_back(registry.tags[i]->GetName());
+		snapshot.tags.push_back(registry.tags[i]->GetUsage());
+	}
+	return snapshot;
+}
+
+void MemoryAccounting::ResetPeaks() {
+	MemoryRegistry& registry = Registry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	std::vector<MemoryTag*> tags = registry.tags;
+	tags.push_back(MemoryAccounting::GetTotalTag());
+	for(size_t i = 0; i < tags.size(); i++) {
+		tags[i]->peakShadowBytes.store(tags[i]->shadowBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		tags[i]->peakGPUBytes.store(tags[i]->gpuBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+}
+
+void MemoryAccounting::AddBuffer(MemoryTag* tag) {
+	assert(tag != NULL);
+	tag->bufferCount.fetch_add(1, std::memory_order_relaxed);
+	MemoryAccounting::GetTotalTag()->bufferCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryAccounting::RemoveBuffer(MemoryTag* tag) {
+	assert(tag != NULL);
+	tag->bufferCount.fetch_sub(1, std::memory_order_relaxed);
+	MemoryAccounting::GetTotalTag()->bufferCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MemoryAccounting::ChangeShadowBytes(MemoryTag* tag, ptrdiff_t change) {
+	assert(tag != NULL);
+	if(change == 0) {
+		return;
+	}
+	tag->Change(tag->shadowBytes, tag->peakShadowBytes, change);
+	MemoryTag* total = MemoryAccounting::GetTotalTag();
+	total->Change(total->shadowBytes, total->peakShadowBytes, change);
+}
+
+void MemoryAccounting::ChangeGPUBytes(MemoryTag* tag, ptrdiff_t change) {
+	assert(tag != NULL);
+	if(change == 0) {
+		return;
+	}
+	tag->Change(tag->gpuBytes, tag->peakGPUBytes, change);
+	MemoryTag* total = MemoryAccounting::GetTotalTag();
+	total->Change(total->gpuBytes, total->peakGPUBytes, change);
+}
+
+void MemoryAccounting::Retag(MemoryTag* from, MemoryTag* to, size_t shadowBytes, size_t gpuBytes) {
+	assert(from != NULL && to != NULL);
+	if(from == to) {
+		return;
+	}
+	from->bufferCount.fetch_sub(1, std::memory_order_relaxed);
+	from->Change(from->shadowBytes, from->peakShadowBytes, -(ptrdiff_t)shadowBytes);
+	from->Change(from->gpuBytes, from->peakGPUBytes, -(ptrdiff_t)gpuBytes);
+	to->bufferCount.fetch_add(1, std::memory_order_relaxed);
+	to->Change(to->shadowBytes, to->peakShadowBytes, (ptrdiff_t)shadowBytes);
+	to->Change(to->gpuBytes, to->peakGPUBytes, (ptrdiff_t)gpuBytes);
+}
@@ -0,0 +1,99 @@
+#ifndef _591_MEMORYACCOUNTING_H_
+#define _591_MEMORYACCOUNTING_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstddef>
+
+/*
+	Counts the memory held by vertex and index buffers: how many are alive, the bytes in their CPU
+	shadow arrays and the bytes they've asked GL for. Every buffer belongs to a tag (an asset name,
+	a pool, anything) and the totals are kept per tag and overall, along with their peaks.
+	Counters are relaxed atomics, so buffers on any thread can update them and anyone can read them
+	at any time; a reading taken while buffers change is only as consistent as the moment it was taken.
+*/
+
+/// Memory in use, at a moment or at its peak
+struct MemoryUsage {
+	MemoryUsage() {
+		bufferCount = 0;
+		shadowBytes = gpuBytes = 0;
+		peakShadowBytes = peakGPUBytes = 0;
+	}
+	/// Buffers alive
+	size_t bufferCount;
+	/// Bytes of main memory in shadow arrays
+	size_t shadowBytes;
+	/// Bytes of buffer storage asked of GL. The driver may round it up or keep its own copy.
+	size_t gpuBytes;
+	/// The most shadowBytes has been since the peaks were last reset
+	size_t peakShadowBytes;
+	/// The most gpuBytes has been since the peaks were last reset
+	size_t peakGPUBytes;
+};
+
+/// The counters of one tag. Handed out by MemoryAccounting::GetTag and never freed, so keep the pointer.
+class MemoryTag {
+public:
+	const std::string& GetName() const {
+		return this->name;
+	}
+	/// What buffers with this tag hold right now
+	MemoryUsage GetUsage() const;
+private:
+	friend class MemoryAccounting;
+	explicit MemoryTag(const std::string& name);
+	void Change(std::atomic<size_t>& bytes, std::atomic<size_t>& peak, ptrdiff_t change);
+	// Tags are shared, no copying
+	MemoryTag(const MemoryTag&);
+	MemoryTag& operator=(const MemoryTag&);
+private:
+	std::string name;
+	std::atomic<size_t> bufferCount;
+	std::atomic<size_t> shadowBytes;
+	std::atomic<size_t> gpuBytes;
+	std::atomic<size_t> peakShadowBytes;
+	std::atomic<size_t> peakGPUBytes;
+};
+
+/// Every tag's usage, taken in one go
+struct MemorySnapshot {
+	MemoryUsage total;
+	/// Tag names, in the order the tags were made
+	std::vector<std::string> names;
+	/// Usage of the tag in names at the same position
+	std::vector<MemoryUsage> tags;
+	/// Print a table of the tags and the total, one line each
+	void Write(std::ostream& output) const;
+};
+
+/// The registry buffers report to. All static; there is only one.
+class MemoryAccounting {
+public:
+	/// Find the tag with a name, making it if it's new. Takes a lock, so look tags up once and keep them.
+	static MemoryTag* GetTag(const std::string& name);
+	/// The tag buffers start with, named "untagged"
+	static MemoryTag* GetDefaultTag();
+	/// What every buffer holds right now
+	static MemoryUsage GetTotal();
+	/// Read every tag, for dumping or checking against budgets
+	static MemorySnapshot TakeSnapshot();
+	/// Start the peaks again from the current usage, e.g. at the start of a level
+	static void ResetPeaks();
+public:
+	/// \name For buffers to report through
+	/// \{
+	static void AddBuffer(MemoryTag* tag);
+	static void RemoveBuffer(MemoryTag* tag);
+	static void ChangeShadowBytes(MemoryTag* tag, ptrdiff_t change);
+	static void ChangeGPUBytes(MemoryTag* tag, ptrdiff_t change);
+	/// Move a live buffer's memory from one tag to another. The total doesn't change.
+	static void Retag(MemoryTag* from, MemoryTag* to, size_t shadowBytes, size_t gpuBytes);
+	/// \}
+private:
+	static MemoryTag* GetTotalTag();
+};
+
+#endif
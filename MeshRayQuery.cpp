@@ -0,0 +1,383 @@
+#include "MeshRayQuery.h"
+#include "Parallel.h"
+#include "CheckedSize.h"
+#include <algorithm>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+namespace {
+
+/// Nodes with this many triangles or fewer may be leaves
+const unsigned int MaximumLeafTriangles = 4;
+/// Candidate split planes tried along each axis
+const size_t SplitBins = 12;
+/// Past this depth nodes are split down the middle, which bounds the depth of the traversal stack
+const size_t MedianSplitDepth = 64;
+/// Enough for MedianSplitDepth plus halving 2^32 triangles
+const size_t TraversalStackSize = 128;
+
+float SurfaceArea(const BoundingBox& box) {
+	if(box.IsEmpty()) {
+		return 0.0f;
+	}
+	Vector3 size = box.maximum - box.minimum;
+	return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+
+/// Slab test. On a hit, entry is where the ray goes into the box.
+inline bool RayBoxCollision(const float* minimum, const float* maximum, const float* origin, const float* inverseDirection,
+							float nearest, float furthest, float& entry) {
+	for(size_t axis = 0; axis < 3; axis++) {
+		float t0 = (minimum[axis] - origin[axis]) * inverseDirection[axis];
+		float t1 = (maximum[axis] - origin[axis]) * inverseDirection[axis];
+		if(t0 > t1) {
+			std::swap(t0, t1);
+		}
+		nearest = std::max(nearest, t0);
+		furthest = std::min(furthest, t1);
+	}
+	entry = nearest;
+	return nearest <= furthest;
+}
+
+/// Möller-Trumbore, as the internal depth pass has always done it
+inline bool RayTriangleCollision(const Vector3& rayOrigin, const Vector3& rayDirection, const Vector3& origin,
+								 const Vector3& e1, const Vector3& e2, float& t, float& u, float& v) {
+	Vector3 h = cross(rayDirection, e2);
+	float a = e1.dot(h);
+
+	// Parallel check
+	if(a > -0.00001f && a < 0.00001f) {
+		return false;
+	}
+
+	float f = 1.0f / a;
+	Vector3 s = rayOrigin - origin;
+
+	u = f * s.dot(h);
+
+	// Barycentric range check
+	if(u < 0.0f || u > 1.0f) {
+		return false;
+	}
+
+	Vector3 q = cross(s, e1);
+
+	v = f * rayDirection.dot(q);
+	if(v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+
+	t = f * e2.dot(q);
+	return true;
+}
+
+}
+
+//--------------------------------------------------------------------------
+
+void MeshRayQuery::Build(const float* positions, size_t stride, const unsigned int* indices, size_t triangleCount) {
+	this->nodes.clear();
+	this->triangles.clear();
+	this->corners.clear();
+	if(triangleCount == 0) {
+		return;
+	}
+	assert(triangleCount < RayMissed);
+
+	std::vector<BoundingBox> boxes(triangleCount);
+	std::vector<Vector3> centres(triangleCount);
+	std::vector<unsigned int> order(triangleCount);
+	for(size_t t = 0; t < triangleCount; t++) {
+		for(size_t v = 0; v < 3; v++) {
+			const float* p = positions + indices[t * 3 + v] * stride;
+			boxes[t].Extend(Vector3(p[0], p[1], p[2]));
+		}
+		centres[t] = boxes[t].GetCentre();
+		order[t] = (unsigned int)t;
+	}
+
+	// A binary tree over n leaves has at most 2n - 1 nodes
+	this->nodes.reserve(triangleCount * 2);
+	this->nodes.push_back(Node());
+	this->Subdivide(0, 0, (unsigned int)triangleCount, 0, order, boxes, centres);
+
+	// Lay the triangles out in leaf order so each leaf reads one run of them
+	this->triangles.resize(triangleCount);
+	this->corners.resize(triangleCount * 3);
+	for(size_t i = 0; i < triangleCount; i++) {
+		for(size_t v = 0; v < 3; v++) {
+			this->corners[i * 3 + v] = indices[(size_t)order[i] * 3 + v];
+		}
+		this->triangles[i].index = order[i];
+		this->SetTriangle(i, positions, stride);
+	}
+}
+
+size_t MeshRayQuery::GetBuildBytes(size_t triangleCount) {
+	// Build's boxes, centres and order, then what the query keeps: up to two nodes, a triangle and three corners each
+	size_t perTriangle = sizeof(BoundingBox) + sizeof(Vector3) + sizeof(unsigned int)
+					   + 2 * sizeof(Node) + sizeof(Triangle) + 3 * sizeof(unsigned int);
+	size_t bytes = 0;
+	return MultiplySizes(triangleCount, perTriangle, bytes) ? bytes : (size_t)-1;
+}
+
+void MeshRayQuery::Refit(const float* positions, size_t stride) {
+	for(size_t i = 0; i < this->triangles.size(); i++) {
+		this->SetTriangle(i, positions, stride);
+	}
+
+	// Children always come after their parent, so walking backwards fixes every child before its parent
+	for(size_t n = this->nodes.size(); n-- > 0; ) {
+		Node& node = this->nodes[n];
+		BoundingBox bounds;
+		if(node.count > 0) {
+			for(unsigned int i = node.first; i < node.first + node.count; i++) {
+				const Triangle& triangle = this->triangles[i];
+				bounds.Extend(triangle.origin);
+				bounds.Extend(triangle.origin + triangle.edge1);
+				bounds.Extend(triangle.origin + triangle.edge2);
+			}
+		}
+		else {
+			for(size_t child = node.first; child < node.first + 2; child++) {
+				const Node& c = this->nodes[child];
+				bounds.Extend(BoundingBox(Vector3(c.minimum[0], c.minimum[1], c.minimum[2]),
+										  Vector3(c.maximum[0], c.maximum[1], c.maximum[2])));
+			}
+		}
+		for(size_t axis = 0; axis < 3; axis++) {
+			node.minimum[axis] = bounds.minimum[axis];
+			node.maximum[axis] = bounds.maximum[axis];
+		}
+	}
+}
+
+void MeshRayQuery::SetTriangle(size_t i, const float* positions, size_t stride) {
+	const float* p0 = positions + this->corners[i * 3] * stride;
+	const float* p1 = positions + this->corners[i * 3 + 1] * stride;
+	const float* p2 = positions + this->corners[i * 3 + 2] * stride;
+	Triangle& triangle = this->triangles[i];
+	triangle.origin = Vector3(p0[0], p0[1], p0[2]);
+	triangle.edge1 = Vector3(p1[0], p1[1], p1[2]) - triangle.origin;
+	triangle.edge2 = Vector3(p2[0], p2[1], p2[2]) - triangle.origin;
+}
+
+void MeshRayQuery::Subdivide(size_t node, unsigned int first, unsigned int count, size_t depth, std::vector<unsigned int>& order,
+							 const std::vector<BoundingBox>& boxes, const std::vector<Vector3>& centres) {
+	BoundingBox bounds, centreBounds;
+	for(unsigned int i = first; i < first + count; i++) {
+		bounds.Extend(boxes[order[i]]);
+		centreBounds.Extend(centres[order[i]]);
+	}
+	for(size_t axis = 0; axis < 3; axis++) {
+		this->nodes[node].minimum[axis] = bounds.minimum[axis];
+		this->nodes[node].maximum[axis] = bounds.maximum[axis];
+	}
+
+	// Find the cheapest split plane, where the cost of a side is its area times its triangle count
+	float bestCost = std::numeric_limits<float>::max();
+	size_t bestAxis = 0;
+	float bestPlane = 0.0f;
+	if(depth < MedianSplitDepth) {
+		for(size_t axis = 0; axis < 3; axis++) {
+			float low = centreBounds.minimum[axis];
+			float extent = centreBounds.maximum[axis] - low;
+			if(extent <= 0.0f) {
+				continue;
+			}
+			float binScale = SplitBins / extent;
+			BoundingBox binBounds[SplitBins];
+			unsigned int binCounts[SplitBins] = { 0 };
+			for(unsigned int i = first; i < first + count; i++) {
+				size_t bin = std::min(SplitBins - 1, (size_t)((centres[order[i]][axis] - low) * binScale));
+				binBounds[bin].Extend(boxes[order[i]]);
+				binCounts[bin]++;
+			}
+
+			// Sweep from the right to get the cost of everything above each plane, then from the left
+			float rightAreas[SplitBins];
+			unsigned int rightCounts[SplitBins];
+			BoundingBox right;
+			unsigned int rightCount = 0;
+			for(size_t bin = SplitBins - 1; bin > 0; bin--) {
+				right.Extend(binBounds[bin]);
+				rightCount += binCounts[bin];
+				rightAreas[bin] = SurfaceArea(right);
+				rightCounts[bin] = rightCount;
+			}
+			BoundingBox left;
+			unsigned int leftCount = 0;
+			for(size_t bin = 1; bin < SplitBins; bin++) {
+				left.Extend(binBounds[bin - 1]);
+				leftCount += binCounts[bin - 1];
+				if(leftCount == 0 || rightCounts[bin] == 0) {
+					continue;
+				}
+				float cost = SurfaceArea(left) * leftCount + rightAreas[bin] * rightCounts[bin];
+				if(cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestPlane = low + bin / binScale;
+				}
+			}
+		}
+	}
+
+	// Small nodes stay leaves unless splitting them is cheaper than testing every triangle
+	float leafCost = SurfaceArea(bounds) * count;
+	if(count <= MaximumLeafTriangles && !(bestCost < leafCost)) {
+		this->nodes[node].first = first;
+		this->nodes[node].count = count;
+		return;
+	}
+
+	unsigned int* begin = &order[0] + first;
+	unsigned int* end = begin + count;
+	unsigned int* middle = begin;
+	if(bestCost < std::numeric_limits<float>::max()) {
+		middle = std::partition(begin, end, [&centres, bestAxis, bestPlane](unsigned int t) {
+			return centres[t][bestAxis] < bestPlane;
+		});
+	}
+	if(middle == begin || middle == end) {
+		// No plane separates them (or the tree is too deep), so halve them along the widest axis
+		Vector3 extent = centreBounds.maximum - centreBounds.minimum;
+		size_t axis = (extent[0] > extent[1] && extent[0] > extent[2]) ? 0 : (extent[1] > extent[2] ? 1 : 2);
+		middle = begin + count / 2;
+		std::nth_element(begin, middle, end, [&centres, axis](unsigned int a, unsigned int b) {
+			return centres[a][axis] < centres[b][axis];
+		});
+	}
+
+	unsigned int leftCount = (unsigned int)(middle - begin);
+	size_t child = this->nodes.size();
+	this->nodes[node].first = (unsigned int)child;
+	this->nodes[node].count = 0;
+	this->nodes.push_back(Node());
+	this->nodes.push_back(Node());
+	this->Subdivide(child, first, leftCount, depth + 1, order, boxes, centres);
+	this->Subdivide(child + 1, first + leftCount, count - leftCount, depth + 1, order, boxes, centres);
+}
+
+BoundingBox MeshRayQuery::GetBounds() const {
+	if(this->nodes.empty()) {
+		return BoundingBox();
+	}
+	const Node& root = this->nodes[0];
+	return BoundingBox(Vector3(root.minimum[0], root.minimum[1], root.minimum[2]),
+					   Vector3(root.maximum[0], root.maximum[1], root.maximum[2]));
+}
+
+bool MeshRayQuery::Trace(const Ray& ray, bool anyHit, RayHit& hit) const {
+	hit = RayHit();
+	if(this->nodes.empty()) {
+		return false;
+	}
+
+	const float origin[3] = { ray.origin[0], ray.origin[1], ray.origin[2] };
+	const float inverseDirection[3] = { 1.0f / ray.direction[0], 1.0f / ray.direction[1], 1.0f / ray.direction[2] };
+	float nearest = ray.minimumDistance;
+	float furthest = ray.maximumDistance;
+
+	// Nodes still to visit, with where the ray enters them so ones behind a closer hit can be skipped
+	size_t stackNodes[TraversalStackSize];
+	float stackEntries[TraversalStackSize];
+	size_t stackSize = 0;
+
+	float entry;
+	const Node* root = &this->nodes[0];
+	if(!RayBoxCollision(root->minimum, root->maximum, origin, inverseDirection, nearest, furthest, entry)) {
+		return false;
+	}
+	stackNodes[stackSize] = 0;
+	stackEntries[stackSize++] = entry;
+
+	while(stackSize > 0) {
+		stackSize--;
+		if(stackEntries[stackSize] > furthest) {
+			continue;
+		}
+		const Node* node = &this->nodes[stackNodes[stackSize]];
+
+		if(node->count > 0) {
+			for(unsigned int i = node->first; i < node->first + node->count; i++) {
+				const Triangle& triangle = this->triangles[i];
+				float t, u, v;
+				if(RayTriangleCollision(ray.origin, ray.direction, triangle.origin, triangle.edge1, triangle.edge2, t, u, v)
+				   && t > nearest && t < furthest) {
+					furthest = t;
+					hit.triangle = triangle.index;
+					hit.distance = t;
+					hit.u = u;
+					hit.v = v;
+					if(anyHit) {
+						return true;
+					}
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first by pushing it last
+		const Node* left = &this->nodes[node->first];
+		const Node* right = left + 1;
+		float leftEntry, rightEntry;
+		bool hitLeft = RayBoxCollision(left->minimum, left->maximum, origin, inverseDirection, nearest, furthest, leftEntry);
+		bool hitRight = RayBoxCollision(right->minimum, right->maximum, origin, inverseDirection, nearest, furthest, rightEntry);
+		assert(stackSize + 2 <= TraversalStackSize);
+		if(hitLeft && hitRight && leftEntry < rightEntry) {
+			stackNodes[stackSize] = node->first + 1;
+			stackEntries[stackSize++] = rightEntry;
+			hitRight = false;
+		}
+		if(hitLeft) {
+			stackNodes[stackSize] = node->first;
+			stackEntries[stackSize++] = leftEntry;
+		}
+		if(hitRight) {
+			stackNodes[stackSize] = node->first + 1;
+			stackEntries[stackSize++] = rightEntry;
+		}
+	}
+	return hit.IsHit();
+}
+
+bool MeshRayQuery::ClosestHit(const Ray& ray, RayHit& hit) const {
+	return this->Trace(ray, false, hit);
+}
+
+bool MeshRayQuery::AnyHit(const Ray& ray) const {
+	RayHit hit;
+	return this->Trace(ray, true, hit);
+}
+
+size_t MeshRayQuery::ClosestHits(const Ray* rays, size_t count, RayHit* hits) const {
+	ParallelFor(count, ParallelRayThreshold, 1, [this, rays, hits](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			this->Trace(rays[i], false, hits[i]);
+		}
+	});
+
+	size_t hitCount = 0;
+	for(size_t i = 0; i < count; i++) {
+		hitCount += hits[i].IsHit() ? 1 : 0;
+	}
+	return hitCount;
+}
+
+size_t MeshRayQuery::AnyHits(const Ray* rays, size_t count, unsigned char* hit) const {
+	ParallelFor(count, ParallelRayThreshold, 1, [this, rays, hit](size_t begin, size_t end) {
+		RayHit scratch;
+		for(size_t i = begin; i < end; i++) {
+			hit[i] = this->Trace(rays[i], true, scratch) ? 1 : 0;
+		}
+	});
+
+	size_t hitCount = 0;
+	for(size_t i = 0; i < count; i++) {
+		hitCount += hit[i];
+	}
+	return hitCount;
+}
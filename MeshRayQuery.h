@@ -0,0 +1,130 @@
+#ifndef _591_MESHRAYQUERY_H_
+#define _591_MESHRAYQUERY_H_
+
+#include "Vector.h"
+#include "Bounds.h"
+#include <vector>
+#include <limits>
+#include <cstddef>
+
+/*
+	Ray queries against a triangle mesh, for picking and the like. The triangles go into a bounding
+	volume hierarchy (split with a binned surface area heuristic), so a ray only tests the few
+	triangles near it instead of all of them. Batches of ParallelRayThreshold rays or more are
+	split across hardware threads; a built query is read-only, so any number of threads may share it.
+*/
+
+/// Batches at least this big are traced on several threads.
+const size_t ParallelRayThreshold = 1024;
+
+/// What RayHit::triangle holds when the ray didn't hit anything
+const unsigned int RayMissed = 0xFFFFFFFF;
+
+/// A ray from origin along direction. Only hits between minimumDistance and maximumDistance count.
+struct Ray {
+	Ray() {
+		minimumDistance = 0.0f;
+		maximumDistance = std::numeric_limits<float>::max();
+	}
+	Ray(const Vector3& origin, const Vector3& direction) : origin(origin), direction(direction) {
+		minimumDistance = 0.0f;
+		maximumDistance = std::numeric_limits<float>::max();
+	}
+	Vector3 origin;
+	/// Needn't be unit length; distances are in multiples of it
+	Vector3 direction;
+	float minimumDistance;
+	float maximumDistance;
+};
+
+/// Where a ray hit a mesh
+struct RayHit {
+	RayHit() {
+		triangle = RayMissed;
+		distance = std::numeric_limits<float>::max();
+		u = v = 0.0f;
+	}
+	bool IsHit() const {
+		return triangle != RayMissed;
+	}
+	/// The zero-indexed triangle hit, in the order the triangles were given to Build
+	unsigned int triangle;
+	/// How far along the ray, so the point hit is origin + direction * distance
+	float distance;
+	/// Barycentric weights of the triangle's second and third vertex; the first gets 1 - u - v
+	float u;
+	float v;
+};
+
+/// A triangle mesh prepared for ray queries.
+class MeshRayQuery {
+public:
+	MeshRayQuery() { }
+public:
+	/**
+		\brief Build the hierarchy over a triangle list, replacing anything built before.
+		\param positions		The first vertex's x. y and z follow it.
+		\param stride			Floats from one vertex to the next, at least 3.
+		\param indices			Three zero-indexed vertices per triangle.
+		\param triangleCount	The number of triangles.
+	*/
+	void Build(const float* positions, size_t stride, const unsigned int* indices, size_t triangleCount);
+	/// The most main memory Build holds at once for this many triangles, or the largest size_t if that doesn't fit in one.
+	static size_t GetBuildBytes(size_t triangleCount);
+	/**
+		\brief Move the triangles to new vertex positions, keeping the hierarchy and only growing or shrinking its boxes.
+		Much cheaper than Build, but queries slow down as the mesh strays far from the shape it was built in.
+		\param positions	The vertices, laid out as they were for Build.
+		\param stride		Floats from one vertex to the next.
+	*/
+	void Refit(const float* positions, size_t stride);
+	size_t GetTriangleCount() const {
+		return this->triangles.size();
+	}
+	bool IsEmpty() const {
+		return this->triangles.empty();
+	}
+	/// The box around every triangle
+	BoundingBox GetBounds() const;
+	/// Find the nearest triangle along a ray. Triangles are hit from either side.
+	bool ClosestHit(const Ray& ray, RayHit& hit) const;
+	/// Whether the ray hits anything at all. Stops at the first triangle found, so it's cheaper than ClosestHit.
+	bool AnyHit(const Ray& ray) const;
+	/**
+		\brief Find the nearest hit for many rays at once.
+		\param rays		The first ray.
+		\param count	The number of rays.
+		\param hits		Receives one hit per ray; check RayHit::IsHit.
+		\return			The number of rays that hit.
+	*/
+	size_t ClosestHits(const Ray* rays, size_t count, RayHit* hits) const;
+	/// Test many rays at once, like AnyHit. Writes 1 for each ray that hits and 0 for each that doesn't.
+	size_t AnyHits(const Ray* rays, size_t count, unsigned char* hit) const;
+private:
+	/// A box in the hierarchy: two children at first and first + 1, or count triangles from first.
+	struct Node {
+		float minimum[3];
+		unsigned int first;
+		float maximum[3];
+		unsigned int count;
+	};
+	/// A triangle ready for intersection, stored in hierarchy order
+	struct Triangle {
+		Vector3 origin;
+		Vector3 edge1;
+		Vector3 edge2;
+		/// Its index in the order it was built from
+		unsigned int index;
+	};
+	void SetTriangle(size_t i, const float* positions, size_t stride);
+	void Subdivide(size_t node, unsigned int first, unsigned int count, size_t depth, std::vector<unsigned int>& order,
+				   const std::vector<BoundingBox>& boxes, const std::vector<Vector3>& centres);
+	bool Trace(const Ray& ray, bool anyHit, RayHit& hit) const;
+private:
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	/// The three vertices of each triangle, in the same order as triangles
+	std::vector<unsigned int> corners;
+};
+
+#endif
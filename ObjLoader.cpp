@@ -1,10 +1,15 @@
 #include "ObjLoader.h"
-#include <fstream>
+#include "TransformKernels.h"
+#include "Parallel.h"
+#include "CheckedSize.h"
 #include <sstream>
 #include <cmath>
 #include <limits>
+#include <map>
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
+#include <climits>
 #include <cassert>
 
 //--------------------------------------------------------------------------
@@ -15,11 +20,11 @@
  \param vertices		The vertex pool.
  \param triangles	The triangle pool.
  */
-Vector3 CalculateVertexNormal(unsigned int vertexIndex, const std::vector<ObjVertex>& vertices, std::vector<ObjTriangle>& triangles) {
+Vector3 CalculateVertexNormal(size_t vertexIndex, const std::vector<ObjVertex>& vertices, std::vector<ObjTriangle>& triangles) {
 	// First, find the triangles that use this vertex (slooowwwww)
 	Vector3 aggregateFaceNormal;
 	unsigned int adjacentFaces = 0;
-	for(unsigned int triangle = 0; triangle < triangles.size(); triangle++) {
+	for(size_t triangle = 0; triangle < triangles.size(); triangle++) {
 		if(triangles[triangle].GetVertexIndex(0) - 1 == vertexIndex || triangles[triangle].GetVertexIndex(1) - 1 == vertexIndex || triangles[triangle].GetVertexIndex(2) - 1 == vertexIndex) {
 			// Triangle uses this vertex
 			aggregateFaceNormal += triangles[triangle].GetFaceNormal(vertices);
@@ -32,144 +37,342 @@ Vector3 CalculateVertexNormal(unsigned int vertexIndex, const std::vector<ObjVer
 
 //--------------------------------------------------------------------------
 
-inline bool RayTriangleCollision(Vector3 rayOrigin, Vector3 rayDirection, Vector3* triangleVertices, float& t) {
-	// Distance will be returned as a t
-	Vector3 e1, e2, h, s, q;
-	float a, f, u, v;
-	
-	e1 = triangleVertices[1] - triangleVertices[0];
-	e2 = triangleVertices[2] - triangleVertices[0];
-	h = cross(rayDirection, e2);
-	a = e1.dot(h);
+void TriangleMeshInternalDepth::BuildRayQuery(const std::vector<ObjTriangle>& triangles, const std::vector<ObjVertex>& vertices, MeshRayQuery& query) {
+	std::vector<unsigned int> indices(triangles.size() * 3);
+	for(size_t t = 0; t < triangles.size(); t++) {
+		for(size_t v = 0; v < 3; v++) {
+			indices[t * 3 + v] = triangles[t].GetVertexIndex(v) - 1;
+		}
+	}
+	query.Build(vertices.empty() ? NULL : &vertices[0].x, ObjVertexStride, indices.empty() ? NULL : &indices[0], triangles.size());
+}
+
+void TriangleMeshInternalDepth::Calculate(std::vector<ObjTriangle>& triangles, std::vector<ObjVertex>& vertices) {
+	MeshRayQuery query;
+	TriangleMeshInternalDepth::BuildRayQuery(triangles, vertices, query);
+	this->Calculate(query, vertices);
+}
+
+/// The ray a vertex's depth is measured along: from the vertex along its normal, INVERSE!!!
+Ray InternalDepthRay(const ObjVertex& vertex) {
+	Ray ray(Vector3(vertex.x, vertex.y, vertex.z), Vector3(vertex.normalX, vertex.normalY, vertex.normalZ).normalize() * -1);
+	// Skip the triangles around the vertex itself
+	ray.minimumDistance = 0.00001f;
+	return ray;
+}
+
+void TriangleMeshInternalDepth::Calculate(const MeshRayQuery& triangles, const std::vector<ObjVertex>& vertices) {
+	std::cout << "Generating vertex depth information." << std::endl;
 	
-	// Parallel check
-	if(a > -0.00001f && a < 0.00001f) {
-		return false;
+	// Shoot a ray from every vertex to find how far it is to the other side
+	std::vector<Ray> rays(vertices.size());
+	for(size_t i = 0; i < vertices.size(); i++) {
+		rays[i] = InternalDepthRay(vertices[i]);
 	}
 	
-	f = 1.0f / a;
-	s = rayOrigin - triangleVertices[0];
+	// Misses keep the maximum depth
+	std::vector<RayHit> hits(vertices.size());
+	if(!rays.empty()) {
+		triangles.ClosestHits(&rays[0], rays.size(), &hits[0]);
+	}
 	
-	u = f * s.dot(h);
+	this->distances.resize(vertices.size());
+	this->hitTriangles.resize(vertices.size());
+	this->cellSize = 0.0f;
+	for(size_t i = 0; i < hits.size(); i++) {
+		this->distances[i] = hits[i].distance;
+		this->hitTriangles[i] = hits[i].triangle;
+	}
+}
+
+void TriangleMeshInternalDepth::CalculateApproximate(const MeshRayQuery& query, const std::vector<ObjTriangle>& triangles,
+													 const std::vector<ObjVertex>& vertices, size_t resolution) {
+	std::cout << "Generating approximate vertex depth information." << std::endl;
 	
-	// Barycentric range check
-	if(u < 0.0f || u > 1.0f) {
-		return false;
+	std::vector<unsigned int> indices(triangles.size() * 3);
+	for(size_t t = 0; t < triangles.size(); t++) {
+		for(size_t v = 0; v < 3; v++) {
+			indices[t * 3 + v] = triangles[t].GetVertexIndex(v) - 1;
+		}
 	}
+	DistanceField field;
+	field.Build(query, vertices.empty() ? NULL : &vertices[0].x, ObjVertexStride, indices.empty() ? NULL : &indices[0],
+				triangles.size(), resolution);
 	
-	q = cross(s, e1);
+	this->distances.assign(vertices.size(), std::numeric_limits<float>::max());
+	this->hitTriangles.assign(vertices.size(), RayMissed);
+	this->cellSize = field.IsEmpty() ? 0.0f : field.GetCellSize();
+	if(field.IsEmpty()) {
+		return;
+	}
 	
-	v = f * rayDirection.dot(q);
-	if(v < 0.0f || u + v > 1.0f) {
-		return false;
+	ParallelFor(vertices.size(), ParallelRayThreshold, 1, [this, &field, &vertices](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			Ray ray = InternalDepthRay(vertices[i]);
+			this->distances[i] = field.DistanceThrough(ray.origin, ray.direction);
+		}
+	});
+}
+
+InternalDepthError TriangleMeshInternalDepth::MeasureError(const MeshRayQuery& query, const std::vector<ObjVertex>& vertices, size_t sampleCount) const {
+	assert(this->distances.size() == vertices.size());
+	InternalDepthError error;
+	error.cellSize = this->cellSize;
+	if(vertices.empty() || sampleCount == 0) {
+		return error;
 	}
 	
-	t = f * e2.dot(q);
-	if(t > 0.00001f) {
-		// Hit!
-		return true;
+	// Every step-th vertex, so the samples spread over the whole file
+	size_t step = std::max((size_t)1, vertices.size() / sampleCount);
+	std::vector<Ray> rays;
+	std::vector<size_t> sampled;
+	for(size_t i = 0; i < vertices.size() && sampled.size() < sampleCount; i += step) {
+		rays.push_back(InternalDepthRay(vertices[i]));
+		sampled.push_back(i);
 	}
+	std::vector<RayHit> hits(rays.size());
+	query.ClosestHits(&rays[0], rays.size(), &hits[0]);
 	
-	return false;
+	const float miss = std::numeric_limits<float>::max();
+	size_t compared = 0;
+	double total = 0.0;
+	for(size_t i = 0; i < sampled.size(); i++) {
+		float approximate = this->distances[sampled[i]];
+		if((approximate == miss) != !hits[i].IsHit()) {
+			error.differentMisses++;
+		}
+		else if(hits[i].IsHit()) {
+			float difference = std::fabs(approximate - hits[i].distance);
+			error.maximum = std::max(error.maximum, difference);
+			total += difference;
+			compared++;
+		}
+	}
+	error.sampledVertices = sampled.size();
+	error.mean = (compared > 0) ? (float)(total / compared) : 0.0f;
+	return error;
 }
 
-void TriangleMeshInternalDepth::Calculate(std::vector<ObjTriangle>& triangles, std::vector<ObjVertex>& vertices) {
-	this->distances.clear();
+void TriangleMeshInternalDepth::Refresh(MeshRayQuery& query, const std::vector<ObjTriangle>& triangles, const std::vector<ObjVertex>& vertices,
+										const std::vector<unsigned int>& moved, std::vector<unsigned int>& changed) {
+	assert(this->distances.size() == vertices.size()); // Calculate first
+	assert(!this->IsApproximate()); // Only exact depths can be patched up exactly
+	changed.clear();
+	if(moved.empty()) {
+		return;
+	}
 	
-	std::cout << "Generating vertex depth information." << std::endl;
+	query.Refit(&vertices[0].x, ObjVertexStride);
+	
+	std::vector<unsigned char> isMoved(vertices.size(), 0);
+	for(size_t i = 0; i < moved.size(); i++) {
+		isMoved[moved[i]] = 1;
+	}
+	
+	// The triangles that moved with them
+	std::vector<unsigned char> isAffected(triangles.size(), 0);
+	std::vector<unsigned int> affected;
+	std::vector<unsigned int> affectedCorners;
+	for(size_t t = 0; t < triangles.size(); t++) {
+		unsigned int corners[3];
+		for(size_t v = 0; v < 3; v++) {
+			corners[v] = triangles[t].GetVertexIndex(v) - 1;
+		}
+		if(isMoved[corners[0]] || isMoved[corners[1]] || isMoved[corners[2]]) {
+			isAffected[t] = 1;
+			affected.push_back(t);
+			affectedCorners.insert(affectedCorners.end(), corners, corners + 3);
+		}
+	}
 	
+	// A vertex's depth has to be traced again from scratch if its ray moved, or the triangle it stopped at did.
+	// Any other ray still stops where it did, unless a moved triangle now gets in the way first.
+	std::vector<unsigned int> retrace;
+	std::vector<unsigned int> recheck;
 	for(size_t i = 0; i < vertices.size(); i++) {
-		ObjVertex& thisVertex = vertices[i];
-		float minimumDepth = std::numeric_limits<float>::max();
-		Vector3 vertexPosition = Vector3(thisVertex.x, thisVertex.y, thisVertex.z);
-		// Make a new vector for the vertex normal that is INVERSE!!!
-		Vector3 vertexNormalRay = Vector3(thisVertex.normalX, thisVertex.normalY, thisVertex.normalZ).normalize() * -1;
-		
-		for(size_t t = 0; t < triangles.size(); t++) {
-			ObjTriangle& thisTriangle = triangles[t];
-			float depth = 0.0f;
-			
-			Vector3 triangleVertices[3];
-			for(size_t v = 0; v < 3; v++) {
-				// Could try caching this, but who cares
-				ObjVertex& referencedVertex = vertices[thisTriangle.GetVertexIndex(v) - 1];
-				triangleVertices[v] = Vector3(referencedVertex.x, referencedVertex.y, referencedVertex.z);
-			}
-			
-			if(RayTriangleCollision(vertexPosition, vertexNormalRay, triangleVertices, depth)) {
-				if(depth < minimumDepth) {
-					minimumDepth = depth;
-				}
-			}
+		unsigned int hitTriangle = this->hitTriangles[i];
+		if(isMoved[i] || (hitTriangle != RayMissed && isAffected[hitTriangle])) {
+			retrace.push_back(i);
+		}
+		else {
+			recheck.push_back(i);
+		}
+	}
+	
+	std::vector<Ray> rays(retrace.size());
+	std::vector<RayHit> hits(retrace.size());
+	for(size_t i = 0; i < retrace.size(); i++) {
+		rays[i] = InternalDepthRay(vertices[retrace[i]]);
+	}
+	if(!rays.empty()) {
+		query.ClosestHits(&rays[0], rays.size(), &hits[0]);
+	}
+	for(size_t i = 0; i < retrace.size(); i++) {
+		unsigned int vertex = retrace[i];
+		if(hits[i].distance != this->distances[vertex]) {
+			changed.push_back(vertex);
+		}
+		this->distances[vertex] = hits[i].distance;
+		this->hitTriangles[vertex] = hits[i].triangle;
+	}
+	
+	// The rest only need testing against the moved triangles, and only as far as they reach now
+	MeshRayQuery movedTriangles;
+	movedTriangles.Build(&vertices[0].x, ObjVertexStride, affectedCorners.empty() ? NULL : &affectedCorners[0], affected.size());
+	rays.resize(recheck.size());
+	hits.resize(recheck.size());
+	for(size_t i = 0; i < recheck.size(); i++) {
+		rays[i] = InternalDepthRay(vertices[recheck[i]]);
+		rays[i].maximumDistance = this->distances[recheck[i]];
+	}
+	if(!rays.empty()) {
+		movedTriangles.ClosestHits(&rays[0], rays.size(), &hits[0]);
+	}
+	for(size_t i = 0; i < recheck.size(); i++) {
+		if(hits[i].IsHit()) {
+			unsigned int vertex = recheck[i];
+			changed.push_back(vertex);
+			this->distances[vertex] = hits[i].distance;
+			this->hitTriangles[vertex] = affected[hits[i].triangle];
 		}
-		
-		// Assign the minimum depth
-		this->distances.push_back(minimumDepth);
 	}
 	
-	assert(this->distances.size() == vertices.size()); // Make sure they're all there!
+	std::sort(changed.begin(), changed.end());
+}
+
+void TriangleMeshInternalDepth::WriteDepthAsTextureCoordinates(VertexBuffer* vertices, const std::vector<ObjTriangle>& triangles, size_t firstVertex) const {
+	assert(vertices->GetFormat() == ObjMeshFormat);
+	this->WriteDepth(vertices, ObjMeshLayout::Stride(), ObjMeshLayout::OffsetOf(SemanticTextureCoordinate), triangles, firstVertex);
+	
+	// Now that we're done, commit the vertices to GPU
+	vertices->Commit();
+}
+
+void TriangleMeshInternalDepth::WriteDepthAsTextureCoordinates(ObjStreamedVertexBuffer* vertices, const std::vector<ObjTriangle>& triangles) const {
+	this->WriteDepth(vertices->GetAttributes(), ObjMeshAttributeLayout::Stride(), ObjMeshAttributeLayout::OffsetOf(SemanticTextureCoordinate), triangles, 0);
+	
+	// Only the attribute stream changed
+	vertices->GetAttributes()->Commit();
+}
+
+void TriangleMeshInternalDepth::WriteDepthAsTextureCoordinates(GeometryPool& pool, GeometryHandle mesh, const std::vector<ObjTriangle>& triangles) const {
+	assert(pool.GetVertices()->GetFormat() == ObjMeshFormat);
+	this->WriteDepth(pool.GetVertices(), ObjMeshLayout::Stride(), ObjMeshLayout::OffsetOf(SemanticTextureCoordinate), triangles, pool.GetRange(mesh).firstVertex);
+	
+	// Only this mesh changed, so the rest of the pool stays where it is on the GPU
+	pool.CommitRange(mesh);
 }
 
-void TriangleMeshInternalDepth::WriteDepthAsTextureCoordinates(VertexBuffer* vertices, const std::vector<ObjTriangle>& triangles) const {
+void TriangleMeshInternalDepth::WriteDepth(VertexBufferStorage* vertices, unsigned int vertexSize, unsigned int texCoordUOffset,
+										   const std::vector<ObjTriangle>& triangles, size_t firstVertex) const {
 	assert(this->distances.size() > 0); // make sure they were calculated to start with
 	
-	unsigned int vertexSize = vertices->GetVertexStride();
+	if(triangles.empty()) {
+		return;
+	}
 	
-	for(unsigned int t = 0; t < triangles.size(); t++) {
-		const ObjTriangle& thisTriangle = triangles[t];
-		unsigned int baseAddress = (t * vertexSize * 3); // 3 verts/tri
-		
-		for(unsigned int v = 0; v < 3; v++) {
-			// Look up the depth that this vertex of the triangle uses from our table
-			unsigned int vertexIndex = (thisTriangle.GetVertexIndex(v) - 1);
-			float thisVertexDepth = this->distances[vertexIndex];
-			unsigned int vertexOffset = vertexSize * v;
-			unsigned int texCoordUOffset = 3; // 4th object in the vertex (Vertex3Texture2Normal3)
+	// Gather the depth of every triangle corner (3 verts/tri) in buffer order, a chunk of triangles at a time
+	size_t chunkTriangles = std::min(triangles.size(), ObjWriteChunkTriangles);
+	std::vector<float> cornerDepths(chunkTriangles * 3);
+	for(size_t firstTriangle = 0; firstTriangle < triangles.size(); firstTriangle += chunkTriangles) {
+		size_t triangleCount = std::min(chunkTriangles, triangles.size() - firstTriangle);
+		for(size_t t = 0; t < triangleCount; t++) {
+			const ObjTriangle& thisTriangle = triangles[firstTriangle + t];
 			
-			// Write it into the VBO
-			(*vertices)[baseAddress + vertexOffset + texCoordUOffset] = thisVertexDepth;
+			for(size_t v = 0; v < 3; v++) {
+				// Look up the depth that this vertex of the triangle uses from our table
+				unsigned int vertexIndex = (thisTriangle.GetVertexIndex(v) - 1);
+				cornerDepths[t * 3 + v] = this->distances[vertexIndex];
+			}
 		}
+		
+		// Write them into the VBO, one component per vertex
+		vertices->WriteStrided((firstVertex + firstTriangle * 3) * vertexSize + texCoordUOffset, vertexSize, &cornerDepths[0], 1, triangleCount * 3, 1);
 	}
-	
-	// Now that we're done, commit the vertices to GPU
-	vertices->Commit();
 }
 
-float TriangleMeshInternalDepth::GetVertexInternalDistance(size_t vertexIndex) const {
-	return this->distances[vertexIndex];
+void TriangleMeshInternalDepth::WriteDepthAsTextureCoordinates(VertexBuffer* vertices, const std::vector<ObjTriangle>& triangles,
+																const std::vector<unsigned int>& changed, size_t firstVertex) const {
+	assert(vertices->GetFormat() == ObjMeshFormat);
+	this->WriteChangedDepth(vertices, ObjMeshLayout::Stride(), ObjMeshLayout::OffsetOf(SemanticTextureCoordinate), triangles, changed, firstVertex);
 }
 
-// --------------------------------------------------------------
+void TriangleMeshInternalDepth::WriteDepthAsTextureCoordinates(ObjStreamedVertexBuffer* vertices, const std::vector<ObjTriangle>& triangles,
+																const std::vector<unsigned int>& changed) const {
+	this->WriteChangedDepth(vertices->GetAttributes(), ObjMeshAttributeLayout::Stride(), ObjMeshAttributeLayout::OffsetOf(SemanticTextureCoordinate), triangles, changed, 0);
+}
 
-// Tokenize a group of format x/[y]/[z]
-std::vector<std::string> tokenizeGroup(const std::string& str) {
-	std::vector<std::string> grouped(3);
-	std::string currentString = "";
+void TriangleMeshInternalDepth::WriteChangedDepth(VertexBufferStorage* vertices, unsigned int vertexSize, unsigned int texCoordUOffset,
+												  const std::vector<ObjTriangle>& triangles, const std::vector<unsigned int>& changed, size_t firstVertex) const {
+	if(changed.empty()) {
+		return;
+	}
+	
+	std::vector<unsigned char> isChanged(this->distances.size(), 0);
+	for(size_t i = 0; i < changed.size(); i++) {
+		isChanged[changed[i]] = 1;
+	}
 	
-	int group = 0;
-	for(unsigned int i = 0; i < str.length(); i++) {
-		if(str[i] != '/') {
-			currentString += str[i]; // append it
+	// Find the corners that use a changed vertex, as runs of whole vertices to upload. Runs only a few
+	// vertices apart go up as one, since an upload costs more than the handful of extra bytes.
+	const size_t mergeGap = 16;
+	std::vector<std::pair<size_t, size_t> > runs;
+	for(size_t corner = 0; corner < triangles.size() * 3; corner++) {
+		unsigned int vertexIndex = triangles[corner / 3].GetVertexIndex(corner % 3) - 1;
+		if(!isChanged[vertexIndex]) {
+			continue;
+		}
+		if(!runs.empty() && corner <= runs.back().second + mergeGap) {
+			runs.back().second = corner + 1;
 		}
 		else {
-			// Next group!
-			grouped[group] = currentString;
-			currentString = "";
-			group++;
+			runs.push_back(std::make_pair(corner, corner + 1));
 		}
 	}
 	
-	// We ran out of text
-	if(str.length() > 0) {
-		if(grouped[group].size() == 0) {
-			// We didn't get a chance to commit it
-			grouped[group] = currentString;
+	for(size_t run = 0; run < runs.size(); run++) {
+		size_t firstComponent = (firstVertex + runs[run].first) * vertexSize;
+		size_t count = (runs[run].second - runs[run].first) * vertexSize;
+		// A released shadow stays released: the run is written in place on the GPU, rather than the whole
+		// buffer being read back for it and thrown away again. If GL can't map it, it goes through the shadow.
+		float* mapped = NULL;
+		if(vertices->GetResidency() == ResidentGPU) {
+			mapped = vertices->MapRangeForWriting(firstComponent, count);
+		}
+		for(size_t corner = runs[run].first; corner < runs[run].second; corner++) {
+			unsigned int vertexIndex = triangles[corner / 3].GetVertexIndex(corner % 3) - 1;
+			if(!isChanged[vertexIndex]) {
+				continue;
+			}
+			size_t component = (corner - runs[run].first) * vertexSize + texCoordUOffset;
+			if(mapped != NULL) {
+				mapped[component] = this->distances[vertexIndex];
+			}
+			else {
+				vertices->Set(firstComponent + component, this->distances[vertexIndex]);
+			}
+		}
+		
+		if(mapped == NULL) {
+			vertices->CommitRange(firstComponent, count);
+		}
+		else if(!vertices->Unmap()) {
+			// GL lost the buffer while it was mapped; it's blank now and has to be written again whole
+			return;
 		}
 	}
 	
-	return grouped;
+	if(vertices->GetShadowPolicy() == ShadowReleasedAfterCommit && vertices->GetResidency() == ResidentCPUAndGPU) {
+		vertices->ReleaseShadow();
+	}
 }
 
+float TriangleMeshInternalDepth::GetVertexInternalDistance(size_t vertexIndex) const {
+	return this->distances[vertexIndex];
+}
+
+// --------------------------------------------------------------
+
 std::vector<std::string> SplitString(const std::string& str, char splitCharacter) {
 	std::vector<std::string> output;
 	std::string currentString;
@@ -194,369 +397,945 @@ std::vector<std::string> SplitString(const std::string& str, char splitCharacter
 	return output;
 }
 
+/// Cut the spaces, tabs and carriage returns off both ends of a string
+std::string TrimString(const std::string& str) {
+	size_t first = str.find_first_not_of(" \t\r");
+	if(first == std::string::npos) {
+		return "";
+	}
+	size_t last = str.find_last_not_of(" \t\r");
+	return str.substr(first, last - first + 1);
+}
+
+/// Read a float at cursor, skipping the whitespace before it, and move cursor past it. Reads 0 if there's no number.
+float ParseFloat(const char*& cursor) {
+	char* end = NULL;
+	float value = strtof(cursor, &end);
+	cursor = end;
+	return value;
+}
+
+/**
+	\brief Read a face corner of the form v, v/t, v//n or v/t/n and move cursor past it.
+	\param cursor	Anywhere before the corner; leading whitespace is skipped.
+	\param corner	Receives the vertex, texture coordinate and normal indices. Missing ones read as 1.
+	\return			False if there's no corner left on the line.
+*/
+bool ParseFaceCorner(const char*& cursor, unsigned int corner[3]) {
+	while(*cursor == ' ' || *cursor == '\t' || *cursor == '\r') {
+		cursor++;
+	}
+	if(*cursor == '\0') {
+		return false;
+	}
+	for(int part = 0; part < 3; part++) {
+		long index = 0;
+		if(*cursor != '/' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\0') {
+			char* end = NULL;
+			index = strtol(cursor, &end, 10);
+			cursor = end;
+		}
+		// Indices too big for a triangle to hold saturate, so they fail the range checks in ParseMesh rather than wrap round to a real vertex
+		corner[part] = (index <= 0) ? 1 : ((unsigned long)index > UINT_MAX) ? UINT_MAX : (unsigned int)index;
+		if(*cursor == '/') {
+			cursor++;
+		}
+		else {
+			// The rest are missing
+			for(part++; part < 3; part++) {
+				corner[part] = 1;
+			}
+		}
+	}
+	// Skip anything unexpected to the end of the corner
+	while(*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r') {
+		cursor++;
+	}
+	return true;
+}
+
+/// Orders triangles by material, for grouping them into submeshes
+struct ObjTriangleMaterialOrder {
+	bool operator()(const ObjTriangle& a, const ObjTriangle& b) const {
+		if(a.GetMaterialIndex() != b.GetMaterialIndex()) {
+			return a.GetMaterialIndex() < b.GetMaterialIndex();
+		}
+		return a.GetGroupIndex() < b.GetGroupIndex();
+	}
+};
+
+/// Work out the bounds of a submesh from the triangles it covers
+void CalculateSubmeshBounds(const ObjMeshData& mesh, Submesh& submesh) {
+	submesh.bounds = BoundingBox();
+	size_t firstTriangle = submesh.firstIndex / 3;
+	size_t lastTriangle = (submesh.firstIndex + submesh.indexCount) / 3;
+	for(size_t t = firstTriangle; t < lastTriangle; t++) {
+		for(int v = 0; v < 3; v++) {
+			const ObjVertex& vertex = mesh.vertices[mesh.triangles[t].GetVertexIndex(v) - 1];
+			submesh.bounds.Extend(Vector3(vertex.x, vertex.y, vertex.z));
+		}
+	}
+	
+	// The same sphere BoundingSphere::Enclosing would make, around corners instead of a run of points
+	submesh.boundingSphere = BoundingSphere();
+	if(!submesh.bounds.IsEmpty()) {
+		Vector3 centre = submesh.bounds.GetCentre();
+		float radiusSquared = 0.0f;
+		for(size_t t = firstTriangle; t < lastTriangle; t++) {
+			for(int v = 0; v < 3; v++) {
+				const ObjVertex& vertex = mesh.vertices[mesh.triangles[t].GetVertexIndex(v) - 1];
+				Vector3 offset = Vector3(vertex.x, vertex.y, vertex.z) - centre;
+				radiusSquared = std::max(radiusSquared, offset.dot(offset));
+			}
+		}
+		submesh.boundingSphere = BoundingSphere(centre, std::sqrt(radiusSquared));
+	}
+}
+
+/// The main memory the parsed arrays of a mesh hold, spare capacity included
+size_t ParsedMeshBytes(const ObjMeshData& mesh) {
+	return mesh.vertices.capacity() * sizeof(ObjVertex) + mesh.normals.capacity() * sizeof(ObjNormal)
+		   + mesh.textureCoordinates.capacity() * sizeof(ObjTextureCoordinate) + mesh.triangles.capacity() * sizeof(ObjTriangle);
+}
+
 // --------------------------------------------------------------
 
-MeshGeometry ObjLoader::LoadMesh(const std::string& path) const {
+InputSource* ObjLoader::OpenInput(const std::string& path) const {
+	return OpenInputSource(path);
+}
+
+bool ObjLoader::ParseMaterials(const std::string& path, std::vector<ObjMaterial>& materials) const {
+	InputSource* input = this->OpenInput(path);
+	if(input == NULL) {
+		std::cerr << "Could not open MTL file \"" + path + "\"!" << std::endl;
+		return false;
+	}
+	
+	std::string buffer;
+	ObjMaterial* material = NULL;
+	LineReader lines(*input);
+	while(lines.ReadLine(buffer)) {
+		std::istringstream line(buffer);
+		std::string keyword;
+		line >> keyword;
+		
+		if(keyword == "newmtl") {
+			materials.push_back(ObjMaterial());
+			material = &materials.back();
+			material->name = TrimString(buffer.substr(buffer.find("newmtl") + 6));
+			continue;
+		}
+		if(material == NULL || keyword.empty() || keyword[0] == '#') {
+			// Nothing to attach it to, or nothing at all
+			continue;
+		}
+		
+		if(keyword == "Ka" || keyword == "Kd" || keyword == "Ks" || keyword == "Ke") {
+			// format: Kd r g b
+			float r = 0.0f, g = 0.0f, b = 0.0f;
+			line >> r >> g >> b;
+			Vector3 colour(r, g, b);
+			if(keyword == "Ka") {
+				material->ambient = colour;
+			}
+			else if(keyword == "Kd") {
+				material->diffuse = colour;
+			}
+			else if(keyword == "Ks") {
+				material->specular = colour;
+			}
+			else {
+				material->emissive = colour;
+			}
+		}
+		else if(keyword == "Ns") {
+			line >> material->shininess;
+		}
+		else if(keyword == "d") {
+			line >> material->opacity;
+		}
+		else if(keyword == "Tr") {
+			float transparency = 0.0f;
+			line >> transparency;
+			material->opacity = 1.0f - transparency;
+		}
+		else if(keyword == "illum") {
+			line >> material->illumination;
+		}
+		else if(keyword.substr(0, 4) == "map_" || keyword == "bump") {
+			// format: map_Kd [options] file. The file comes last.
+			std::vector<std::string> parts = SplitString(TrimString(buffer), ' ');
+			std::string file = parts.back();
+			std::string mtlDirectory = path.substr(0, path.find_last_of("/\\") + 1);
+			if(keyword == "map_Ka") {
+				material->ambientMap = mtlDirectory + file;
+			}
+			else if(keyword == "map_Kd") {
+				material->diffuseMap = mtlDirectory + file;
+			}
+			else if(keyword == "map_Ks") {
+				material->specularMap = mtlDirectory + file;
+			}
+			else if(keyword == "map_d") {
+				material->opacityMap = mtlDirectory + file;
+			}
+			else if(keyword == "map_bump" || keyword == "map_Bump" || keyword == "bump") {
+				material->bumpMap = mtlDirectory + file;
+			}
+		}
+	}
+	bool failed = input->HasFailed();
+	delete input;
+	return !failed;
+}
+
+bool ObjLoader::ParseMesh(const std::string& path, ObjMeshData& mesh) const {
 	
-	// Try opening the file for starters.
-	std::ifstream input(path.c_str());
+	// Try opening the file for starters. Compressed files are decompressed as they're read.
+	InputSource* input = this->OpenInput(path);
 	std::string buffer;
 	
-	unsigned int numberOfTextureCoordinates = 0;
-	unsigned int numberOfNormals = 0;
-	unsigned int numberOfTriangles = 0;
-	unsigned int numberOfVertices = 0;
+	bool parsed = false;
 	
-	// Create the geometry cache object
-	MeshGeometry output;
-	output.vertices = NULL;
-	output.indices = NULL;
+	// Material libraries and texture maps are named relative to the OBJ file
+	std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+	if(this->loadLimit != 0 && ParsedMeshBytes(mesh) > this->loadLimit) {
+		// The arrays kept from a bigger load would count against this one
+		mesh = ObjMeshData();
+	}
+	// Triangles before any usemtl, g or o get an unnamed material and group
+	mesh.materials.assign(1, ObjMaterial());
+	mesh.groups.assign(1, std::string());
+	mesh.submeshes.clear();
+	mesh.scale = 1.0f;
+	mesh.bounds = BoundingBox();
+	mesh.boundingSphere = BoundingSphere();
 	
-	if(!input.is_open()) {
-		// Load failed (file not found)
+	if(input == NULL) {
+		// Load failed (file not found, or compressed in a way we weren't built for)
 		std::cerr << "Could not open OBJ file \"" + path + "\"!" << std::endl;
 	}
 	else {
-		// First we'll scan to figure out how many vertices,
-		// texture coordinates, normals and triangles there are
-		// in the file.
-		while(!input.eof()) {
-			// Read each line
-			std::getline(input, buffer);
+		// Read the whole file in one pass, so a compressed file is only decompressed once. The arrays
+		// keep their capacity from one load to the next, so they rarely have to grow.
+		std::vector<ObjVertex>& vertices = mesh.vertices;
+		std::vector<ObjNormal>& normals = mesh.normals;
+		std::vector<ObjTextureCoordinate>& textureCoordinates = mesh.textureCoordinates;
+		std::vector<ObjTriangle>& triangles = mesh.triangles;
+		vertices.clear();
+		normals.clear();
+		textureCoordinates.clear();
+		triangles.clear();
+		
+		unsigned int material = 0;
+		unsigned int group = 0;
+		// The first material of each name wins, like the first vertex of each position
+		std::map<std::string, unsigned int> materialIndices;
+		// Groups by name, starting with the unnamed one
+		std::map<std::string, unsigned int> groupIndices;
+		groupIndices.insert(std::make_pair(std::string(), 0u));
+		// The furthest vertex, texture coordinate and normal any face refers to, checked against the arrays once they've all been read
+		unsigned int highestVertex = 0;
+		unsigned int highestTextureCoordinate = 0;
+		unsigned int highestNormal = 0;
+		bool overLimit = false;
+		
+		LineReader lines(*input);
+		while(lines.ReadLine(buffer)) {
+			if(this->loadLimit != 0 && ParsedMeshBytes(mesh) > this->loadLimit) {
+				std::cerr << "OBJ file \"" + path + "\" is too big to read within the load limit of " << this->loadLimit << " bytes" << std::endl;
+				overLimit = true;
+				break;
+			}
+			
+			// The records below are read straight out of the line, so most lines don't allocate at all.
+			const char* cursor = buffer.c_str();
 			
 			if(buffer.substr(0, 2) == "vn") {
-				// Vertex normal
-				numberOfNormals++;
+				// Format vn nx ny nz
+				cursor += 2;
+				normals.push_back(ObjNormal());
+				normals.back().x = ParseFloat(cursor);
+				normals.back().y = ParseFloat(cursor);
+				normals.back().z = ParseFloat(cursor);
 			}
 			else if(buffer.substr(0, 2) == "vt") {
-				// Vertex texture coordinate
-				numberOfTextureCoordinates++;
+				// format: vt u v
+				cursor += 2;
+				textureCoordinates.push_back(ObjTextureCoordinate());
+				textureCoordinates.back().u = ParseFloat(cursor);
+				textureCoordinates.back().v = ParseFloat(cursor);
 			}
 			else if(buffer.substr(0, 1) == "v") {
-				// Vertex
-				numberOfVertices++;
+				// format: v x y z
+				cursor += 1;
+				vertices.push_back(ObjVertex());
+				vertices.back().x = ParseFloat(cursor);
+				vertices.back().y = ParseFloat(cursor);
+				vertices.back().z = ParseFloat(cursor);
+			}
+			else if(buffer.substr(0, 6) == "mtllib") {
+				// Material libraries, relative to the OBJ file. They come before the usemtl records that use them.
+				std::vector<std::string> libraries = SplitString(TrimString(buffer.substr(6)), ' ');
+				for(size_t i = 0; i < libraries.size(); i++) {
+					size_t first = mesh.materials.size();
+					this->ParseMaterials(directory + libraries[i], mesh.materials);
+					for(size_t m = first; m < mesh.materials.size(); m++) {
+						materialIndices.insert(std::make_pair(mesh.materials[m].name, (unsigned int)m));
+					}
+				}
+			}
+			else if(buffer.substr(0, 6) == "usemtl") {
+				// format: usemtl name
+				std::string name = TrimString(buffer.substr(6));
+				std::map<std::string, unsigned int>::iterator found = materialIndices.find(name);
+				if(found == materialIndices.end()) {
+					std::cerr << "Material \"" + name + "\" isn't in any material library; using defaults" << std::endl;
+					mesh.materials.push_back(ObjMaterial());
+					mesh.materials.back().name = name;
+					found = materialIndices.insert(std::make_pair(name, (unsigned int)mesh.materials.size() - 1)).first;
+				}
+				material = found->second;
+			}
+			else if(buffer.substr(0, 1) == "g" || buffer.substr(0, 1) == "o") {
+				// format: g name, or o name. A name that comes back continues the group it named before.
+				std::string name = TrimString(buffer.substr(1));
+				std::map<std::string, unsigned int>::iterator found = groupIndices.find(name);
+				if(found == groupIndices.end()) {
+					mesh.groups.push_back(name);
+					found = groupIndices.insert(std::make_pair(name, (unsigned int)mesh.groups.size() - 1)).first;
+				}
+				group = found->second;
 			}
 			else if(buffer.substr(0, 1) == "f") {
-				// Face
-				
-				// Not necessarily a triangle, so now we gotta count it.
-				std::vector<std::string> faceParts = SplitString(buffer, ' ');
+				// Format: vertexIndex1/[textureIndex1]/[normalIndex1] vertexIndex2/[textureIndex2]/[normalIndex2] vertexIndex3/[textureIndex3]/[normalIndex3]
+				// Missing indices read as 1. A fourth corner makes a quad, split into two triangles.
+				cursor += 1;
+				unsigned int corners[4][3];
+				int cornerCount = 0;
+				while(cornerCount < 4 && ParseFaceCorner(cursor, corners[cornerCount])) {
+					cornerCount++;
+				}
+				for(int c = cornerCount; c < 3; c++) {
+					// Too short to be a face; the missing corners read as 1 like missing indices do
+					corners[c][0] = corners[c][1] = corners[c][2] = 1;
+				}
 				
-				numberOfTriangles++;
-				if(faceParts.size() > 4) {
-					// We have to make another triangle for this face. It's a quad.
-					numberOfTriangles++;
+				// The first triangle, and for a quad the second, which reuses the first and third corners
+				static const int quadCorners[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+				for(int half = 0; half < ((cornerCount > 3) ? 2 : 1); half++) {
+					triangles.push_back(ObjTriangle());
+					ObjTriangle& triangle = triangles.back();
+					for(int v = 0; v < 3; v++) {
+						const unsigned int* corner = corners[quadCorners[half][v]];
+						highestVertex = std::max(highestVertex, corner[0]);
+						highestTextureCoordinate = std::max(highestTextureCoordinate, corner[1]);
+						highestNormal = std::max(highestNormal, corner[2]);
+						triangle.SetVertexIndex(v, corner[0]);
+						triangle.SetTextureCoordinateIndex(v, corner[1]);
+						triangle.SetNormalIndex(v, corner[2]);
+					}
+					triangle.SetMaterialIndex(material);
+					triangle.SetGroupIndex(group);
 				}
 			}
 		}
 		
-		// Instantiate the arrays
-		std::vector<ObjVertex> vertices(numberOfVertices);
-		std::vector<ObjNormal> normals(std::max(1u, numberOfNormals)); // if no normals, just predefine some
-		std::vector<ObjTextureCoordinate> textureCoordinates(std::max(1u, numberOfTextureCoordinates));
-		std::vector<ObjTriangle> triangles(numberOfTriangles);
-		
-		// Reset the read pointer, otherwise it will just keep shouting eof.		
-		input.clear();
-		input.seekg(0, std::ios::beg);
+		// If there are no normals or texture coordinates, just predefine some
+		if(normals.empty()) {
+			normals.push_back(ObjNormal());
+		}
+		if(textureCoordinates.empty()) {
+			textureCoordinates.push_back(ObjTextureCoordinate());
+		}
 		
-		if(!input.is_open()) {
-			std::cerr << "Could not reopen OBJ file for second stage load" << std::endl;
+		if(overLimit) {
+			// Don't hang on to the arrays that didn't fit
+			mesh = ObjMeshData();
+		}
+		else if(input->HasFailed()) {
+			std::cerr << "Could not read all of OBJ file \"" + path + "\"!" << std::endl;
+		}
+		else if(highestVertex > vertices.size()) {
+			std::cerr << "OBJ file \"" + path + "\" has a face on vertex " << highestVertex << " but only " << vertices.size() << " vertices" << std::endl;
+		}
+		else if(highestTextureCoordinate > textureCoordinates.size()) {
+			std::cerr << "OBJ file \"" + path + "\" has a face on texture coordinate " << highestTextureCoordinate << " but only " << textureCoordinates.size() << " texture coordinates" << std::endl;
+		}
+		else if(highestNormal > normals.size()) {
+			std::cerr << "OBJ file \"" + path + "\" has a face on normal " << highestNormal << " but only " << normals.size() << " normals" << std::endl;
 		}
 		else {
-			// Keep reading through line by line and break down the format now			
-			int normal = 0;
-			int textureCoordinate = 0;
-			int vertex = 0;
-			int triangle = 0;
-			
-			while(!input.eof()) {
-				// Fetch the line
-				std::getline(input, buffer);
-				// Create a stringstream for fast searching
-				std::istringstream line(buffer);
-				
-				if(buffer.substr(0, 2) == "vn") {
-					std::string temp, f1, f2, f3;
-					// Parse out some floats and the parameters
-					// Format vn nx ny nz
-					line >> temp >> f1 >> f2 >> f3;
-					float x = (float)atof(f1.c_str());
-					float y = (float)atof(f2.c_str());
-					float z = (float)atof(f3.c_str());
-					normals[normal].x = x;
-					normals[normal].y = y;
-					normals[normal].z = z;
-					normal++;
-				}
-				else if(buffer.substr(0, 2) == "vt") {
-					// format: vt u v
-					std::string temp, f1, f2;
-					line >> temp >> f1 >> f2;
-					float u = (float)atof(f1.c_str());
-					float v = (float)atof(f2.c_str());
-					textureCoordinates[textureCoordinate].u = u;
-					textureCoordinates[textureCoordinate].v = v;
-					textureCoordinate++;
-				}
-				else if(buffer.substr(0, 1) == "v") {
-					// format: v x y z
-					std::string temp, f1, f2, f3;
-					line >> temp >> f1 >> f2 >> f3;
-					float x = (float)atof(f1.c_str());
-					float y = (float)atof(f2.c_str());
-					float z = (float)atof(f3.c_str());
-					vertices[vertex].x = x;
-					vertices[vertex].y = y;
-					vertices[vertex].z = z;
-					vertex++;
-				}
-				else if(buffer.substr(0, 1) == "f") {
-					// Format: vertexIndex1/[textureIndex1]/[normalIndex1] vertexIndex2/[textureIndex2]/[normalIndex2] vertexIndex3/[textureIndex3]/[normalIndex3]
-					
-					std::vector<std::string> vertices = SplitString(buffer, ' ');
-					
-					// Now parse them all.
-					std::vector<std::string> v1Parts = tokenizeGroup(vertices[1]);
-					std::vector<std::string> v2Parts = tokenizeGroup(vertices[2]);
-					std::vector<std::string> v3Parts = tokenizeGroup(vertices[3]);
-					
-					// Load the vertex indexes
-					triangles[triangle].SetVertexIndex(0, (v1Parts[0].length() > 0) ? atoi(v1Parts[0].c_str()) : 1);
-					triangles[triangle].SetVertexIndex(1, (v2Parts[0].length() > 0) ? atoi(v2Parts[0].c_str()) : 1);
-					triangles[triangle].SetVertexIndex(2, (v3Parts[0].length() > 0) ? atoi(v3Parts[0].c_str()) : 1);
-					
-					// Load the texture coordinates	(if present)
-					triangles[triangle].SetTextureCoordinateIndex(0, (v1Parts[1].length() > 0) ? atoi(v1Parts[1].c_str()) : 1);
-					triangles[triangle].SetTextureCoordinateIndex(1, (v2Parts[1].length() > 1) ? atoi(v2Parts[1].c_str()) : 1);
-					triangles[triangle].SetTextureCoordinateIndex(2, (v3Parts[1].length() > 1) ? atoi(v3Parts[1].c_str()) : 1);
-					
-					// Load the normals (if present)
-					triangles[triangle].SetNormalIndex(0, (v1Parts[2].length() > 0) ? atoi(v1Parts[2].c_str()) : 1);
-					triangles[triangle].SetNormalIndex(1, (v2Parts[2].length() > 0) ? atoi(v2Parts[2].c_str()) : 1);
-					triangles[triangle].SetNormalIndex(2, (v3Parts[2].length() > 0) ? atoi(v3Parts[2].c_str()) : 1);
-					
-					triangle++;
-					
-					if(vertices.size() > 4) {
-						// Making a quad.
-						// Make another triangle
-						std::vector<std::string> v4Parts = tokenizeGroup(vertices[4]);
-						
-						// Use the previous two vertices
-						triangles[triangle].SetVertexIndex(0, (v1Parts[0].length() > 0) ? atoi(v1Parts[0].c_str()) : 1);
-						triangles[triangle].SetVertexIndex(1, (v3Parts[0].length() > 0) ? atoi(v3Parts[0].c_str()) : 1);
-						triangles[triangle].SetVertexIndex(2, (v4Parts[0].length() > 0) ? atoi(v4Parts[0].c_str()) : 1);
-						
-						triangles[triangle].SetTextureCoordinateIndex(0, (v1Parts[1].length() > 1) ? atoi(v1Parts[1].c_str()) : 1);
-						triangles[triangle].SetTextureCoordinateIndex(1, (v3Parts[1].length() > 1) ? atoi(v3Parts[1].c_str()) : 1);
-						triangles[triangle].SetTextureCoordinateIndex(2, (v4Parts[1].length() > 1) ? atoi(v4Parts[1].c_str()) : 1);
-						
-						triangles[triangle].SetNormalIndex(0, (v1Parts[2].length() > 0) ? atoi(v1Parts[2].c_str()) : 1);
-						triangles[triangle].SetNormalIndex(1, (v3Parts[2].length() > 0) ? atoi(v3Parts[2].c_str()) : 1);
-						triangles[triangle].SetNormalIndex(2, (v4Parts[2].length() > 0) ? atoi(v4Parts[2].c_str()) : 1);
-						
-						++triangle;
-					}
+			// Group the triangles by material, then by group within a material, so each is one run of indices
+			std::stable_sort(triangles.begin(), triangles.end(), ObjTriangleMaterialOrder());
+			for(size_t i = 0; i < triangles.size(); i++) {
+				if(mesh.submeshes.empty() || mesh.submeshes.back().material != triangles[i].GetMaterialIndex()
+				   || mesh.submeshes.back().group != triangles[i].GetGroupIndex()) {
+					Submesh submesh;
+					submesh.material = triangles[i].GetMaterialIndex();
+					submesh.group = triangles[i].GetGroupIndex();
+					submesh.firstIndex = submesh.firstVertex = i * 3;
+					submesh.indexCount = 0;
+					mesh.submeshes.push_back(submesh);
 				}
+				mesh.submeshes.back().indexCount += 3;
+				mesh.submeshes.back().lastVertex = i * 3 + 2;
 			}
 			
-			// We're done, close it out
-			input.close();
-			
-			
-			// ATTEMPTING TO CENTER MODEL
-
-			float minX = std::numeric_limits<float>::max();
-			float maxX = std::numeric_limits<float>::min();
-			float minY = std::numeric_limits<float>::max();
-			float maxY = std::numeric_limits<float>::min();
-			float minZ = std::numeric_limits<float>::max();
-			float maxZ = std::numeric_limits<float>::min();
-			
-			float xSum = 0.0f;
-			float ySum = 0.0f;
-			float zSum = 0.0f;
 			
-			/*for(unsigned int i = 0; i < triangles.size(); i++) {
-				for(unsigned int v = 0; v < 3; v++) {
-					minX = std::min(minX, vertices[triangles[i].GetVertexIndex(v) - 1].x);
-					maxX = std::max(maxX, vertices[triangles[i].GetVertexIndex(v) - 1].x);
-					minY = std::min(minY, vertices[triangles[i].GetVertexIndex(v) - 1].y);
-					maxY = std::max(maxY, vertices[triangles[i].GetVertexIndex(v) - 1].y);
-					minZ = std::min(minZ, vertices[triangles[i].GetVertexIndex(v) - 1].z);
-					maxZ = std::max(maxZ, vertices[triangles[i].GetVertexIndex(v) - 1].z);
-					
-					xSum += vertices[triangles[i].GetVertexIndex(v) - 1].x;
-					ySum += vertices[triangles[i].GetVertexIndex(v) - 1].y;
-					zSum += vertices[triangles[i].GetVertexIndex(v) - 1].z;
-				}
-			}*/
-			
-			for(unsigned int v = 0; v < vertices.size(); v++) {
-				minX = std::min(minX, vertices[v].x);
-				maxX = std::max(maxX, vertices[v].x);
-				minY = std::min(minY, vertices[v].y);
-				maxY = std::max(maxY, vertices[v].y);
-				minZ = std::min(minZ, vertices[v].z);
-				maxZ = std::max(maxZ, vertices[v].z);
-				
-				xSum += vertices[v].x;
-				ySum += vertices[v].y;
-				zSum += vertices[v].z;
+			// Centre the model on the mean of its vertices
+			PointStatistics statistics;
+			if(!vertices.empty()) {
+				statistics = MeasurePoints(&vertices[0].x, ObjVertexStride, vertices.size());
 			}
+			const Vector3& minimum = statistics.bounds.minimum;
+			const Vector3& maximum = statistics.bounds.maximum;
+			const Vector3& average = statistics.centroid;
+			std::cout << "Maximum dimensions: [" << minimum[0] << "," << maximum[0] << "] [" << minimum[1] << "," << maximum[1] << "] [" << minimum[2] << "," << maximum[2] << "]" << std::endl;
+			std::cout << "Average: [" << average[0] << "," << average[1] << "," << average[2] << "]" << std::endl;
 			
-			float aveX = xSum / vertices.size();//(minX + maxX) / 2.0f;
-			float aveY = ySum / vertices.size();//(minY + maxY) / 2.0f;
-			float aveZ = zSum / vertices.size();//(minZ + maxZ) / 2.0f;
-			std::cout << "Maximum dimensions: [" << minX << "," << maxX << "] [" << minY << "," << maxY << "] [" << minZ << "," << maxZ << "]" << std::endl;
-			std::cout << "Average: [" << aveX << "," << aveY << "," << aveZ << "]" << std::endl;
-			
-			for(unsigned int v = 0; v < vertices.size(); v++) {
-				vertices[v].x -= aveX;
-				vertices[v].y -= aveY;
-				vertices[v].z -= aveZ;
+			if(!vertices.empty()) {
+				Matrix4 centre = Matrix4::translation(Vector3(-average[0], -average[1], -average[2]));
+				TransformPoints(centre, &vertices[0].x, ObjVertexStride, &vertices[0].x, ObjVertexStride, vertices.size());
 			}
 			
-			/*for (unsigned int i = 0;i < triangles.size();i++) {
-				for (unsigned int v=0;v<3;v++) {
-					vertices[triangles[i].GetVertexIndex(v) - 1].x -= aveX;
-					vertices[triangles[i].GetVertexIndex(v) - 1].y -= aveY;
-					vertices[triangles[i].GetVertexIndex(v) - 1].z -= aveZ;
-				}
-			}*/
-			
-			// END ATTEMPTING TO CENTER MODEL
-			
-			// Figure out the scales so we can rope this thing down
-			float width = std::numeric_limits<float>::min();
-			float height = std::numeric_limits<float>::min();
-			float depth = std::numeric_limits<float>::min();
-			 
-			for(unsigned int i = 0; i < triangles.size(); i++) {
-				for(unsigned int v = 0; v < 3; v++) {
-					width = std::max(width, std::fabs(vertices[triangles[i].GetVertexIndex(v) - 1].x));
-					height = std::max(height, std::fabs(vertices[triangles[i].GetVertexIndex(v) - 1].y));
-					float z = std::fabs(vertices[triangles[i].GetVertexIndex(v) - 1].z);
-					depth = std::max(depth, z);
-				}
-			 }
+			// Figure out the scales so we can rope this thing down: the furthest the centred model reaches along each axis
+			float width = 0.0f;
+			float height = 0.0f;
+			float depth = 0.0f;
+			if(!vertices.empty()) {
+				width = std::max(maximum[0] - average[0], average[0] - minimum[0]);
+				height = std::max(maximum[1] - average[1], average[1] - minimum[1]);
+				depth = std::max(maximum[2] - average[2], average[2] - minimum[2]);
+			}
 			
 			std::cout << "New dimensions: [" << width << "," << height << "," << depth << "]" << std::endl;
 			
-			// Build the vertex buffer.
-			VertexBuffer* vb = new VertexBuffer(numberOfTriangles * 3 * 8, Vertex3Texture2Normal3); // 8 for Vertex3Texture2Normal3
-			IndexBuffer* ib = new IndexBuffer(numberOfTriangles * 3);
-			
 			// Clamp the size of the model so that the biggest axis is normalized to 1.0f world units
 			float scale = std::max(0.5f, std::max(width, std::max(height, depth)));
 
 			std::cout << "Calculating normals" << std::endl;
 
-			struct TemporaryTriangle {
-				float x;
-				float y;
-				float z;
-
-				float u;
-				float v;
-
-				float normalX;
-				float normalY;
-				float normalZ;
-			};
-
 			// Rebuild all the vertex normals
-			for(unsigned int i = 0; i < vertices.size(); i++) {
+			for(size_t i = 0; i < vertices.size(); i++) {
 				Vector3 vertexNormal = CalculateVertexNormal(i, vertices, triangles);
 				vertices[i].normalX = vertexNormal[0];
 				vertices[i].normalY = vertexNormal[1];
 				vertices[i].normalZ = vertexNormal[2];
 			}
 			
-			// Scale the vertices
-			for(unsigned int v = 0; v < vertices.size(); v++) {
-				float adjustedScale = 1.0f / (scale * 2.0f);
-				
-				vertices[v].x *= adjustedScale;
-				vertices[v].y *= adjustedScale;
-				vertices[v].z *= adjustedScale;
+			// Scale the vertices. The normals were computed on the unscaled mesh, but a uniform scale doesn't turn them.
+			float adjustedScale = 1.0f / (scale * 2.0f);
+			if(!vertices.empty()) {
+				TransformPoints(Matrix4::scale(adjustedScale), &vertices[0].x, ObjVertexStride, &vertices[0].x, ObjVertexStride, vertices.size());
 			}
 			
-			// Now that all the vertices are set up, calculate the vertex depths before we
-			// write the whole thing into a vertex buffer
+			mesh.scale = scale;
+			if(!vertices.empty()) {
+				mesh.bounds = BoundingBox::Enclosing(&vertices[0].x, ObjVertexStride, vertices.size());
+				mesh.boundingSphere = BoundingSphere::Enclosing(mesh.bounds, &vertices[0].x, ObjVertexStride, vertices.size());
+			}
+			for(size_t i = 0; i < mesh.submeshes.size(); i++) {
+				CalculateSubmeshBounds(mesh, mesh.submeshes[i]);
+			}
+			parsed = true;
+		}
+	}
+	
+	delete input;
+	return parsed;
+}
+
+bool ObjLoader::CheckMeshSize(const ObjMeshData& mesh, const std::string& path, bool newBuffers) const {
+	// Every triangle gets three vertices of its own, numbered by the ray query and the index buffer
+	size_t cornerCount = 0;
+	size_t vertexBytes = 0;
+	if(mesh.triangles.size() >= RayMissed || !MultiplySizes(mesh.triangles.size(), 3, cornerCount)
+	   || !MultiplySizes(cornerCount, ObjMeshLayout::Stride() * sizeof(float), vertexBytes)) {
+		std::cerr << "OBJ file \"" + path + "\" has too many triangles to load (" << mesh.triangles.size() << ")" << std::endl;
+		return false;
+	}
+	if(cornerCount > MaxIndexedVertices) {
+		std::cerr << "OBJ file \"" + path + "\" has " << cornerCount << " triangle corners, more than the " << MaxIndexedVertices
+				  << " an index can address" << std::endl;
+		return false;
+	}
+	
+	size_t bytes = this->EstimateLoadBytes(mesh, newBuffers);
+	if(this->loadLimit != 0 && bytes > this->loadLimit) {
+		std::cerr << "Loading OBJ file \"" + path + "\" takes about " << bytes << " bytes, over the load limit of "
+				  << this->loadLimit << " bytes" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+size_t ObjLoader::EstimateLoadBytes(const ObjMeshData& mesh, bool newBuffers) const {
+	const size_t overflowed = (size_t)-1;
+	size_t triangleCount = mesh.triangles.size();
+	size_t vertexCount = mesh.vertices.size();
+	size_t cornerCount = 0;
+	if(!MultiplySizes(triangleCount, 3, cornerCount)) {
+		return overflowed;
+	}
+	
+	// Each part is a count of items times the bytes of each
+	size_t parts[6][2] = {
+		// The ray query, and the corner indices it's built from
+		{ 1, MeshRayQuery::GetBuildBytes(triangleCount) },
+		{ cornerCount, sizeof(unsigned int) },
+		// The depths, and the rays that measure them or the corner indices the distance field is built from
+		{ vertexCount, sizeof(float) + sizeof(unsigned int) + sizeof(Ray) + sizeof(RayHit) },
+		{ 1, (this->depthMethod == InternalDepthApproximate) ? DistanceField::GetBuildBytes(this->depthResolution) : 0 },
+		// The shadow arrays, and for strips the welded corners and the strips, which degenerate joins can make longer than a list
+		{ newBuffers ? cornerCount : 0, ObjMeshLayout::Stride() * sizeof(float) + sizeof(IndexType) },
+		{ this->triangleStrips ? cornerCount : 0, sizeof(unsigned long long) * 2 + sizeof(IndexType) * 5 }
+	};
+	
+	size_t total = ParsedMeshBytes(mesh);
+	// The corners and depths being staged into the buffers
+	if(!AddSizes(total, ObjWriteChunkTriangles * 3 * (ObjMeshLayout::Stride() + 1) * sizeof(float), total)) {
+		return overflowed;
+	}
+	for(size_t i = 0; i < 6; i++) {
+		size_t bytes = 0;
+		if(!MultiplySizes(parts[i][0], parts[i][1], bytes) || !AddSizes(total, bytes, total)) {
+			return overflowed;
+		}
+	}
+	return total;
+}
+
+void ObjLoader::WriteMesh(const ObjMeshData& mesh, VertexBuffer* vb, size_t firstVertex, IndexBuffer* ib, size_t firstIndex) {
+	assert(vb->GetFormat() == ObjMeshFormat);
+	
+	VertexDestination destination;
+	destination.positions = vb;
+	destination.positionStride = ObjMeshLayout::Stride();
+	destination.firstPosition = firstVertex * ObjMeshLayout::Stride();
+	destination.attributes = vb;
+	destination.attributeStride = ObjMeshLayout::Stride();
+	destination.firstAttribute = firstVertex * ObjMeshLayout::Stride() + ObjMeshLayout::OffsetOf(SemanticTextureCoordinate);
+	
+	this->WriteMesh(mesh, destination, ib, firstIndex);
+}
+
+void ObjLoader::BuildRayQuery(const ObjMeshData& mesh, MeshRayQuery& query) {
+	const std::vector<ObjTriangle>& triangles = mesh.triangles;
+	unsigned int* indices = this->scratch.Allocate<unsigned int>(triangles.size() * 3);
+	for(size_t t = 0; t < triangles.size(); t++) {
+		for(size_t v = 0; v < 3; v++) {
+			indices[t * 3 + v] = triangles[t].GetVertexIndex(v) - 1;
+		}
+	}
+	query.Build(mesh.vertices.empty() ? NULL : &mesh.vertices[0].x, ObjVertexStride, indices, triangles.size());
+}
+
+void ObjLoader::CalculateInternalDepth(const ObjMeshData& mesh, const MeshRayQuery& query, TriangleMeshInternalDepth& depth) const {
+	if(this->depthMethod == InternalDepthExact) {
+		depth.Calculate(query, mesh.vertices);
+		return;
+	}
+	
+	depth.CalculateApproximate(query, mesh.triangles, mesh.vertices, this->depthResolution);
+	InternalDepthError error = depth.MeasureError(query, mesh.vertices, 256);
+	std::cout << "Approximate vertex depth is off by at most " << error.maximum << " (" << error.mean << " on average) over "
+			  << error.sampledVertices << " vertices, " << error.differentMisses << " misses differing, with a cell size of "
+			  << error.cellSize << std::endl;
+}
+
+MeshRayQuery* ObjLoader::CalculateInternalDepth(const ObjMeshData& mesh, TriangleMeshInternalDepth& depth) {
+	MeshRayQuery* query = new MeshRayQuery();
+	this->BuildRayQuery(mesh, *query);
+	this->CalculateInternalDepth(mesh, *query, depth);
+	if(!this->keepRayQueries) {
+		// Only picking needs it after this, and it's a copy of every triangle
+		delete query;
+		query = NULL;
+	}
+	return query;
+}
+
+void ObjLoader::WriteMesh(const ObjMeshData& mesh, ObjStreamedVertexBuffer* vb, IndexBuffer* ib) {
+	VertexDestination destination;
+	destination.positions = vb->GetPositions();
+	destination.positionStride = ObjMeshPositionLayout::Stride();
+	destination.firstPosition = 0;
+	destination.attributes = vb->GetAttributes();
+	destination.attributeStride = ObjMeshAttributeLayout::Stride();
+	destination.firstAttribute = ObjMeshAttributeLayout::OffsetOf(SemanticTextureCoordinate);
+	
+	this->WriteMesh(mesh, destination, ib, 0);
+}
+
+void ObjLoader::WriteMesh(const ObjMeshData& mesh, const VertexDestination& destination, IndexBuffer* ib, size_t firstIndex) {
+	// The texture coordinate and normal sit together, in that order, whether they're interleaved with
+	// the position or streamed separately.
+	static_assert(ObjMeshLayout::OffsetOf(SemanticNormal) - ObjMeshLayout::OffsetOf(SemanticTextureCoordinate)
+				  == ObjMeshAttributeLayout::OffsetOf(SemanticNormal) - ObjMeshAttributeLayout::OffsetOf(SemanticTextureCoordinate),
+				  "Interleaved and streamed attributes must be ordered the same");
+	
+	// The bulk writes below check that everything fits
+	
+	if(mesh.triangles.empty()) {
+		return;
+	}
+	
+	// Final preparation of the triangle corners, laid out like ObjMeshLayout, before they're written into the vertex buffer in bulk.
+	// They're staged a chunk at a time, so the scratch memory stays the same however big the mesh is.
+	size_t cornerCount = mesh.triangles.size() * 3;
+	size_t chunkTriangles = std::min(mesh.triangles.size(), ObjWriteChunkTriangles);
+	float* corners = this->scratch.Allocate<float>(chunkTriangles * 3 * ObjMeshLayout::Stride());
+	
+	// Load the triangles in
+	bool interleaved = (destination.positions == destination.attributes
+						&& destination.positionStride == ObjMeshLayout::Stride()
+						&& destination.attributeStride == ObjMeshLayout::Stride()
+						&& destination.firstAttribute == destination.firstPosition + ObjMeshLayout::OffsetOf(SemanticTextureCoordinate));
+	for(size_t firstTriangle = 0; firstTriangle < mesh.triangles.size(); firstTriangle += chunkTriangles) {
+		size_t triangleCount = std::min(chunkTriangles, mesh.triangles.size() - firstTriangle);
+		size_t firstCorner = firstTriangle * 3;
+		size_t chunkCorners = triangleCount * 3;
+		this->WriteCorners(mesh, NULL, firstTriangle, triangleCount, corners, ObjMeshLayout::Stride(),
+						   corners + ObjMeshLayout::OffsetOf(SemanticTextureCoordinate), ObjMeshLayout::Stride());
+		if(interleaved) {
+			// Our corners are already laid out exactly like the buffer
+			destination.positions->Write(destination.firstPosition + firstCorner * ObjMeshLayout::Stride(), corners,
+										 chunkCorners * ObjMeshLayout::Stride());
+		}
+		else {
+			destination.positions->WriteStrided(destination.firstPosition + firstCorner * destination.positionStride, destination.positionStride,
+												corners, ObjMeshLayout::Stride(), chunkCorners, 3);
+			destination.attributes->WriteStrided(destination.firstAttribute + firstCorner * destination.attributeStride, destination.attributeStride,
+												 corners + 3, ObjMeshLayout::Stride(), chunkCorners, 5);
+		}
+	}
+	
+	// Make the index buffer now. Every triangle got its own three vertices above, so the
+	// indices point at those (relative to the first vertex) rather than at the OBJ's vertex list.
+	if(ib != NULL) {
+		ib->WriteSequence(firstIndex, cornerCount, 0);
+	}
+}
+
+void ObjLoader::WriteCorners(const ObjMeshData& mesh, const TriangleMeshInternalDepth* depth, size_t firstTriangle, size_t triangleCount,
+							 float* positions, size_t positionStride, float* attributes, size_t attributeStride) const {
+	const std::vector<ObjVertex>& vertices = mesh.vertices;
+	const std::vector<ObjTextureCoordinate>& textureCoordinates = mesh.textureCoordinates;
+	const std::vector<ObjTriangle>& triangles = mesh.triangles;
+	
+	assert(IsRangeWithin(firstTriangle, triangleCount, triangles.size()));
+	for(size_t i = firstTriangle; i < firstTriangle + triangleCount; i++) {
+		for(unsigned int v = 0; v < 3; v++) {
+			const ObjVertex& vertex = vertices[triangles[i].GetVertexIndex(v) - 1];
 			
-			// Compute vertex depths (assuming that the vertices already have their normals calculated)
-			output.internalDepthInformation.Calculate(triangles, vertices);
+			// Vertex (3)
+			positions[0] = vertex.x;
+			positions[1] = vertex.y;
+			positions[2] = vertex.z;
 			
-			// Final preparation and then write the triangles into the vertex buffer.
-			for(unsigned int i = 0; i < triangles.size(); i++) {
-				for(unsigned int v = 0; v < 3; v++) {
-					TemporaryTriangle triangle;
-
-					// Vertex (3)
-					
-					triangle.x = vertices[triangles[i].GetVertexIndex(v) - 1].x;
-					triangle.y = vertices[triangles[i].GetVertexIndex(v) - 1].y;
-					triangle.z = vertices[triangles[i].GetVertexIndex(v) - 1].z;
-					
-					// Some quickie assertions to make sure we're sane.
-					assert(!(triangle.x != triangle.x)); // nan check
-					assert(!(triangle.y != triangle.y));
-					assert(!(triangle.z != triangle.z));
-					assert(triangle.x <= 1.0f);
-					assert(triangle.x >= -1.0f);
-					assert(triangle.y <= 1.0f);
-					assert(triangle.y >= -1.0f);
-					assert(triangle.z <= 1.0f);
-					assert(triangle.z >= -1.0f);
-					
-					// Texture (2)
-					triangle.u = textureCoordinates[triangles[i].GetTextureCoordinateIndex(v) - 1].u;
-					triangle.v = textureCoordinates[triangles[i].GetTextureCoordinateIndex(v) - 1].v;
-					
-					// Normal (3)
-					unsigned int normalIndex = triangles[i].GetNormalIndex(v) - 1;
-					assert(normalIndex < normals.size());
-
-					// We calculated the vertex normals already, so just use 'em
-					triangle.normalX = vertices[triangles[i].GetVertexIndex(v) - 1].normalX;
-					triangle.normalY = vertices[triangles[i].GetVertexIndex(v) - 1].normalY;
-					triangle.normalZ = vertices[triangles[i].GetVertexIndex(v) - 1].normalZ;
-
-					// Load the triangle in
-					vb->Set(i * 24 + (v * 8) + 0, triangle.x);
-					vb->Set(i * 24 + (v * 8) + 1, triangle.y);
-					vb->Set(i * 24 + (v * 8) + 2, triangle.z);
-
-					vb->Set(i * 24 + (v * 8) + 3, triangle.u);
-					vb->Set(i * 24 + (v * 8) + 4, triangle.v);
-					
-					vb->Set(i * 24 + (v * 8) + 5, triangle.normalX);
-					vb->Set(i * 24 + (v * 8) + 6, triangle.normalY);
-					vb->Set(i * 24 + (v * 8) + 7, triangle.normalZ);
-				}
-				
-				// Make the index buffer now
-				(*ib)[i * 3] = triangles[i].GetVertexIndex(0) - 1;
-				(*ib)[i * 3 + 1] = triangles[i].GetVertexIndex(1)- 1;
-				(*ib)[i * 3 + 2] = triangles[i].GetVertexIndex(2) - 1;
-			}
+			// Some quickie assertions to make sure we're sane.
+			assert(!(vertex.x != vertex.x)); // nan check
+			assert(!(vertex.y != vertex.y));
+			assert(!(vertex.z != vertex.z));
+			assert(vertex.x <= 1.0f);
+			assert(vertex.x >= -1.0f);
+			assert(vertex.y <= 1.0f);
+			assert(vertex.y >= -1.0f);
+			assert(vertex.z <= 1.0f);
+			assert(vertex.z >= -1.0f);
+			
+			// Texture (2), unless the depth takes the place of u
+			const ObjTextureCoordinate& textureCoordinate = textureCoordinates[triangles[i].GetTextureCoordinateIndex(v) - 1];
+			attributes[0] = (depth != NULL) ? depth->GetVertexInternalDistance(triangles[i].GetVertexIndex(v) - 1) : textureCoordinate.u;
+			attributes[1] = textureCoordinate.v;
+			
+			// Normal (3)
+			assert(triangles[i].GetNormalIndex(v) - 1 < mesh.normals.size());
 			
-			// Commit the buffers
-			vb->Commit();
-			ib->Commit();			
+			// We calculated the vertex normals already, so just use 'em
+			attributes[2] = vertex.normalX;
+			attributes[3] = vertex.normalY;
+			attributes[4] = vertex.normalZ;
 			
-			// Set the output properly.
-			output.vertices = vb;
-			output.indices = ib;
-			output.scale = scale;
+			positions += positionStride;
+			attributes += attributeStride;
+		}
+	}
+}
+
+bool ObjLoader::WriteMappedMesh(const ObjMeshData& mesh, const TriangleMeshInternalDepth& depth, const VertexDestination& destination,
+								IndexBuffer* ib, const std::vector<IndexType>* strips) const {
+	// Map everything first, so a buffer that won't map leaves the others to be written the usual way too
+	float* positions = destination.positions->MapForWriting();
+	float* attributes = positions;
+	if(positions != NULL && destination.attributes != destination.positions) {
+		attributes = destination.attributes->MapForWriting();
+	}
+	IndexType* indices = (positions != NULL && attributes != NULL) ? ib->MapForWriting() : NULL;
+	
+	if(indices != NULL) {
+		size_t cornerCount = mesh.triangles.size() * 3;
+		if(cornerCount > 0) {
+			this->WriteCorners(mesh, &depth, 0, mesh.triangles.size(), positions + destination.firstPosition, destination.positionStride,
+							   attributes + destination.firstAttribute, destination.attributeStride);
+		}
+		if(strips != NULL) {
+			if(!strips->empty()) {
+				memcpy(indices, &(*strips)[0], strips->size() * sizeof(IndexType));
+			}
+		}
+		else {
+			for(size_t i = 0; i < cornerCount; i++) {
+				indices[i] = (IndexType)i;
+			}
+		}
+	}
+	
+	// Unmap whatever did map, even if the rest didn't
+	bool written = (indices != NULL);
+	if(indices != NULL) {
+		written = ib->Unmap() && written;
+	}
+	if(attributes != NULL && destination.attributes != destination.positions) {
+		written = destination.attributes->Unmap() && written;
+	}
+	if(positions != NULL) {
+		written = destination.positions->Unmap() && written;
+	}
+	return written;
+}
+
+StripStatistics ObjLoader::StripifyMesh(const ObjMeshData& mesh, const Submesh& submesh, StripJoin join, std::vector<IndexType>& strips) {
+	const std::vector<ObjTriangle>& triangles = mesh.triangles;
+	
+	// Sort the corners by (vertex, texture coordinate), then by corner, so each run of equal keys starts with the
+	// first corner that used them
+	struct Corner {
+		unsigned long long key;
+		IndexType corner;
+		bool operator<(const Corner& other) const {
+			return (this->key != other.key) ? this->key < other.key : this->corner < other.corner;
+		}
+	};
+	size_t cornerCount = submesh.indexCount;
+	Corner* corners = this->scratch.Allocate<Corner>(cornerCount);
+	IndexType* welded = this->scratch.Allocate<IndexType>(cornerCount);
+	size_t firstTriangle = submesh.firstIndex / 3;
+	for(size_t i = 0; i < cornerCount / 3; i++) {
+		const ObjTriangle& triangle = triangles[firstTriangle + i];
+		for(unsigned int v = 0; v < 3; v++) {
+			Corner& corner = corners[i * 3 + v];
+			corner.key = ((unsigned long long)triangle.GetVertexIndex(v) << 32) | triangle.GetTextureCoordinateIndex(v);
+			corner.corner = (IndexType)((firstTriangle + i) * 3 + v);
+		}
+	}
+	std::sort(corners, corners + cornerCount);
+	for(size_t i = 0, first = 0; i < cornerCount; i++) {
+		if(corners[i].key != corners[first].key) {
+			first = i;
+		}
+		welded[corners[i].corner - submesh.firstIndex] = corners[first].corner;
+	}
+	assert(join != StripJoinRestart || submesh.lastVertex < PrimitiveRestartIndex); // The last corner would read as a restart
+	
+	return Stripify((cornerCount > 0) ? welded : NULL, cornerCount, join, strips);
+}
+
+MeshGeometry ObjLoader::LoadMesh(const std::string& path) {
+	// Create the geometry cache object
+	MeshGeometry output;
+	output.vertices = NULL;
+	output.indices = NULL;
+	output.rayQuery = NULL;
+	output.primitiveType = GL_TRIANGLES;
+	output.scale = 1.0f;
+	
+	ObjMeshData& mesh = this->scratchMesh;
+	this->scratch.Reset();
+	if(!this->ParseMesh(path, mesh) || !this->CheckMeshSize(mesh, path, true)) {
+		return output;
+	}
+	
+	// Build the vertex buffer.
+	size_t numberOfTriangles = mesh.triangles.size();
+	// Buffers about to be mapped are written whole there, so they skip making and zeroing shadow arrays
+	ShadowStart shadowStart = this->mappedUploads ? ShadowDeferred : ShadowZeroed;
+	VertexBuffer* vb = new VertexBuffer(numberOfTriangles * 3 * ObjMeshLayout::Stride(), ObjMeshFormat, this->shadowPolicy, shadowStart);
+	IndexBuffer* ib = NULL;
+	
+	// Now that all the vertices are set up, calculate the vertex depths before we
+	// write the whole thing into a vertex buffer
+	
+	// Compute vertex depths (assuming that the vertices already have their normals calculated)
+	output.rayQuery = this->CalculateInternalDepth(mesh, output.internalDepthInformation);
+	
+	// The indices when they're strips. A triangle list's are just the corners in order.
+	std::vector<IndexType> strips;
+	if(this->triangleStrips) {
+		bool restart = IndexBuffer::IsPrimitiveRestartSupported();
+		// Strip each submesh on its own, so it keeps its own run of indices
+		StripStatistics statistics;
+		output.submeshes = mesh.submeshes;
+		for(size_t i = 0; i < output.submeshes.size(); i++) {
+			Submesh& submesh = output.submeshes[i];
+			std::vector<IndexType> submeshStrips;
+			StripStatistics submeshStatistics = this->StripifyMesh(mesh, submesh, restart ? StripJoinRestart : StripJoinDegenerate, submeshStrips);
+			submesh.firstIndex = strips.size();
+			submesh.indexCount = submeshStrips.size();
+			strips.insert(strips.end(), submeshStrips.begin(), submeshStrips.end());
 			
-			// Encode the depth information into the vertex buffer, overwriting texture coordinates!
-			output.internalDepthInformation.WriteDepthAsTextureCoordinates(output.vertices, triangles);
+			statistics.triangleCount += submeshStatistics.triangleCount;
+			statistics.degenerateTriangles += submeshStatistics.degenerateTriangles;
+			statistics.stripCount += submeshStatistics.stripCount;
+			statistics.listIndexCount += submeshStatistics.listIndexCount;
+			statistics.stripIndexCount += submeshStatistics.stripIndexCount;
+		}
+		std::cout << "Stripified " << statistics.triangleCount << " triangles into " << statistics.stripCount << " strips, "
+				  << statistics.listIndexCount << " -> " << statistics.stripIndexCount << " indices ("
+				  << (int)(statistics.GetIndexRatio() * 100.0f + 0.5f) << "%)" << std::endl;
+		
+		ib = new IndexBuffer(strips.size(), this->shadowPolicy, shadowStart);
+		ib->SetPrimitiveRestart(restart);
+		output.primitiveType = GL_TRIANGLE_STRIP;
+	}
+	else {
+		ib = new IndexBuffer(numberOfTriangles * 3, this->shadowPolicy, shadowStart);
+		output.submeshes = mesh.submeshes;
+	}
+	
+	// Count the buffers under the file they came from
+	MemoryTag* memoryTag = MemoryAccounting::GetTag(path);
+	vb->SetMemoryTag(memoryTag);
+	ib->SetMemoryTag(memoryTag);
+	
+	// Set the output properly.
+	output.vertices = vb;
+	output.indices = ib;
+	output.scale = mesh.scale;
+	output.bounds = mesh.bounds;
+	output.boundingSphere = mesh.boundingSphere;
+	output.materials = mesh.materials;
+	output.groups = mesh.groups;
+	
+	if(this->mappedUploads) {
+		VertexDestination destination;
+		destination.positions = vb;
+		destination.positionStride = ObjMeshLayout::Stride();
+		destination.firstPosition = 0;
+		destination.attributes = vb;
+		destination.attributeStride = ObjMeshLayout::Stride();
+		destination.firstAttribute = ObjMeshLayout::OffsetOf(SemanticTextureCoordinate);
+		if(this->WriteMappedMesh(mesh, output.internalDepthInformation, destination, ib, this->triangleStrips ? &strips : NULL)) {
+			return output;
+		}
+	}
+	
+	if(this->triangleStrips) {
+		this->WriteMesh(mesh, vb, 0, NULL, 0);
+		ib->SetData(strips);
+	}
+	else {
+		this->WriteMesh(mesh, vb, 0, ib, 0);
+	}
+	
+	// Commit the indices. The vertices get committed once the depth is written into them below.
+	ib->Commit();
+	
+	// Encode the depth information into the vertex buffer, overwriting texture coordinates!
+	output.internalDepthInformation.WriteDepthAsTextureCoordinates(output.vertices, mesh.triangles);
+	
+	return output;
+}
+
+StreamedMeshGeometry ObjLoader::LoadStreamedMesh(const std::string& path) {
+	StreamedMeshGeometry output;
+	output.vertices = NULL;
+	output.indices = NULL;
+	output.rayQuery = NULL;
+	output.scale = 1.0f;
+	
+	ObjMeshData& mesh = this->scratchMesh;
+	this->scratch.Reset();
+	if(!this->ParseMesh(path, mesh) || !this->CheckMeshSize(mesh, path, true)) {
+		return output;
+	}
+	
+	size_t numberOfTriangles = mesh.triangles.size();
+	ShadowStart shadowStart = this->mappedUploads ? ShadowDeferred : ShadowZeroed;
+	ObjStreamedVertexBuffer* vb = new ObjStreamedVertexBuffer(numberOfTriangles * 3, this->shadowPolicy, shadowStart);
+	IndexBuffer* ib = new IndexBuffer(numberOfTriangles * 3, this->shadowPolicy, shadowStart);
+	
+	output.rayQuery = this->CalculateInternalDepth(mesh, output.internalDepthInformation);
+	
+	MemoryTag* memoryTag = MemoryAccounting::GetTag(path);
+	vb->SetMemoryTag(memoryTag);
+	ib->SetMemoryTag(memoryTag);
+	
+	output.vertices = vb;
+	output.indices = ib;
+	output.scale = mesh.scale;
+	output.bounds = mesh.bounds;
+	output.boundingSphere = mesh.boundingSphere;
+	output.materials = mesh.materials;
+	output.groups = mesh.groups;
+	output.submeshes = mesh.submeshes;
+	
+	if(this->mappedUploads) {
+		VertexDestination destination;
+		destination.positions = vb->GetPositions();
+		destination.positionStride = ObjMeshPositionLayout::Stride();
+		destination.firstPosition = 0;
+		destination.attributes = vb->GetAttributes();
+		destination.attributeStride = ObjMeshAttributeLayout::Stride();
+		destination.firstAttribute = ObjMeshAttributeLayout::OffsetOf(SemanticTextureCoordinate);
+		if(this->WriteMappedMesh(mesh, output.internalDepthInformation, destination, ib, NULL)) {
+			return output;
 		}
 	}
 	
+	this->WriteMesh(mesh, vb, ib);
+	
+	// The depth only lands in the attribute stream, so the positions can go up now.
+	vb->GetPositions()->Commit();
+	ib->Commit();
+	
+	output.internalDepthInformation.WriteDepthAsTextureCoordinates(output.vertices, mesh.triangles);
+	
+	return output;
+}
+
+PooledMeshGeometry ObjLoader::LoadMesh(const std::string& path, GeometryPool& pool) {
+	PooledMeshGeometry output;
+	output.rayQuery = NULL;
+	output.scale = 1.0f;
+	
+	ObjMeshData& mesh = this->scratchMesh;
+	this->scratch.Reset();
+	if(!this->ParseMesh(path, mesh) || !this->CheckMeshSize(mesh, path, false)) {
+		return output;
+	}
+	
+	// CheckMeshSize kept the corners within what an index can address, which the pool's counts can hold
+	size_t cornerCount = mesh.triangles.size() * 3;
+	GeometryHandle handle = pool.Allocate((unsigned int)cornerCount, (unsigned int)cornerCount);
+	if(!handle.IsValid()) {
+		std::cerr << "Geometry pool is out of room for \"" + path + "\"" << std::endl;
+		return output;
+	}
+	const GeometryRange& range = pool.GetRange(handle);
+	
+	output.rayQuery = this->CalculateInternalDepth(mesh, output.internalDepthInformation);
+	
+	this->WriteMesh(mesh, pool.GetVertices(), range.firstVertex, pool.GetIndices(), range.firstIndex);
+	
+	// Uploads the mesh's indices too
+	output.internalDepthInformation.WriteDepthAsTextureCoordinates(pool, handle, mesh.triangles);
+	
+	output.mesh = handle;
+	output.scale = mesh.scale;
+	output.bounds = mesh.bounds;
+	output.boundingSphere = mesh.boundingSphere;
 	return output;
 }
 
@@ -3,12 +3,32 @@
 
 #include "VertexBuffer.h"
 #include "IndexBuffer.h"
+#include "GeometryPool.h"
+#include "StreamedVertexBuffer.h"
+#include "Stripifier.h"
+#include "Bounds.h"
+#include "MeshRayQuery.h"
+#include "DistanceField.h"
+#include "ScratchArena.h"
+#include "InputSource.h"
 #include <string>
 #include "Vector.h"
 //#include <Vector>
 
 //--------------------------------------------------------------------------
 
+/// Triangles the loader stages in scratch memory at once while writing a mesh into its buffers
+const size_t ObjWriteChunkTriangles = 16384;
+
+/// The vertex format LoadMesh writes into its vertex buffers
+const VertexFormat ObjMeshFormat = Vertex3Texture2Normal3;
+/// The layout behind ObjMeshFormat
+typedef VertexFormatLayout<ObjMeshFormat>::Type ObjMeshLayout;
+/// ObjMeshLayout split into a position stream and an attribute stream, for LoadStreamedMesh
+typedef VertexLayout<Position3> ObjMeshPositionLayout;
+typedef VertexLayout<TextureCoordinate2, Normal3> ObjMeshAttributeLayout;
+typedef StreamedVertexBuffer<ObjMeshPositionLayout, ObjMeshAttributeLayout> ObjStreamedVertexBuffer;
+
 /// A 3D vertex in the OBJ file format
 class ObjVertex { 
 public:
@@ -23,6 +43,10 @@ public:
 	float normalZ;
 };
 
+/// Floats from one ObjVertex position to the next, for the batch transform kernels
+const size_t ObjVertexStride = sizeof(ObjVertex) / sizeof(float);
+static_assert(sizeof(ObjVertex) == 6 * sizeof(float), "ObjVertex must be six packed floats");
+
 /// A 3D normal in the OBJ file format
 class ObjNormal { 
 public:
@@ -47,6 +71,7 @@ public:
 		for(int i = 0; i < 3; i++) {
 			vertexIndices[i] = normalIndices[i] = textureCoordinateIndices[i] = 0;
 		}
+		this->material = this->group = 0;
 		this->isFaceNormalComputedYet = false;
 	}
 	
@@ -89,6 +114,24 @@ public:
 		textureCoordinateIndices[vertex] = index;
 	}
 	
+	/// The zero-indexed material the triangle is drawn with, from the last usemtl before it
+	unsigned int GetMaterialIndex() const {
+		return material;
+	}
+	
+	void SetMaterialIndex(unsigned int index) {
+		material = index;
+	}
+	
+	/// The zero-indexed group or object the triangle belongs to, from the last g or o before it
+	unsigned int GetGroupIndex() const {
+		return group;
+	}
+	
+	void SetGroupIndex(unsigned int index) {
+		group = index;
+	}
+	
 	Vector3 GetFaceNormal(const std::vector<ObjVertex>& vertices) {
 		if(this->isFaceNormalComputedYet) {
 			// Pull it out of the cache
@@ -118,41 +161,425 @@ private:
 	unsigned int vertexIndices[3];
 	unsigned int normalIndices[3];
 	unsigned int textureCoordinateIndices[3];
+	unsigned int material;
+	unsigned int group;
 	bool isFaceNormalComputedYet;
 	Vector3 faceNormal;
 };
 
+/// A material from an MTL library
+class ObjMaterial {
+public:
+	ObjMaterial() {
+		ambient = Vector3(0.2f, 0.2f, 0.2f);
+		diffuse = Vector3(0.8f, 0.8f, 0.8f);
+		specular = emissive = Vector3(0.0f, 0.0f, 0.0f);
+		shininess = 0.0f;
+		opacity = 1.0f;
+		illumination = 1;
+	}
+public:
+	std::string name;
+	
+	Vector3 ambient;	// Ka
+	Vector3 diffuse;	// Kd
+	Vector3 specular;	// Ks
+	Vector3 emissive;	// Ke
+	float shininess;	// Ns
+	float opacity;		// d, or 1 - Tr
+	int illumination;	// illum
+	
+	/// Texture files, relative to the OBJ file's directory. Empty if the material has none.
+	std::string ambientMap;
+	std::string diffuseMap;
+	std::string specularMap;
+	std::string bumpMap;
+	std::string opacityMap;
+};
+
+/// A run of a mesh's indices that all use one material and belong to one group, so they draw with one DrawRange.
+struct Submesh {
+	/// Index into the mesh's materials
+	unsigned int material;
+	/// Index into the mesh's groups, the g or o record the triangles came under
+	unsigned int group;
+	/// The first index of the run, and how many there are
+	size_t firstIndex;
+	size_t indexCount;
+	/// The lowest and highest vertex the run uses, for IndexBuffer::DrawRange
+	size_t firstVertex;
+	size_t lastVertex;
+	/// The bounds of the run's triangles, in the same space as the mesh's
+	BoundingBox bounds;
+	BoundingSphere boundingSphere;
+};
+
 //--------------------------------------------------------------------------
 
+/// How the internal depth of each vertex is found
+enum InternalDepthMethod {
+	/// Cast a ray through the mesh from every vertex
+	InternalDepthExact = 0,
+	/// March through a signed distance field of the mesh from every vertex. Only for closed meshes.
+	InternalDepthApproximate
+};
+
+/// How far approximate depths are from exact ones, over a sample of vertices
+struct InternalDepthError {
+	InternalDepthError() {
+		sampledVertices = differentMisses = 0;
+		maximum = mean = cellSize = 0.0f;
+	}
+	size_t sampledVertices;
+	/// The largest and average difference where both found the other side
+	float maximum;
+	float mean;
+	/// Vertices where only one of them found the other side
+	size_t differentMisses;
+	/// The distance field's grid spacing, which the errors should be around
+	float cellSize;
+};
+
 class TriangleMeshInternalDepth {
+public:
+	TriangleMeshInternalDepth() {
+		this->cellSize = 0.0f;
+	}
 public:
 	/// Compute the internal depth storage from the vertices
 	void Calculate(std::vector<ObjTriangle>& triangles, std::vector<ObjVertex>& vertices);
-	/// Write the calculated depth to a vertex buffer of triangles
-	void WriteDepthAsTextureCoordinates(VertexBuffer* vertices, const std::vector<ObjTriangle>& triangles) const;
+	/// Compute the internal depth storage from the vertices, tracing against a query already built over their triangles.
+	void Calculate(const MeshRayQuery& triangles, const std::vector<ObjVertex>& vertices);
+	/// Build a ray query over triangles whose vertex indices start from 1, for Calculate and Refresh
+	static void BuildRayQuery(const std::vector<ObjTriangle>& triangles, const std::vector<ObjVertex>& vertices, MeshRayQuery& query);
+	/**
+	 \brief Write the calculated depth to a vertex buffer of triangles, then commit it.
+	 \param vertices		The vertex buffer the triangles were written to.
+	 \param triangles	The triangles, in the order they were written.
+	 \param firstVertex	The vertex the first triangle was written at.
+	 */
+	void WriteDepthAsTextureCoordinates(VertexBuffer* vertices, const std::vector<ObjTriangle>& triangles, size_t firstVertex = 0) const;
+	/// Write the calculated depth to the attribute stream of a streamed vertex buffer of triangles, then commit it.
+	void WriteDepthAsTextureCoordinates(ObjStreamedVertexBuffer* vertices, const std::vector<ObjTriangle>& triangles) const;
+	/// Write the calculated depth to a mesh of triangles in a geometry pool, then upload just that mesh.
+	void WriteDepthAsTextureCoordinates(GeometryPool& pool, GeometryHandle mesh, const std::vector<ObjTriangle>& triangles) const;
+	/**
+	 \brief Compute approximate depths, much faster, by marching along each inverted normal through a signed
+	 distance field of the mesh. The mesh has to be closed for the field to know its inside from its outside.
+	 \param query		A query over the triangles, used to build the field.
+	 \param triangles	The triangles.
+	 \param vertices		The vertices.
+	 \param resolution	Field grid points along the longest side of the mesh.
+	 */
+	void CalculateApproximate(const MeshRayQuery& query, const std::vector<ObjTriangle>& triangles, const std::vector<ObjVertex>& vertices,
+							  size_t resolution = DefaultDistanceFieldResolution);
+	/// Whether the depths came from CalculateApproximate
+	bool IsApproximate() const {
+		return this->cellSize > 0.0f;
+	}
+	/**
+	 \brief Compare the depths of up to sampleCount vertices, spread through the mesh, with exact ones.
+	 \param query		The query over the triangles.
+	 \param vertices		The vertices the depths were calculated for.
+	 \param sampleCount	How many vertices to check; more is slower and surer.
+	 */
+	InternalDepthError MeasureError(const MeshRayQuery& query, const std::vector<ObjVertex>& vertices, size_t sampleCount) const;
+	/**
+	 \brief Bring the depths up to date after some vertices moved or bent, recomputing only the ones that could have
+	 changed. Gives the same depths as calculating them all again. Only for exact depths.
+	 \param query		A query over the triangles, from BuildRayQuery, kept from one refresh to the next. Refit here to the vertices' new positions.
+	 \param triangles	The triangles the query was built over.
+	 \param vertices		All the vertices, with their new positions and normals.
+	 \param moved		The zero-indexed vertices whose position or normal changed.
+	 \param changed		Receives the vertices whose depth changed, in order, for the WriteDepthAsTextureCoordinates overloads that take them.
+	 */
+	void Refresh(MeshRayQuery& query, const std::vector<ObjTriangle>& triangles, const std::vector<ObjVertex>& vertices,
+				 const std::vector<unsigned int>& moved, std::vector<unsigned int>& changed);
+	/**
+	 \brief Write only the depths that changed to a vertex buffer of triangles, and upload only the vertices around them.
+	 A buffer whose shadow array was released is changed in place on the GPU, without being read back.
+	 \param vertices		The vertex buffer the triangles were written to.
+	 \param triangles	The triangles, in the order they were written.
+	 \param changed		The vertices whose depth changed, from Refresh.
+	 \param firstVertex	The vertex the first triangle was written at.
+	 */
+	void WriteDepthAsTextureCoordinates(VertexBuffer* vertices, const std::vector<ObjTriangle>& triangles,
+										const std::vector<unsigned int>& changed, size_t firstVertex = 0) const;
+	/// Write only the depths that changed to the attribute stream of a streamed vertex buffer of triangles, and upload only the vertices around them.
+	void WriteDepthAsTextureCoordinates(ObjStreamedVertexBuffer* vertices, const std::vector<ObjTriangle>& triangles,
+										const std::vector<unsigned int>& changed) const;
 	/**
 	 \brief Retrieve the internal distance of a given vertex.
 	 \param triangleIndex	A zero-indexed triangle index.
 	 \return					The distance, in scaled units.
 	 */
 	float GetVertexInternalDistance(size_t vertexIndex) const;
+private:
+	void WriteDepth(VertexBufferStorage* vertices, unsigned int vertexSize, unsigned int texCoordUOffset,
+					const std::vector<ObjTriangle>& triangles, size_t firstVertex) const;
+	void WriteChangedDepth(VertexBufferStorage* vertices, unsigned int vertexSize, unsigned int texCoordUOffset,
+						   const std::vector<ObjTriangle>& triangles, const std::vector<unsigned int>& changed, size_t firstVertex) const;
 private:
 	std::vector<float> distances;
+	/// The triangle each vertex's depth ray stopped at, or RayMissed
+	std::vector<unsigned int> hitTriangles;
+	/// The distance field's grid spacing for approximate depths, or 0 for exact ones
+	float cellSize;
 };
 
+/**
+	\brief A mesh loaded into buffers of its own. Its triangles are grouped by material and then by OBJ group,
+	so a whole multi-material asset draws with one BeginDraw and one IndexBuffer::DrawRange per submesh,
+	and single groups can be drawn or hidden by their submeshes.
+*/
 struct MeshGeometry {
 	VertexBuffer* vertices;
 	IndexBuffer* indices;
+	/// What to draw the indices as: GL_TRIANGLES, or GL_TRIANGLE_STRIP if the loader made strips
+	GLenum primitiveType;
 	float scale;
+	/// The bounds of the mesh as it sits in the vertex buffer, i.e. after centring and scaling
+	BoundingBox bounds;
+	BoundingSphere boundingSphere;
+	/// The triangles, for picking, if ObjLoader::SetKeepRayQueries asked for them; NULL otherwise. Delete it with the buffers.
+	/// Triangle i is vertices 3i to 3i + 2 of the vertex buffer.
+	MeshRayQuery* rayQuery;
 	TriangleMeshInternalDepth internalDepthInformation;
+	/// The materials from the OBJ file's MTL libraries, plus any it used without defining
+	std::vector<ObjMaterial> materials;
+	/// The names of the OBJ file's g and o records. Triangles before any belong to the first, unnamed one.
+	std::vector<std::string> groups;
+	/// The index ranges of each material and group, in material order and then group order
+	std::vector<Submesh> submeshes;
 };
 
-/// A mesh loader for the Alias/Wavefront OBJ file format.
+/// A mesh whose positions are streamed separately from its other attributes.
+struct StreamedMeshGeometry {
+	ObjStreamedVertexBuffer* vertices;
+	IndexBuffer* indices;
+	float scale;
+	/// The bounds of the mesh as it sits in the vertex buffer, i.e. after centring and scaling
+	BoundingBox bounds;
+	BoundingSphere boundingSphere;
+	/// The triangles, for picking, if ObjLoader::SetKeepRayQueries asked for them; NULL otherwise. Delete it with the buffers.
+	/// Triangle i is vertices 3i to 3i + 2 of the vertex buffer.
+	MeshRayQuery* rayQuery;
+	TriangleMeshInternalDepth internalDepthInformation;
+	/// The materials from the OBJ file's MTL libraries, plus any it used without defining
+	std::vector<ObjMaterial> materials;
+	/// The names of the OBJ file's g and o records. Triangles before any belong to the first, unnamed one.
+	std::vector<std::string> groups;
+	/// The index ranges of each material and group, in material order and then group order
+	std::vector<Submesh> submeshes;
+};
+
+/// A mesh loaded into a GeometryPool rather than into buffers of its own.
+struct PooledMeshGeometry {
+	/// Invalid if the load failed
+	GeometryHandle mesh;
+	float scale;
+	/// The bounds of the mesh as it sits in the vertex buffer, i.e. after centring and scaling
+	BoundingBox bounds;
+	BoundingSphere boundingSphere;
+	/// The triangles, for picking, if ObjLoader::SetKeepRayQueries asked for them; NULL otherwise. Delete it when the mesh is freed.
+	/// Triangle i is vertices 3i to 3i + 2 of the mesh's range in the pool.
+	MeshRayQuery* rayQuery;
+	TriangleMeshInternalDepth internalDepthInformation;
+};
+
+/// Everything pulled out of an OBJ file, centred, scaled and with normals, before it goes into buffers.
+struct ObjMeshData {
+	std::vector<ObjVertex> vertices;
+	std::vector<ObjNormal> normals;
+	std::vector<ObjTextureCoordinate> textureCoordinates;
+	std::vector<ObjTriangle> triangles;
+	/// Everything named by usemtl or defined in an mtllib. Triangles before any usemtl get the first, unnamed one.
+	std::vector<ObjMaterial> materials;
+	/// The names of the g and o records. Triangles before any get the first, unnamed one.
+	std::vector<std::string> groups;
+	/// The triangles of each material and group, as ranges of a triangle list of three vertices per triangle
+	std::vector<Submesh> submeshes;
+	float scale;
+	BoundingBox bounds;
+	BoundingSphere boundingSphere;
+};
+
+/**
+	\brief A mesh loader for the Alias/Wavefront OBJ file format.
+	The loader keeps its parsing arrays and a scratch arena from one load to the next, so loading many
+	files settles into reusing the same memory instead of going back to the heap. That makes a loader
+	unsafe to share between threads; give each loading thread its own.
+*/
 class ObjLoader {
 public:
+	ObjLoader() {
+		this->shadowPolicy = ShadowRetained;
+		this->triangleStrips = false;
+		this->mappedUploads = false;
+		this->keepRayQueries = false;
+		this->depthMethod = InternalDepthExact;
+		this->depthResolution = DefaultDistanceFieldResolution;
+		this->loadLimit = 0;
+	}
 	virtual ~ObjLoader() { }
 public:
-	virtual MeshGeometry LoadMesh(const std::string& path) const;
+	virtual MeshGeometry LoadMesh(const std::string& path);
+	/**
+	 \brief Load a mesh into space allocated from a shared pool.
+	 \param path	The OBJ file.
+	 \param pool	A pool of ObjMeshFormat vertices with room for three vertices and indices per triangle.
+	 Only the new mesh is uploaded, and the pool's shadow arrays are kept; Commit the pool after a run of loads
+	 if it releases its shadows.
+	 */
+	virtual PooledMeshGeometry LoadMesh(const std::string& path, GeometryPool& pool);
+	/**
+	 \brief Load a mesh with its positions in a stream of their own, so depth and shadow passes can
+	 draw with PositionStreamOnly.
+	 */
+	virtual StreamedMeshGeometry LoadStreamedMesh(const std::string& path);
+	/// Choose whether loaded meshes keep their CPU shadow arrays after they are uploaded.
+	void SetShadowPolicy(ShadowPolicy shadowPolicy) {
+		this->shadowPolicy = shadowPolicy;
+	}
+	/**
+	 \brief Choose whether LoadMesh and LoadStreamedMesh write their buffers straight into mapped GL storage,
+	 rather than into the shadow arrays and then uploading them. Each vertex is then written once, with its depth
+	 already in it, and never copied, and the buffers are made without shadow arrays. With ShadowRetained the shadow
+	 arrays are kept, so those are written once instead and go up from there. Falls back to the usual way if GL
+	 can't map a buffer. Pooled loads always go through the pool's shadow arrays, since the pool is shared.
+	 */
+	void SetMappedUploads(bool mappedUploads) {
+		this->mappedUploads = mappedUploads;
+	}
+	/**
+	 \brief Choose whether loads hand back the ray query the depth pass built, for picking. It holds a copy of every
+	 triangle and its hierarchy, so by default it's freed as soon as the depths are done.
+	 */
+	void SetKeepRayQueries(bool keepRayQueries) {
+		this->keepRayQueries = keepRayQueries;
+	}
+	/**
+	 \brief Choose whether LoadMesh indexes its meshes as triangle strips instead of a triangle list.
+	 Strips are joined with primitive restart where the GPU has it and degenerate triangles where it doesn't.
+	 Check MeshGeometry::primitiveType to see which was used.
+	 */
+	void SetTriangleStrips(bool triangleStrips) {
+		this->triangleStrips = triangleStrips;
+	}
+	/**
+	 \brief Choose how the internal depth of loaded meshes is found. Approximate depths print how far off they are.
+	 \param method		Exact or approximate.
+	 \param resolution	For approximate depths, the distance field grid points along the longest side of the mesh.
+	 */
+	void SetInternalDepthMethod(InternalDepthMethod method, size_t resolution = DefaultDistanceFieldResolution) {
+		this->depthMethod = method;
+		this->depthResolution = resolution;
+	}
+	/**
+	 \brief Refuse loads whose big arrays would need more main memory than this: the parsed file, the ray query,
+	 the depths, the scratch memory and the new buffers' shadow arrays. A file stops being read as soon as it
+	 outgrows the limit, and a mesh that would take the load over it fails before its buffers are made, instead of
+	 running the machine out of memory. This only turns loads away; one that fits still holds all of those arrays
+	 at once, since meshes aren't streamed through the loader. 0, the default, means no limit.
+	 */
+	void SetLoadLimit(size_t bytes) {
+		this->loadLimit = bytes;
+	}
+	size_t GetLoadLimit() const {
+		return this->loadLimit;
+	}
+	/// How much scratch memory loads have used, and how often it had to grow
+	ScratchStatistics GetScratchStatistics() const {
+		return this->scratch.GetStatistics();
+	}
+	/// Give the memory kept between loads back to the heap, e.g. after loading a level
+	void ReleaseScratch() {
+		this->scratch.Release();
+		this->scratchMesh = ObjMeshData();
+	}
+protected:
+	/**
+	 \brief Read, centre and scale an OBJ file and compute its normals. Returns false if it couldn't be read.
+	 The triangles come out grouped by material, in the order the materials were first defined or used,
+	 and by group within each material, in the order the groups appear.
+	 */
+	bool ParseMesh(const std::string& path, ObjMeshData& mesh) const;
+	/**
+	 \brief Open a file the loader reads, OBJ or MTL. Override to read from somewhere other than the file system,
+	 such as an archive. The default opens files with OpenInputSource, decompressing .gz and .zst files.
+	 \return	A source the loader deletes when it's done, or NULL if the file can't be opened.
+	 */
+	virtual InputSource* OpenInput(const std::string& path) const;
+	/**
+	 \brief Check that a parsed mesh fits in buffers and within the load limit, saying why on std::cerr if it doesn't.
+	 \param newBuffers	Whether the load makes buffers of its own, rather than writing into a pool's.
+	 */
+	bool CheckMeshSize(const ObjMeshData& mesh, const std::string& path, bool newBuffers) const;
+	/**
+	 \brief The main memory a load of a parsed mesh needs, counting its big arrays as if they were all held at once,
+	 so it errs high. The largest size_t if it doesn't fit in one.
+	 */
+	size_t EstimateLoadBytes(const ObjMeshData& mesh, bool newBuffers) const;
+	/// Read the materials from an MTL file, adding them to materials. Returns false if it couldn't be read.
+	bool ParseMaterials(const std::string& path, std::vector<ObjMaterial>& materials) const;
+	/// Write a parsed mesh's triangles (three vertices each) and indices into buffers at the given offsets. ib may be NULL.
+	void WriteMesh(const ObjMeshData& mesh, VertexBuffer* vb, size_t firstVertex, IndexBuffer* ib, size_t firstIndex);
+	/// Write a parsed mesh's triangles and indices into a streamed vertex buffer.
+	void WriteMesh(const ObjMeshData& mesh, ObjStreamedVertexBuffer* vb, IndexBuffer* ib);
+	/// Build a ray query over a parsed mesh's triangles
+	void BuildRayQuery(const ObjMeshData& mesh, MeshRayQuery& query);
+	/// Calculate a parsed mesh's internal depth the way SetInternalDepthMethod chose
+	void CalculateInternalDepth(const ObjMeshData& mesh, const MeshRayQuery& query, TriangleMeshInternalDepth& depth) const;
+	/// Build the ray query and calculate the depth with it. Returns the query if SetKeepRayQueries asked for it, or NULL.
+	MeshRayQuery* CalculateInternalDepth(const ObjMeshData& mesh, TriangleMeshInternalDepth& depth);
+	/**
+	 \brief Index the vertices WriteMesh writes for one submesh as triangle strips.
+	 Corners with the same position and texture coordinate end up identical in the buffer, so they are welded
+	 to the first of them in the submesh before stripping. The other copies are left in the buffer, unused.
+	 */
+	StripStatistics StripifyMesh(const ObjMeshData& mesh, const Submesh& submesh, StripJoin join, std::vector<IndexType>& strips);
+private:
+	/// Where WriteMesh puts each vertex. The position and the other attributes may share a buffer.
+	struct VertexDestination {
+		VertexBufferStorage* positions;
+		/// Components between one position and the next
+		unsigned int positionStride;
+		/// The component the first position goes at
+		size_t firstPosition;
+		/// Texture coordinate then normal
+		VertexBufferStorage* attributes;
+		unsigned int attributeStride;
+		size_t firstAttribute;
+	};
+	void WriteMesh(const ObjMeshData& mesh, const VertexDestination& destination, IndexBuffer* ib, size_t firstIndex);
+	/**
+	 \brief Write the corners of a run of a mesh's triangles, three vertices per triangle: the position, then the texture
+	 coordinate and normal. If depth isn't NULL, it goes in place of each texture coordinate's u.
+	 */
+	void WriteCorners(const ObjMeshData& mesh, const TriangleMeshInternalDepth* depth, size_t firstTriangle, size_t triangleCount,
+					  float* positions, size_t positionStride, float* attributes, size_t attributeStride) const;
+	/**
+	 \brief Write a mesh, its depth and its indices straight into mapped storage of whole buffers; see SetMappedUploads.
+	 \param strips	The indices, or NULL for a triangle list of the corners in order.
+	 \return			False if any buffer couldn't be mapped or lost its contents. They then have blank shadow arrays.
+	 */
+	bool WriteMappedMesh(const ObjMeshData& mesh, const TriangleMeshInternalDepth& depth, const VertexDestination& destination,
+						 IndexBuffer* ib, const std::vector<IndexType>* strips) const;
+private:
+	ShadowPolicy shadowPolicy;
+	bool triangleStrips;
+	/// See SetMappedUploads
+	bool mappedUploads;
+	/// See SetKeepRayQueries
+	bool keepRayQueries;
+	InternalDepthMethod depthMethod;
+	size_t depthResolution;
+	/// See SetLoadLimit. 0 for no limit.
+	size_t loadLimit;
+	/// Temporary arrays for a single load. Reset at the start of each load.
+	ScratchArena scratch;
+	/// The mesh each load parses into, kept so its arrays keep their capacity
+	ObjMeshData scratchMesh;
 };
 
 #endif
@@ -0,0 +1,40 @@
+#ifndef _591_PARALLEL_H_
+#define _591_PARALLEL_H_
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+/**
+	\brief Run function(begin, end) over [0, count), split into one run per hardware thread.
+	Small jobs, or machines with one thread, run on the calling thread only.
+	\param count			The number of elements.
+	\param parallelCount	Jobs with fewer elements than this aren't worth starting threads for.
+	\param blockSize		Every run but the last starts on a multiple of this, e.g. a SIMD width.
+	\param function			Called with each run's [begin, end). Runs at once on several threads.
+*/
+template<class Function>
+void ParallelFor(size_t count, size_t parallelCount, size_t blockSize, const Function& function) {
+	unsigned int threads = std::thread::hardware_concurrency();
+	if(count < parallelCount || threads < 2) {
+		function((size_t)0, count);
+		return;
+	}
+
+	size_t chunk = (count + threads - 1) / threads;
+	chunk = ((chunk + blockSize - 1) / blockSize) * blockSize;
+	std::vector<std::thread> workers;
+	for(size_t begin = chunk; begin < count; begin += chunk) {
+		size_t end = std::min(count, begin + chunk);
+		workers.push_back(std::thread([&function, begin, end]() {
+			function(begin, end);
+		}));
+	}
+	function((size_t)0, std::min(count, chunk));
+	for(size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+#endif
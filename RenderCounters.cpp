@@ -0,0 +1,75 @@
+#include "RenderCounters.h"
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+namespace {
+
+/// The finished frames, in a ring
+struct RenderCounterHistory {
+	RenderCounterHistory() : frames(DefaultRenderCounterHistory) {
+		next = count = 0;
+	}
+	std::vector<RenderFrameCounters> frames;
+	/// Where the next finished frame goes
+	size_t next;
+	/// How many of frames are filled in
+	size_t count;
+};
+
+RenderCounterHistory& History() {
+	static RenderCounterHistory history;
+	return history;
+}
+
+}
+
+//--------------------------------------------------------------------------
+
+RenderFrameCounters RenderCounters::current;
+
+void RenderCounters::EndFrame() {
+	RenderCounterHistory& history = History();
+	if(!history.frames.empty()) {
+		history.frames[history.next] = RenderCounters::current;
+		history.next = (history.next + 1) % history.frames.size();
+		history.count = std::min(history.count + 1, history.frames.size());
+	}
+	RenderCounters::current.frame++;
+	RenderCounters::current.Reset();
+}
+
+size_t RenderCounters::GetFrameCount() {
+	return History().count;
+}
+
+RenderFrameCounters RenderCounters::GetFrame(size_t age) {
+	RenderCounterHistory& history = History();
+	assert(age < history.count);
+	size_t size = history.frames.size();
+	return history.frames[(history.next + size - 1 - age) % size];
+}
+
+void RenderCounters::SetHistoryLength(size_t frames) {
+	RenderCounterHistory& history = History();
+	history.frames.assign(frames, RenderFrameCounters());
+	history.next = history.count = 0;
+}
+
+void RenderCounters::Reset() {
+	RenderCounterHistory& history = History();
+	history.next = history.count = 0;
+	RenderCounters::current.Reset();
+}
+
+void RenderCounters::Write(std::ostream& output) {
+	output << "frame, draw calls, primitives, vertices, buffer binds, client state toggles, attrib pushes, attrib pops, uploaded bytes" << std::endl;
+	for(size_t age = RenderCounters::GetFrameCount(); age-- > 0;) {
+		RenderFrameCounters frame = RenderCounters::GetFrame(age);
+		output << frame.frame << ", " << frame.drawCalls << ", " << frame.primitives << ", " << frame.vertices << ", "
+			   << frame.bufferBinds << ", " << frame.clientStateToggles << ", " << frame.attribPushes << ", "
+			   << frame.attribPops << ", " << frame.uploadedBytes << std::endl;
+	}
+}
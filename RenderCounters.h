@@ -0,0 +1,141 @@
+#ifndef _591_RENDERCOUNTERS_H_
+#define _591_RENDERCOUNTERS_H_
+
+#include "GLee.h"
+#include <ostream>
+#include <cstddef>
+
+/*
+	Counts the GL work the buffers and renderers ask for each frame: draw calls, the primitives and
+	vertices they submit, buffer and vertex array binds, client state toggles, attribute stack pushes
+	and pops, and the bytes uploaded. Call RenderCounters::EndFrame once a frame to close its counts
+	into a ring of recent frames, which can be read back or written out as CSV.
+	Counting is a plain increment with no locking, made on the GL thread next to the call it counts.
+	Define OBJLOADER_NO_RENDER_COUNTERS to compile the counting out; the counters then stay at zero.
+*/
+
+/// The finished frames RenderCounters keeps until told otherwise
+const size_t DefaultRenderCounterHistory = 120;
+
+/// What one frame asked of GL
+struct RenderFrameCounters {
+	RenderFrameCounters() {
+		frame = 0;
+		this->Reset();
+	}
+	/// Zero the counts, keeping the frame number
+	void Reset() {
+		drawCalls = primitives = vertices = 0;
+		bufferBinds = clientStateToggles = 0;
+		attribPushes = attribPops = 0;
+		uploadedBytes = 0;
+	}
+	/// Which frame this was, counting from 0 at the start of the program
+	unsigned long long frame;
+	/// glDraw* calls. A multi-draw or instanced draw is one call.
+	unsigned long long drawCalls;
+	/// Primitives submitted, every instance included. Strips joined by primitive restart count each restart as a primitive or two.
+	unsigned long long primitives;
+	/// Vertices submitted, or indices for indexed draws, every instance included
+	unsigned long long vertices;
+	/// glBindBuffer and glBindVertexArray calls
+	unsigned long long bufferBinds;
+	/// Client states and generic vertex attribute arrays enabled or disabled
+	unsigned long long clientStateToggles;
+	/// glPushAttrib calls
+	unsigned long long attribPushes;
+	/// glPopAttrib calls
+	unsigned long long attribPops;
+	/// Bytes handed to GL by Commit, CommitRange and streamed instance data, plus whole buffers written through a mapping
+	unsigned long long uploadedBytes;
+};
+
+/// The frame counters. All static; there is only one set.
+class RenderCounters {
+public:
+	/// The frame being counted now, so far
+	static const RenderFrameCounters& GetCurrentFrame() {
+		return RenderCounters::current;
+	}
+	/// Close the current frame into the ring of finished frames and start counting the next.
+	static void EndFrame();
+	/// The number of finished frames kept, at most the history length
+	static size_t GetFrameCount();
+	/// A finished frame: 0 is the one that finished last, 1 the one before it and so on, up to GetFrameCount() - 1.
+	static RenderFrameCounters GetFrame(size_t age);
+	/// Keep this many finished frames from now on. Forgets the ones kept so far.
+	static void SetHistoryLength(size_t frames);
+	/// Forget the finished frames and zero the current one. Frame numbers carry on.
+	static void Reset();
+	/// Print the finished frames as CSV, oldest first, one line each
+	static void Write(std::ostream& output);
+public:
+	/// \name For buffers and renderers to count through, by way of RENDER_COUNT
+	/// \{
+	static void CountDraw(GLenum primitiveType, size_t vertexCount, size_t instanceCount = 1) {
+		RenderCounters::current.drawCalls++;
+		RenderCounters::current.primitives += RenderCounters::GetPrimitiveCount(primitiveType, vertexCount) * instanceCount;
+		RenderCounters::current.vertices += vertexCount * instanceCount;
+	}
+	/// A glMultiDrawElements of drawCount ranges
+	static void CountMultiDraw(GLenum primitiveType, const GLsizei* vertexCounts, size_t drawCount) {
+		RenderCounters::current.drawCalls++;
+		for(size_t i = 0; i < drawCount; i++) {
+			RenderCounters::current.primitives += RenderCounters::GetPrimitiveCount(primitiveType, vertexCounts[i]);
+			RenderCounters::current.vertices += vertexCounts[i];
+		}
+	}
+	static void CountBind() {
+		RenderCounters::current.bufferBinds++;
+	}
+	static void CountClientStateToggle() {
+		RenderCounters::current.clientStateToggles++;
+	}
+	static void CountPushAttrib() {
+		RenderCounters::current.attribPushes++;
+	}
+	static void CountPopAttrib() {
+		RenderCounters::current.attribPops++;
+	}
+	static void CountUpload(size_t bytes) {
+		RenderCounters::current.uploadedBytes += bytes;
+	}
+	/// \}
+	/// The primitives a draw of vertexCount vertices makes
+	static size_t GetPrimitiveCount(GLenum primitiveType, size_t vertexCount) {
+		switch(primitiveType) {
+			case GL_POINTS:
+				return vertexCount;
+			case GL_LINES:
+				return vertexCount / 2;
+			case GL_LINE_LOOP:
+				return (vertexCount >= 2) ? vertexCount : 0;
+			case GL_LINE_STRIP:
+				return (vertexCount >= 2) ? vertexCount - 1 : 0;
+			case GL_TRIANGLES:
+				return vertexCount / 3;
+			case GL_TRIANGLE_STRIP:
+			case GL_TRIANGLE_FAN:
+				return (vertexCount >= 3) ? vertexCount - 2 : 0;
+			case GL_POLYGON:
+				return (vertexCount >= 3) ? 1 : 0;
+			case GL_QUADS:
+				return vertexCount / 4;
+			case GL_QUAD_STRIP:
+				return (vertexCount >= 4) ? (vertexCount - 2) / 2 : 0;
+			default:
+				return 0;
+		}
+	}
+private:
+	static RenderFrameCounters current;
+};
+
+#ifndef OBJLOADER_NO_RENDER_COUNTERS
+/// Count through RenderCounters, as in RENDER_COUNT(CountBind()). Compiles to nothing with OBJLOADER_NO_RENDER_COUNTERS.
+#define RENDER_COUNT(count) RenderCounters::count
+#else
+#define RENDER_COUNT(count) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#include "ScratchArena.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+//--------------------------------------------------------------------------
+
+ScratchArena::ScratchArena(size_t blockSize) {
+	assert(blockSize > 0);
+	this->blockSize = blockSize;
+	this->used = 0;
+	this->usedBefore = 0;
+}
+
+ScratchArena::~ScratchArena() {
+	this->Release();
+}
+
+void* ScratchArena::Allocate(size_t bytes, size_t alignment) {
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0); // Powers of two only
+	this->statistics.allocations++;
+
+	size_t padding = 0;
+	if(!this->blocks.empty()) {
+		uintptr_t next = (uintptr_t)(this->blocks.back().data + this->used);
+		padding = (alignment - (next & (alignment - 1))) & (alignment - 1);
+	}
+	if(this->blocks.empty() || this->used + padding + bytes > this->blocks.back().size) {
+		// Doesn't fit; leave the rest of this block and start another at least twice as big
+		size_t previous = this->blocks.empty() ? 0 : this->blocks.back().size;
+		this->usedBefore += this->used;
+		this->AddBlock(std::max(std::max(this->blockSize, previous * 2), bytes + alignment));
+		uintptr_t next = (uintptr_t)this->blocks.back().data;
+		padding = (alignment - (next & (alignment - 1))) & (alignment - 1);
+	}
+
+	void* allocation = this->blocks.back().data + this->used + padding;
+	this->used += padding + bytes;
+	this->statistics.bytesInUse = this->usedBefore + this->used;
+	this->statistics.peakBytes = std::max(this->statistics.peakBytes, this->statistics.bytesInUse);
+	return allocation;
+}
+
+void ScratchArena::Reset() {
+	if(this->blocks.size() > 1) {
+		// Swap the spill blocks for one block that would have held them all
+		size_t capacity = this->statistics.capacity;
+		this->Release();
+		this->AddBlock(capacity);
+	}
+	this->used = 0;
+	this->usedBefore = 0;
+	this->statistics.bytesInUse = 0;
+}
+
+void ScratchArena::Release() {
+	for(size_t i = 0; i < this->blocks.size(); i++) {
+		delete[] this->blocks[i].data;
+	}
+	this->blocks.clear();
+	this->used = 0;
+	this->usedBefore = 0;
+	this->statistics.bytesInUse = 0;
+	this->statistics.capacity = 0;
+}
+
+ScratchStatistics ScratchArena::GetStatistics() const {
+	return this->statistics;
+}
+
+void ScratchArena::ResetStatistics() {
+	this->statistics.allocations = 0;
+	this->statistics.blockAllocations = 0;
+	this->statistics.peakBytes = this->statistics.bytesInUse;
+}
+
+void ScratchArena::AddBlock(size_t size) {
+	Block block;
+	block.data = new char[size];
+	block.size = size;
+	this->blocks.push_back(block);
+	this->used = 0;
+	this->statistics.blockAllocations++;
+	this->statistics.capacity += size;
+}
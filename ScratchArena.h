@@ -0,0 +1,75 @@
+#ifndef _591_SCRATCHARENA_H_
+#define _591_SCRATCHARENA_H_
+
+#include <vector>
+#include <cstddef>
+
+/// The smallest block a ScratchArena asks the heap for
+const size_t DefaultScratchBlockSize = 1 << 20;
+
+/// How much a ScratchArena has been asked for, and how much it asked the heap for
+struct ScratchStatistics {
+	ScratchStatistics() {
+		allocations = blockAllocations = 0;
+		bytesInUse = peakBytes = capacity = 0;
+	}
+	/// Allocate calls since the statistics were reset
+	size_t allocations;
+	/// Blocks taken from the heap since the statistics were reset. Stays put once the arena is big enough.
+	size_t blockAllocations;
+	/// Bytes handed out since the last Reset, alignment padding included
+	size_t bytesInUse;
+	/// The most bytesInUse has been since the statistics were reset
+	size_t peakBytes;
+	/// Bytes of blocks the arena holds
+	size_t capacity;
+};
+
+/**
+	\brief A bump allocator for short-lived arrays that all go away together.
+	Allocating moves a pointer along a block; Reset frees everything at once and keeps the memory
+	for next time. When a round of allocations spills into more blocks, Reset swaps them for one
+	block big enough for all of it, so the next round of the same size needs no heap at all.
+	Nothing allocated is constructed or destroyed, so only use it for plain data.
+*/
+class ScratchArena {
+public:
+	explicit ScratchArena(size_t blockSize = DefaultScratchBlockSize);
+	~ScratchArena();
+public:
+	/// Get bytes that stay valid until the next Reset or Release.
+	void* Allocate(size_t bytes, size_t alignment = 16);
+	/// Get an uninitialised array of plain data that stays valid until the next Reset or Release.
+	template<class T>
+	T* Allocate(size_t count) {
+		return (T*)this->Allocate(count * sizeof(T), alignof(T));
+	}
+	/// Free everything allocated, keeping the memory for the next round.
+	void Reset();
+	/// Free everything and give the memory back to the heap.
+	void Release();
+public:
+	ScratchStatistics GetStatistics() const;
+	/// Start the allocation counts and the peak again, e.g. to measure a single load.
+	void ResetStatistics();
+private:
+	struct Block {
+		char* data;
+		size_t size;
+	};
+	void AddBlock(size_t size);
+	// Owns its blocks, no copying
+	ScratchArena(const ScratchArena&);
+	ScratchArena& operator=(const ScratchArena&);
+private:
+	size_t blockSize;
+	/// Allocations come from the last block
+	std::vector<Block> blocks;
+	/// Bytes used in the last block
+	size_t used;
+	/// Bytes used in every block but the last
+	size_t usedBefore;
+	ScratchStatistics statistics;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef _585_STREAMEDVERTEXBUFFER_H_
+#define _585_STREAMEDVERTEXBUFFER_H_
+
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
+#include <vector>
+#include <set>
+
+/// Which streams of a StreamedVertexBuffer a draw binds.
+enum VertexStreams {
+	/// Positions only, for depth and shadow passes
+	PositionStreamOnly = 1,
+	/// Positions and every other attribute
+	AllVertexStreams = 3
+};
+
+/**
+	\brief A vertex buffer split into two streams: positions on their own, and everything else interleaved.
+	Passes that only need positions bind just the position stream, so they fetch a fraction of the bytes
+	an interleaved buffer would make them read. Leave vertex arrays off on the two streams; a vertex
+	array object per stream can't capture the pair.
+	\param PositionLayout	The layout of the position stream, e.g. VertexLayout<Position3>.
+	\param AttributeLayout	The layout of the remaining attributes, e.g. VertexLayout<TextureCoordinate2, Normal3>.
+*/
+template<class PositionLayout, class AttributeLayout>
+class StreamedVertexBuffer {
+public:
+	/**
+		\brief Create both streams.
+		\param vertexCount		The number of vertices (not components) to store.
+		\param shadowPolicy		What to do with the shadow arrays once the streams are committed.
+		\param shadowStart		Whether to skip making the shadow arrays, for streams about to go through MapForWriting.
+	*/
+	StreamedVertexBuffer(size_t vertexCount, ShadowPolicy shadowPolicy = ShadowRetained, ShadowStart shadowStart = ShadowZeroed)
+		: positions(StreamedVertexBuffer::StreamSize(vertexCount, PositionLayout::Stride()), shadowPolicy, shadowStart),
+		  attributes(StreamedVertexBuffer::StreamSize(vertexCount, AttributeLayout::Stride()), shadowPolicy, shadowStart) {
+		static_assert(PositionLayout::Has(SemanticPosition), "The position stream needs positions");
+		static_assert(!AttributeLayout::Has(SemanticPosition), "Positions belong in the position stream");
+	}
+public:
+	TypedVertexBuffer<PositionLayout>* GetPositions() {
+		return &this->positions;
+	}
+	TypedVertexBuffer<AttributeLayout>* GetAttributes() {
+		return &this->attributes;
+	}
+	/// Get the number of vertices in the buffer
+	size_t GetVertexCount() const {
+		return this->positions.GetVertexCount();
+	}
+	/// Write both streams to the GPU.
+	void Commit() const {
+		this->positions.Commit();
+		this->attributes.Commit();
+	}
+	/// Set what happens to both shadow arrays on the next Commit.
+	void SetShadowPolicy(ShadowPolicy shadowPolicy) {
+		this->positions.SetShadowPolicy(shadowPolicy);
+		this->attributes.SetShadowPolicy(shadowPolicy);
+	}
+	/// Count both streams' memory under a tag. See MemoryAccounting.
+	void SetMemoryTag(MemoryTag* memoryTag) {
+		this->positions.SetMemoryTag(memoryTag);
+		this->attributes.SetMemoryTag(memoryTag);
+	}
+	/// The number of bytes one vertex fetch reads with the given streams bound.
+	static unsigned int GetFetchSize(VertexStreams streams) {
+		unsigned int size = PositionLayout::Stride() * sizeof(float);
+		if(streams == AllVertexStreams) {
+			size += AttributeLayout::Stride() * sizeof(float);
+		}
+		return size;
+	}
+public:
+	/// Bind the chosen streams and point GL at them. Doesn't save GL state; pair it with EndDraw.
+	void BeginDraw(VertexStreams streams = AllVertexStreams) const {
+		if(streams == AllVertexStreams) {
+			this->attributes.BeginDraw();
+		}
+		this->positions.BeginDraw();
+	}
+	/// Undo BeginDraw.
+	void EndDraw(VertexStreams streams = AllVertexStreams) const {
+		this->positions.EndDraw();
+		if(streams == AllVertexStreams) {
+			this->attributes.EndDraw();
+		}
+	}
+	/// Draw the vertices as a certain kind of primitive, binding only the chosen streams.
+	void Draw(GLenum primitiveType = GL_TRIANGLES, VertexStreams streams = AllVertexStreams) const {
+		glPushAttrib(GL_ALL_ATTRIB_BITS);
+		RENDER_COUNT(CountPushAttrib());
+		this->BeginDraw(streams);
+		assert(FitsDrawCount(this->GetVertexCount()));
+		glDrawArrays(primitiveType, 0, (GLsizei)this->GetVertexCount());
+		RENDER_COUNT(CountDraw(primitiveType, this->GetVertexCount()));
+		this->EndDraw(streams);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		RENDER_COUNT(CountBind());
+		glPopAttrib();
+		RENDER_COUNT(CountPopAttrib());
+	}
+	/**
+		\brief Draw the vertices using an index buffer, binding only the chosen streams.
+		\param indices			The index buffer to use. Ensure it is committed to the GPU.
+		\param primitiveType	The OpenGL geometric primitive type to render these vertices as.
+		\param streams			The streams to bind. PositionStreamOnly for depth and shadow passes.
+	*/
+	void DrawIndexed(IndexBuffer& indices, GLenum primitiveType = GL_TRIANGLES, VertexStreams streams = AllVertexStreams) const {
+		glPushAttrib(GL_ALL_ATTRIB_BITS);
+		RENDER_COUNT(CountPushAttrib());
+		indices.EnsureCommitted();
+		indices.Bind();
+		this->BeginDraw(streams);
+		indices.DrawAll(primitiveType);
+		this->EndDraw(streams);
+		glPopAttrib();
+		RENDER_COUNT(CountPopAttrib());
+	}
+private:
+	/// The components of one stream, checked before the stream is made from it. Too many vertices give a size no allocation can meet, rather than one that wrapped round to something small.
+	static size_t StreamSize(size_t vertexCount, size_t stride) {
+		size_t size = 0;
+		bool fits = MultiplySizes(vertexCount, stride, size);
+		assert(fits);
+		return fits ? size : (size_t)-1;
+	}
+private:
+	TypedVertexBuffer<PositionLayout> positions;
+	TypedVertexBuffer<AttributeLayout> attributes;
+};
+
+//--------------------------------------------------------------------------
+
+/**
+	\brief Counts the vertex data a draw pulls from memory, so pass layouts can be compared on the CPU.
+	Every index is one vertex fetch, reading a whole vertex from each bound stream. Each stream is also
+	modelled as a run of cache lines, and the distinct lines a draw touches are counted.
+*/
+class VertexFetchCounter {
+public:
+	VertexFetchCounter(unsigned int cacheLineBytes = 64) {
+		assert(cacheLineBytes > 0);
+		this->cacheLineBytes = cacheLineBytes;
+		this->Reset();
+	}
+	void Reset() {
+		this->vertexFetches = 0;
+		this->bytesFetched = 0;
+		this->cacheLinesTouched = 0;
+	}
+	/**
+		\brief Count an indexed draw.
+		\param indices		The index buffer the draw uses.
+		\param startIndex	The first index drawn.
+		\param indexCount	The number of indices drawn.
+		\param streamStrides	The size of one vertex, in bytes, in each bound stream.
+	*/
+	void CountDraw(const IndexBuffer& indices, size_t startIndex, size_t indexCount,
+				   const std::vector<unsigned int>& streamStrides) {
+		for(size_t stream = 0; stream < streamStrides.size(); stream++) {
+			std::set<size_t> lines;
+			unsigned int stride = streamStrides[stream];
+			for(size_t i = startIndex; i < startIndex + indexCount; i++) {
+				size_t first = (size_t)indices[i] * stride;
+				size_t last = first + stride - 1;
+				for(size_t line = first / this->cacheLineBytes; line <= last / this->cacheLineBytes; line++) {
+					lines.insert(line);
+				}
+				this->bytesFetched += stride;
+			}
+			this->cacheLinesTouched += lines.size();
+		}
+		this->vertexFetches += indexCount;
+	}
+	/// Count an indexed draw from a single interleaved stream.
+	void CountDraw(const IndexBuffer& indices, size_t startIndex, size_t indexCount, unsigned int strideBytes) {
+		this->CountDraw(indices, startIndex, indexCount, std::vector<unsigned int>(1, strideBytes));
+	}
+	/// Count an indexed draw from a StreamedVertexBuffer with the given streams bound.
+	template<class PositionLayout, class AttributeLayout>
+	void CountDraw(const IndexBuffer& indices, size_t startIndex, size_t indexCount,
+				   const StreamedVertexBuffer<PositionLayout, AttributeLayout>&, VertexStreams streams) {
+		std::vector<unsigned int> strides(1, PositionLayout::Stride() * sizeof(float));
+		if(streams == AllVertexStreams) {
+			strides.push_back(AttributeLayout::Stride() * sizeof(float));
+		}
+		this->CountDraw(indices, startIndex, indexCount, strides);
+	}
+public:
+	/// The number of vertices fetched
+	size_t GetVertexFetches() const {
+		return this->vertexFetches;
+	}
+	/// The number of bytes of vertex data read, counting every fetch
+	size_t GetBytesFetched() const {
+		return this->bytesFetched;
+	}
+	/// The number of distinct cache lines each draw touched, summed over draws
+	size_t GetCacheLinesTouched() const {
+		return this->cacheLinesTouched;
+	}
+	/// GetCacheLinesTouched in bytes: the memory traffic with a perfect cache within each draw
+	size_t GetCacheLineBytes() const {
+		return this->cacheLinesTouched * this->cacheLineBytes;
+	}
+private:
+	unsigned int cacheLineBytes;
+	size_t vertexFetches;
+	size_t bytesFetched;
+	size_t cacheLinesTouched;
+};
+
+#endif
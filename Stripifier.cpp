@@ -0,0 +1,165 @@
+#include "Stripifier.h"
+#include <algorithm>
+#include <utility>
+#include <cassert>
+
+//--------------------------------------------------------------------------
+
+namespace {
+
+typedef unsigned long long EdgeKey;
+
+inline EdgeKey MakeEdgeKey(IndexType from, IndexType to) {
+	return ((EdgeKey)from << 32) | (EdgeKey)to;
+}
+
+/// Finds the triangles that hold a directed edge.
+class EdgeTable {
+public:
+	EdgeTable(const IndexType* triangles, const std::vector<size_t>& usable) {
+		for(size_t i = 0; i < usable.size(); i++) {
+			const IndexType* t = triangles + usable[i] * 3;
+			this->edges.push_back(std::make_pair(MakeEdgeKey(t[0], t[1]), usable[i]));
+			this->edges.push_back(std::make_pair(MakeEdgeKey(t[1], t[2]), usable[i]));
+			this->edges.push_back(std::make_pair(MakeEdgeKey(t[2], t[0]), usable[i]));
+		}
+		std::sort(this->edges.begin(), this->edges.end());
+	}
+	/// Find an unused triangle with the directed edge from -> to, or return false.
+	bool Find(IndexType from, IndexType to, const std::vector<bool>& used, size_t& triangle) const {
+		std::vector<std::pair<EdgeKey, size_t> >::const_iterator edge =
+			std::lower_bound(this->edges.begin(), this->edges.end(), std::make_pair(MakeEdgeKey(from, to), (size_t)0));
+		for(; edge != this->edges.end() && edge->first == MakeEdgeKey(from, to); ++edge) {
+			if(!used[edge->second]) {
+				triangle = edge->second;
+				return true;
+			}
+		}
+		return false;
+	}
+private:
+	std::vector<std::pair<EdgeKey, size_t> > edges;
+};
+
+/// The vertex of a triangle that isn't on the edge from -> to.
+inline IndexType ThirdVertex(const IndexType* t, IndexType from, IndexType to) {
+	for(int v = 0; v < 3; v++) {
+		if(t[v] != from && t[v] != to) {
+			return t[v];
+		}
+	}
+	assert(false); // Degenerate triangles are filtered out before we get here
+	return t[0];
+}
+
+/**
+	Grow a strip forward from its last two vertices. Triangle i of a strip is (i, i+1, i+2) when i is even and
+	(i+1, i, i+2) when odd, so the next triangle must hold the matching directed edge to keep its winding.
+	If marking is false the strip is only measured; nothing is recorded as used.
+*/
+size_t ExtendStrip(const IndexType* triangles, const EdgeTable& edges, std::vector<bool>& used,
+				   std::vector<IndexType>& strip, bool marking) {
+	std::vector<size_t> taken;
+	size_t added = 0;
+	while(true) {
+		size_t n = strip.size();
+		bool even = ((n - 2) % 2 == 0);
+		IndexType from = even ? strip[n - 2] : strip[n - 1];
+		IndexType to = even ? strip[n - 1] : strip[n - 2];
+
+		size_t next;
+		if(!edges.Find(from, to, used, next)) {
+			break;
+		}
+		used[next] = true;
+		taken.push_back(next);
+		strip.push_back(ThirdVertex(triangles + next * 3, from, to));
+		added++;
+	}
+	if(!marking) {
+		for(size_t i = 0; i < taken.size(); i++) {
+			used[taken[i]] = false;
+		}
+	}
+	return added;
+}
+
+}
+
+//--------------------------------------------------------------------------
+
+StripStatistics Stripify(const IndexType* triangles, size_t indexCount, StripJoin join, std::vector<IndexType>& strips) {
+	assert(indexCount % 3 == 0);
+	StripStatistics statistics;
+	statistics.listIndexCount = indexCount;
+	strips.clear();
+
+	size_t triangleCount = indexCount / 3;
+	std::vector<size_t> usable;
+	for(size_t t = 0; t < triangleCount; t++) {
+		const IndexType* triangle = triangles + t * 3;
+		if(triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]) {
+			statistics.degenerateTriangles++;
+			continue;
+		}
+		assert(join != StripJoinRestart || (triangle[0] != PrimitiveRestartIndex && triangle[1] != PrimitiveRestartIndex && triangle[2] != PrimitiveRestartIndex));
+		usable.push_back(t);
+	}
+	statistics.triangleCount = usable.size();
+
+	EdgeTable edges(triangles, usable);
+	std::vector<bool> used(triangleCount, true);
+	for(size_t i = 0; i < usable.size(); i++) {
+		used[usable[i]] = false;
+	}
+
+	std::vector<IndexType> strip;
+	for(size_t i = 0; i < usable.size(); i++) {
+		size_t start = usable[i];
+		if(used[start]) {
+			continue;
+		}
+		used[start] = true;
+		const IndexType* t = triangles + start * 3;
+
+		// Try starting from each of the triangle's three edges and keep whichever runs longest
+		int bestRotation = 0;
+		size_t bestLength = 0;
+		for(int rotation = 0; rotation < 3; rotation++) {
+			strip.clear();
+			strip.push_back(t[rotation]);
+			strip.push_back(t[(rotation + 1) % 3]);
+			strip.push_back(t[(rotation + 2) % 3]);
+			size_t length = ExtendStrip(triangles, edges, used, strip, false);
+			if(rotation == 0 || length > bestLength) {
+				bestRotation = rotation;
+				bestLength = length;
+			}
+		}
+		strip.clear();
+		strip.push_back(t[bestRotation]);
+		strip.push_back(t[(bestRotation + 1) % 3]);
+		strip.push_back(t[(bestRotation + 2) % 3]);
+		ExtendStrip(triangles, edges, used, strip, true);
+
+		// Join it onto what we have so far
+		if(!strips.empty()) {
+			if(join == StripJoinRestart) {
+				strips.push_back(PrimitiveRestartIndex);
+			}
+			else {
+				strips.push_back(strips.back());
+				strips.push_back(strip[0]);
+				// Each strip has to start on an even triangle or its winding flips
+				if(strips.size() % 2 != 0) {
+					strips.push_back(strip[0]);
+				}
+			}
+		}
+		strips.insert(strips.end(), strip.begin(), strip.end());
+		statistics.stripCount++;
+	}
+
+	statistics.stripIndexCount = strips.size();
+	return statistics;
+}
@@ -0,0 +1,51 @@
+#ifndef _585_STRIPIFIER_H_
+#define _585_STRIPIFIER_H_
+
+#include "IndexBuffer.h"
+#include <vector>
+#include <cstddef>
+
+/// How Stripify joins one strip to the next in its output.
+enum StripJoin {
+	/// Put PrimitiveRestartIndex between strips. Needs IndexBuffer::SetPrimitiveRestart to draw.
+	StripJoinRestart = 0,
+	/// Repeat vertices to make degenerate triangles between strips. Draws anywhere, but costs more indices.
+	StripJoinDegenerate = 1
+};
+
+/// What Stripify made of a triangle list.
+struct StripStatistics {
+	StripStatistics() {
+		triangleCount = degenerateTriangles = stripCount = 0;
+		listIndexCount = stripIndexCount = 0;
+	}
+	/// Triangles in the input that made it into strips
+	size_t triangleCount;
+	/// Triangles in the input with repeated vertices, which were dropped
+	size_t degenerateTriangles;
+	/// The number of strips made
+	size_t stripCount;
+	/// Indices in the input triangle list
+	size_t listIndexCount;
+	/// Indices in the output, joins included
+	size_t stripIndexCount;
+
+	/// The output's size as a fraction of the input's.
+	float GetIndexRatio() const {
+		return (listIndexCount > 0) ? (float)stripIndexCount / (float)listIndexCount : 1.0f;
+	}
+};
+
+/**
+	\brief Turn a triangle list into long triangle strips, greedily following shared edges.
+	Winding is kept, so the strips cull the same way the triangles did. Works best on meshes
+	whose triangles share vertex indices; weld duplicate vertices first.
+	\param triangles	The triangle list, three indices per triangle.
+	\param indexCount	The number of indices in the list.
+	\param join			How to join the strips together.
+	\param strips		Receives the joined strips, to be drawn as one GL_TRIANGLE_STRIP.
+	\return				How big the strips came out compared to the list.
+*/
+StripStatistics Stripify(const IndexType* triangles, size_t indexCount, StripJoin join, std::vector<IndexType>& strips);
+
+#endif
@@ -0,0 +1,332 @@
+#include "TransformKernels.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <vector>
+#include <cfloat>
+
+//--------------------------------------------------------------------------
+
+namespace {
+
+/// Reads xyz from interleaved elements, gathering four elements into x, y and z lanes.
+struct StridedReader {
+	const float* data;
+	size_t stride;
+
+	void Load(size_t i, Float4& x, Float4& y, Float4& z) const {
+		const float* p = this->data + i * this->stride;
+		size_t s = this->stride;
+		x = Float4Set(p[0], p[s], p[2 * s], p[3 * s]);
+		y = Float4Set(p[1], p[s + 1], p[2 * s + 1], p[3 * s + 1]);
+		z = Float4Set(p[2], p[s + 2], p[2 * s + 2], p[3 * s + 2]);
+	}
+	void Load(size_t i, float& x, float& y, float& z) const {
+		const float* p = this->data + i * this->stride;
+		x = p[0];
+		y = p[1];
+		z = p[2];
+	}
+};
+
+/// Writes xyz lanes back out to four interleaved elements.
+struct StridedWriter {
+	float* data;
+	size_t stride;
+
+	void Store(size_t i, Float4 x, Float4 y, Float4 z) const {
+		alignas(16) float lanes[3][4];
+		Float4Store(lanes[0], x);
+		Float4Store(lanes[1], y);
+		Float4Store(lanes[2], z);
+		float* p = this->data + i * this->stride;
+		for(size_t k = 0; k < 4; k++, p += this->stride) {
+			p[0] = lanes[0][k];
+			p[1] = lanes[1][k];
+			p[2] = lanes[2][k];
+		}
+	}
+	void Store(size_t i, float x, float y, float z) const {
+		float* p = this->data + i * this->stride;
+		p[0] = x;
+		p[1] = y;
+		p[2] = z;
+	}
+};
+
+/// Reads separate x, y and z arrays, which are already in lanes.
+struct ArrayReader {
+	const float* x;
+	const float* y;
+	const float* z;
+
+	void Load(size_t i, Float4& x, Float4& y, Float4& z) const {
+		x = Float4LoadUnaligned(this->x + i);
+		y = Float4LoadUnaligned(this->y + i);
+		z = Float4LoadUnaligned(this->z + i);
+	}
+	void Load(size_t i, float& x, float& y, float& z) const {
+		x = this->x[i];
+		y = this->y[i];
+		z = this->z[i];
+	}
+};
+
+struct ArrayWriter {
+	float* x;
+	float* y;
+	float* z;
+
+	void Store(size_t i, Float4 x, Float4 y, Float4 z) const {
+		Float4StoreUnaligned(this->x + i, x);
+		Float4StoreUnaligned(this->y + i, y);
+		Float4StoreUnaligned(this->z + i, z);
+	}
+	void Store(size_t i, float x, float y, float z) const {
+		this->x[i] = x;
+		this->y[i] = y;
+		this->z[i] = z;
+	}
+};
+
+/// An affine Matrix4 applied to points, with each element splatted across lanes once up front.
+struct PointTransform {
+	PointTransform(const Matrix4& transform) {
+		for(size_t c = 0; c < 4; c++) {
+			for(size_t r = 0; r < 3; r++) {
+				this->scalar[c * 3 + r] = transform(r, c);
+				this->packed[c * 3 + r] = Float4Splat(transform(r, c));
+			}
+		}
+	}
+	void Apply(Float4& x, Float4& y, Float4& z) const {
+		const Float4* m = this->packed;
+		Float4 ox = Float4Add(Float4Add(Float4Mul(x, m[0]), Float4Mul(y, m[3])), Float4Add(Float4Mul(z, m[6]), m[9]));
+		Float4 oy = Float4Add(Float4Add(Float4Mul(x, m[1]), Float4Mul(y, m[4])), Float4Add(Float4Mul(z, m[7]), m[10]));
+		Float4 oz = Float4Add(Float4Add(Float4Mul(x, m[2]), Float4Mul(y, m[5])), Float4Add(Float4Mul(z, m[8]), m[11]));
+		x = ox;
+		y = oy;
+		z = oz;
+	}
+	void Apply(float& x, float& y, float& z) const {
+		const float* m = this->scalar;
+		float ox = (x * m[0] + y * m[3]) + (z * m[6] + m[9]);
+		float oy = (x * m[1] + y * m[4]) + (z * m[7] + m[10]);
+		float oz = (x * m[2] + y * m[5]) + (z * m[8] + m[11]);
+		x = ox;
+		y = oy;
+		z = oz;
+	}
+
+	/// Column-major, rows 0-2 of each of the four columns
+	Float4 packed[12];
+	float scalar[12];
+};
+
+/// A Matrix3 applied to directions, optionally renormalizing them.
+struct DirectionTransform {
+	DirectionTransform(const Matrix3& transform, bool renormalize) {
+		for(size_t i = 0; i < 9; i++) {
+			this->scalar[i] = transform.m_Data[i];
+			this->packed[i] = Float4Splat(transform.m_Data[i]);
+		}
+		this->renormalize = renormalize;
+	}
+
+	void Apply(Float4& x, Float4& y, Float4& z) const {
+		const Float4* m = this->packed;
+		Float4 ox = Float4Add(Float4Add(Float4Mul(x, m[0]), Float4Mul(y, m[3])), Float4Mul(z, m[6]));
+		Float4 oy = Float4Add(Float4Add(Float4Mul(x, m[1]), Float4Mul(y, m[4])), Float4Mul(z, m[7]));
+		Float4 oz = Float4Add(Float4Add(Float4Mul(x, m[2]), Float4Mul(y, m[5])), Float4Mul(z, m[8]));
+		if(this->renormalize) {
+			Float4 lengthSquared = Float4Add(Float4Add(Float4Mul(ox, ox), Float4Mul(oy, oy)), Float4Mul(oz, oz));
+			// Dividing a zero direction by the smallest float keeps it zero instead of NaN
+			Float4 length = Float4Max(Float4Sqrt(lengthSquared), Float4Splat(FLT_MIN));
+			ox = Float4Div(ox, length);
+			oy = Float4Div(oy, length);
+			oz = Float4Div(oz, length);
+		}
+		x = ox;
+		y = oy;
+		z = oz;
+	}
+	void Apply(float& x, float& y, float& z) const {
+		const float* m = this->scalar;
+		float ox = x * m[0] + y * m[3] + z * m[6];
+		float oy = x * m[1] + y * m[4] + z * m[7];
+		float oz = x * m[2] + y * m[5] + z * m[8];
+		if(this->renormalize) {
+			float length = std::max(std::sqrt(ox * ox + oy * oy + oz * oz), FLT_MIN);
+			ox /= length;
+			oy /= length;
+			oz /= length;
+		}
+		x = ox;
+		y = oy;
+		z = oz;
+	}
+
+	Float4 packed[9];
+	float scalar[9];
+	bool renormalize;
+};
+
+/// Transform elements [begin, end), four at a time and then one at a time for the rest.
+template<class Transform, class Reader, class Writer>
+void TransformRange(const Transform& transform, const Reader& input, const Writer& output, size_t begin, size_t end) {
+	size_t i = begin;
+	for(; i + 4 <= end; i += 4) {
+		Float4 x, y, z;
+		input.Load(i, x, y, z);
+		transform.Apply(x, y, z);
+		output.Store(i, x, y, z);
+	}
+	for(; i < end; i++) {
+		float x, y, z;
+		input.Load(i, x, y, z);
+		transform.Apply(x, y, z);
+		output.Store(i, x, y, z);
+	}
+}
+
+/// Transform count elements, splitting big batches into one run of whole blocks per hardware thread.
+template<class Transform, class Reader, class Writer>
+void TransformAll(const Transform& transform, const Reader& input, const Writer& output, size_t count) {
+	ParallelFor(count, ParallelTransformThreshold, 4, [&transform, &input, &output](size_t begin, size_t end) {
+		TransformRange(transform, input, output, begin, end);
+	});
+}
+
+/// Points summed in float lanes before the sums move into doubles. A multiple of four.
+const size_t PointSumFlushSize = 256;
+
+/// One block's share of MeasurePoints
+struct PartialStatistics {
+	float minimum[3];
+	float maximum[3];
+	double sum[3];
+};
+
+/// Reduce points [begin, end) into partial, four at a time and then one at a time for the rest.
+template<class Reader>
+void MeasureRange(const Reader& input, size_t begin, size_t end, PartialStatistics& partial) {
+	Float4 minimum[3], maximum[3];
+	for(size_t a = 0; a < 3; a++) {
+		minimum[a] = Float4Splat(FLT_MAX);
+		maximum[a] = Float4Splat(-FLT_MAX);
+		partial.sum[a] = 0.0;
+	}
+
+	size_t i = begin;
+	while(i + 4 <= end) {
+		// A short run summed in float loses next to nothing, then goes into the double total
+		size_t flushEnd = std::min(end, i + PointSumFlushSize);
+		Float4 sum[3] = { Float4Splat(0.0f), Float4Splat(0.0f), Float4Splat(0.0f) };
+		for(; i + 4 <= flushEnd; i += 4) {
+			Float4 p[3];
+			input.Load(i, p[0], p[1], p[2]);
+			for(size_t a = 0; a < 3; a++) {
+				minimum[a] = Float4Min(minimum[a], p[a]);
+				maximum[a] = Float4Max(maximum[a], p[a]);
+				sum[a] = Float4Add(sum[a], p[a]);
+			}
+		}
+		for(size_t a = 0; a < 3; a++) {
+			alignas(16) float lanes[4];
+			Float4Store(lanes, sum[a]);
+			partial.sum[a] += ((double)lanes[0] + lanes[1]) + ((double)lanes[2] + lanes[3]);
+		}
+	}
+
+	for(size_t a = 0; a < 3; a++) {
+		alignas(16) float lanes[2][4];
+		Float4Store(lanes[0], minimum[a]);
+		Float4Store(lanes[1], maximum[a]);
+		partial.minimum[a] = std::min(std::min(lanes[0][0], lanes[0][1]), std::min(lanes[0][2], lanes[0][3]));
+		partial.maximum[a] = std::max(std::max(lanes[1][0], lanes[1][1]), std::max(lanes[1][2], lanes[1][3]));
+	}
+	for(; i < end; i++) {
+		float p[3];
+		input.Load(i, p[0], p[1], p[2]);
+		for(size_t a = 0; a < 3; a++) {
+			partial.minimum[a] = std::min(partial.minimum[a], p[a]);
+			partial.maximum[a] = std::max(partial.maximum[a], p[a]);
+			partial.sum[a] += p[a];
+		}
+	}
+}
+
+/// Reduce count points block by block, on several threads for big batches, then combine the blocks in order.
+template<class Reader>
+PointStatistics MeasureAll(const Reader& input, size_t count) {
+	PointStatistics statistics;
+	statistics.count = count;
+	if(count == 0) {
+		return statistics;
+	}
+
+	size_t blockCount = (count + PointReductionBlockSize - 1) / PointReductionBlockSize;
+	std::vector<PartialStatistics> partials(blockCount);
+	size_t parallelBlocks = (ParallelTransformThreshold + PointReductionBlockSize - 1) / PointReductionBlockSize;
+	ParallelFor(blockCount, parallelBlocks, 1, [&input, &partials, count](size_t begin, size_t end) {
+		for(size_t b = begin; b < end; b++) {
+			size_t first = b * PointReductionBlockSize;
+			MeasureRange(input, first, std::min(count, first + PointReductionBlockSize), partials[b]);
+		}
+	});
+
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	for(size_t b = 0; b < blockCount; b++) {
+		const PartialStatistics& partial = partials[b];
+		statistics.bounds.Extend(Vector3(partial.minimum[0], partial.minimum[1], partial.minimum[2]));
+		statistics.bounds.Extend(Vector3(partial.maximum[0], partial.maximum[1], partial.maximum[2]));
+		for(size_t a = 0; a < 3; a++) {
+			sum[a] += partial.sum[a];
+		}
+	}
+	statistics.centroid = Vector3((float)(sum[0] / count), (float)(sum[1] / count), (float)(sum[2] / count));
+	return statistics;
+}
+
+}
+
+//--------------------------------------------------------------------------
+
+void TransformPoints(const Matrix4& transform, const float* input, size_t inputStride,
+					 float* output, size_t outputStride, size_t count) {
+	assert(inputStride >= 3 && outputStride >= 3);
+	StridedReader reader = { input, inputStride };
+	StridedWriter writer = { output, outputStride };
+	TransformAll(PointTransform(transform), reader, writer, count);
+}
+
+void TransformDirections(const Matrix3& transform, const float* input, size_t inputStride,
+						 float* output, size_t outputStride, size_t count, bool renormalize) {
+	assert(inputStride >= 3 && outputStride >= 3);
+	StridedReader reader = { input, inputStride };
+	StridedWriter writer = { output, outputStride };
+	TransformAll(DirectionTransform(transform, renormalize), reader, writer, count);
+}
+
+void TransformPoints(const Matrix4& transform, const PointArrays& input, const PointArrays& output, size_t count) {
+	ArrayReader reader = { input.x, input.y, input.z };
+	ArrayWriter writer = { output.x, output.y, output.z };
+	TransformAll(PointTransform(transform), reader, writer, count);
+}
+
+void TransformDirections(const Matrix3& transform, const PointArrays& input, const PointArrays& output,
+						 size_t count, bool renormalize) {
+	ArrayReader reader = { input.x, input.y, input.z };
+	ArrayWriter writer = { output.x, output.y, output.z };
+	TransformAll(DirectionTransform(transform, renormalize), reader, writer, count);
+}
+
+PointStatistics MeasurePoints(const float* points, size_t stride, size_t count) {
+	assert(stride >= 3);
+	StridedReader reader = { points, stride };
+	return MeasureAll(reader, count);
+}
+
+PointStatistics MeasurePoints(const PointArrays& points, size_t count) {
+	ArrayReader reader = { points.x, points.y, points.z };
+	return MeasureAll(reader, count);
+}
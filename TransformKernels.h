@@ -0,0 +1,82 @@
+#ifndef _591_TRANSFORMKERNELS_H_
+#define _591_TRANSFORMKERNELS_H_
+
+#include "Matrix.h"
+#include "Bounds.h"
+#include <cstddef>
+
+/*
+	Batch transforms over arrays of positions and normals. Each kernel works four elements at a time,
+	turning them into x, y and z lanes (SoA) and applying the matrix with packed float math. Arrays of
+	ParallelTransformThreshold elements or more are split across hardware threads.
+
+	The strided kernels read xyz from the first three floats of each element, so they can work straight
+	on interleaved vertices. Input and output may be the same array, for transforming in place.
+*/
+
+/// Batches at least this big are transformed on several threads.
+const size_t ParallelTransformThreshold = 65536;
+
+/**
+	\brief Transform points (w = 1) by an affine matrix.
+	\param transform	The matrix.
+	\param input		The first point's x. y and z follow it.
+	\param inputStride	Floats from one input point to the next, at least 3.
+	\param output		Where the first transformed point's x goes.
+	\param outputStride	Floats from one output point to the next, at least 3.
+	\param count		The number of points.
+*/
+void TransformPoints(const Matrix4& transform, const float* input, size_t inputStride,
+					 float* output, size_t outputStride, size_t count);
+
+/**
+	\brief Transform directions (w = 0), optionally renormalizing them afterwards.
+	For normals, pass a Matrix4's normalMatrix(). Zero-length directions stay zero when renormalized.
+*/
+void TransformDirections(const Matrix3& transform, const float* input, size_t inputStride,
+						 float* output, size_t outputStride, size_t count, bool renormalize);
+
+/// Points stored as separate x, y and z arrays. The output arrays may be the input arrays.
+struct PointArrays {
+	float* x;
+	float* y;
+	float* z;
+};
+
+/// TransformPoints on separate x, y and z arrays.
+void TransformPoints(const Matrix4& transform, const PointArrays& input, const PointArrays& output, size_t count);
+
+/// TransformDirections on separate x, y and z arrays.
+void TransformDirections(const Matrix3& transform, const PointArrays& input, const PointArrays& output,
+						 size_t count, bool renormalize);
+
+/// Points summed together in one block of MeasurePoints. Blocks are the same whatever the thread count.
+const size_t PointReductionBlockSize = 16384;
+
+/// The box around a set of points and their mean.
+struct PointStatistics {
+	PointStatistics() {
+		count = 0;
+	}
+	/// Empty when there are no points
+	BoundingBox bounds;
+	/// Zero when there are no points
+	Vector3 centroid;
+	size_t count;
+};
+
+/**
+	\brief Find the box around points and their mean in one pass.
+	Each block of PointReductionBlockSize points is reduced four at a time, its sums moved into doubles
+	every few hundred points, and the blocks are then added up in order. Summing in pieces like this keeps
+	the mean accurate over millions of points, and the result is the same however many threads ran it.
+	\param points	The first point's x. y and z follow it.
+	\param stride	Floats from one point to the next, at least 3.
+	\param count	The number of points.
+*/
+PointStatistics MeasurePoints(const float* points, size_t stride, size_t count);
+
+/// MeasurePoints on separate x, y and z arrays.
+PointStatistics MeasurePoints(const PointArrays& points, size_t count);
+
+#endif
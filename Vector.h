@@ -19,47 +19,43 @@ class Vector {
 	}
 	/// 2-vector cons
 	Vector<N,T>(float a, float b) {
-		for(size_t i = 0; i < N; i++) {
-			m_Data[i] = 0;
-		}
-
 		assert(N >= 2);
 		m_Data[0] = a;
 		m_Data[1] = b;
+		for(size_t i = 2; i < N; i++) {
+			m_Data[i] = 0;
+		}
 	}
 	/// 3-Vector cons
 	Vector<N,T>(float a, float b, float c) {
-		for(size_t i = 0; i < N; i++) {
-			m_Data[i] = 0;
-		}
-		
 		assert(N >= 3);
 		m_Data[0] = a;
 		m_Data[1] = b;
 		m_Data[2] = c;
+		for(size_t i = 3; i < N; i++) {
+			m_Data[i] = 0;
+		}
 	}
 	/// 3-Vector cons
 	Vector<N,T>(const Vector<2,T>& v, float c) {
-		for(size_t i = 0; i < N; i++) {
-			m_Data[i] = 0;
-		}
-		
 		assert(N >= 3); // can't do a template specialization here for some reason.
 		m_Data[0] = v[0];
 		m_Data[1] = v[1];
 		m_Data[2] = c;
+		for(size_t i = 3; i < N; i++) {
+			m_Data[i] = 0;
+		}
 	}
 	/// 4-vector cons
 	Vector<N,T>(float a, float b, float c, float d) {
-		for(size_t i = 0; i < N; i++) {
-			m_Data[i] = 0;
-		}
-		
 		assert(N >= 4);
 		m_Data[0] = a;
 		m_Data[1] = b;
 		m_Data[2] = c;
 		m_Data[3] = d;
+		for(size_t i = 4; i < N; i++) {
+			m_Data[i] = 0;
+		}
 	}
 	/// Copy cons
 	Vector<N,T>(const Vector<N,T>& v) {
@@ -198,7 +194,7 @@ inline float cross(const Vector<2,T>& v1, const Vector<2,T>& v2) {
 	/*
 	 (x * v2.y) - (y * v2.x)
 	*/
-	return (v1[0] * v2[1]) - (v1[2] * v2[0]);
+	return (v1[0] * v2[1]) - (v1[1] * v2[0]);
 }
 
 /// Cross product
@@ -247,6 +243,9 @@ inline double Vector<N,T>::dot(const Vector<N,T>& p) const {
 	return ret;
 }
 	
+// Packed float 3- and 4-vectors
+#include "VectorSIMD.h"
+
 /**
  \brief Gives you the angle between two vectors, around a basis vector.
  \param basis	The basis vector.
@@ -0,0 +1,321 @@
+#ifndef _591_VECTORSIMD_H_
+#define _591_VECTORSIMD_H_
+
+/*
+	SSE/NEON versions of Vector<3,float> and Vector<4,float>. Included by Vector.h; include that instead.
+	Define VECTOR_NO_SIMD to fall back to plain scalar code with the same interface.
+*/
+
+#include "Vector.h"
+
+#if !defined(VECTOR_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+	#define VECTOR_SSE 1
+	#include <xmmintrin.h>
+#elif !defined(VECTOR_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+	#define VECTOR_NEON 1
+	#include <arm_neon.h>
+#endif
+
+//--------------------------------------------------------------------------
+// Four packed floats, and the handful of operations the vectors need on them.
+
+#if defined(VECTOR_SSE)
+
+typedef __m128 Float4;
+
+inline Float4 Float4Load(const float* p) { return _mm_load_ps(p); }
+inline void Float4Store(float* p, Float4 a) { _mm_store_ps(p, a); }
+inline Float4 Float4LoadUnaligned(const float* p) { return _mm_loadu_ps(p); }
+inline void Float4StoreUnaligned(float* p, Float4 a) { _mm_storeu_ps(p, a); }
+inline Float4 Float4Set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+inline Float4 Float4Splat(float f) { return _mm_set1_ps(f); }
+inline Float4 Float4Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Float4Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Float4Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Float4Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+inline Float4 Float4Negate(Float4 a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline Float4 Float4Sqrt(Float4 a) { return _mm_sqrt_ps(a); }
+inline Float4 Float4Max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+inline Float4 Float4Min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+/// Bit i set where lane i of a is less than lane i of b
+inline int Float4LessMask(Float4 a, Float4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+/// x + y + z, ignoring w
+inline float Float4Sum3(Float4 a) {
+	Float4 y = _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1));
+	Float4 z = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2));
+	return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(a, y), z));
+}
+inline float Float4Sum4(Float4 a) {
+	Float4 pairs = _mm_add_ps(a, _mm_movehl_ps(a, a));
+	return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+/// The cross product of the xyz parts. w comes out 0.
+inline Float4 Float4Cross(Float4 a, Float4 b) {
+	Float4 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	Float4 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	Float4 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+/// Approximately 1/sqrt(f) in every lane, good to about 22 bits
+inline Float4 Float4ReciprocalSqrt(float f) {
+	Float4 x = _mm_set1_ps(f);
+	Float4 y = _mm_rsqrt_ps(x);
+	// One Newton-Raphson step: y * (1.5 - 0.5 * x * y * y)
+	Float4 halfXYY = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(y, y));
+	return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), halfXYY));
+}
+
+#elif defined(VECTOR_NEON)
+
+typedef float32x4_t Float4;
+
+inline Float4 Float4Load(const float* p) { return vld1q_f32(p); }
+inline void Float4Store(float* p, Float4 a) { vst1q_f32(p, a); }
+inline Float4 Float4LoadUnaligned(const float* p) { return vld1q_f32(p); }
+inline void Float4StoreUnaligned(float* p, Float4 a) { vst1q_f32(p, a); }
+inline Float4 Float4Set(float a, float b, float c, float d) { float lanes[4] = { a, b, c, d }; return vld1q_f32(lanes); }
+inline Float4 Float4Splat(float f) { return vdupq_n_f32(f); }
+inline Float4 Float4Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Float4Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Float4Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Float4Div(Float4 a, Float4 b) {
+#if defined(__aarch64__)
+	return vdivq_f32(a, b);
+#else
+	// No divide on 32-bit ARM; refine the reciprocal estimate twice instead
+	Float4 reciprocal = vrecpeq_f32(b);
+	reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+	reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+	return vmulq_f32(a, reciprocal);
+#endif
+}
+inline Float4 Float4Negate(Float4 a) { return vnegq_f32(a); }
+inline Float4 Float4Sqrt(Float4 a) {
+#if defined(__aarch64__)
+	return vsqrtq_f32(a);
+#else
+	float lanes[4];
+	vst1q_f32(lanes, a);
+	for(int i = 0; i < 4; i++) {
+		lanes[i] = std::sqrt(lanes[i]);
+	}
+	return vld1q_f32(lanes);
+#endif
+}
+inline Float4 Float4Max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+inline Float4 Float4Min(Float4 a, Float4 b) { return vminq_f32(a, b); }
+inline int Float4LessMask(Float4 a, Float4 b) {
+	uint32x4_t less = vcltq_f32(a, b);
+	return (vgetq_lane_u32(less, 0) & 1) | (vgetq_lane_u32(less, 1) & 2) | (vgetq_lane_u32(less, 2) & 4) | (vgetq_lane_u32(less, 3) & 8);
+}
+inline float Float4Sum3(Float4 a) {
+	return vgetq_lane_f32(a, 0) + vgetq_lane_f32(a, 1) + vgetq_lane_f32(a, 2);
+}
+inline float Float4Sum4(Float4 a) {
+	float32x2_t pairs = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+	return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+}
+inline Float4 Float4Cross(Float4 a, Float4 b) {
+	// NEON has no general shuffle, so rotate xyz with lane moves
+	float32x4_t aYZX = vsetq_lane_f32(vgetq_lane_f32(a, 0), vextq_f32(a, a, 1), 2);
+	float32x4_t bYZX = vsetq_lane_f32(vgetq_lane_f32(b, 0), vextq_f32(b, b, 1), 2);
+	Float4 c = vsubq_f32(vmulq_f32(a, bYZX), vmulq_f32(aYZX, b));
+	c = vsetq_lane_f32(vgetq_lane_f32(c, 0), vextq_f32(c, c, 1), 2);
+	return vsetq_lane_f32(0.0f, c, 3);
+}
+inline Float4 Float4ReciprocalSqrt(float f) {
+	Float4 x = vdupq_n_f32(f);
+	Float4 y = vrsqrteq_f32(x);
+	return vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(x, y), y));
+}
+
+#else
+
+struct Float4 {
+	float v[4];
+};
+
+inline Float4 Float4Load(const float* p) { Float4 a = { { p[0], p[1], p[2], p[3] } }; return a; }
+inline void Float4Store(float* p, Float4 a) { for(int i = 0; i < 4; i++) p[i] = a.v[i]; }
+inline Float4 Float4LoadUnaligned(const float* p) { return Float4Load(p); }
+inline void Float4StoreUnaligned(float* p, Float4 a) { Float4Store(p, a); }
+inline Float4 Float4Set(float a, float b, float c, float d) { Float4 r = { { a, b, c, d } }; return r; }
+inline Float4 Float4Splat(float f) { Float4 a = { { f, f, f, f } }; return a; }
+inline Float4 Float4Add(Float4 a, Float4 b) { for(int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline Float4 Float4Sub(Float4 a, Float4 b) { for(int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline Float4 Float4Mul(Float4 a, Float4 b) { for(int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline Float4 Float4Div(Float4 a, Float4 b) { for(int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+inline Float4 Float4Negate(Float4 a) { for(int i = 0; i < 4; i++) a.v[i] = -a.v[i]; return a; }
+inline Float4 Float4Sqrt(Float4 a) { for(int i = 0; i < 4; i++) a.v[i] = std::sqrt(a.v[i]); return a; }
+inline Float4 Float4Max(Float4 a, Float4 b) { for(int i = 0; i < 4; i++) a.v[i] = (a.v[i] > b.v[i]) ? a.v[i] : b.v[i]; return a; }
+inline Float4 Float4Min(Float4 a, Float4 b) { for(int i = 0; i < 4; i++) a.v[i] = (a.v[i] < b.v[i]) ? a.v[i] : b.v[i]; return a; }
+inline int Float4LessMask(Float4 a, Float4 b) { int mask = 0; for(int i = 0; i < 4; i++) if(a.v[i] < b.v[i]) mask |= 1 << i; return mask; }
+inline float Float4Sum3(Float4 a) { return a.v[0] + a.v[1] + a.v[2]; }
+inline float Float4Sum4(Float4 a) { return (a.v[0] + a.v[2]) + (a.v[1] + a.v[3]); }
+inline Float4 Float4Cross(Float4 a, Float4 b) {
+	Float4 c = { {
+		(a.v[1] * b.v[2]) - (a.v[2] * b.v[1]),
+		(a.v[2] * b.v[0]) - (a.v[0] * b.v[2]),
+		(a.v[0] * b.v[1]) - (a.v[1] * b.v[0]),
+		0.0f
+	} };
+	return c;
+}
+inline Float4 Float4ReciprocalSqrt(float f) { return Float4Splat(1.0f / std::sqrt(f)); }
+
+#endif
+
+//--------------------------------------------------------------------------
+
+/**
+	\brief What Vector<3,float> and Vector<4,float> share: sixteen aligned bytes worked on four lanes at a time.
+	A 3-vector carries an unused w of 0, which dot and length leave out. Everything is in float precision.
+	Heap arrays of these rely on the allocator giving 16-byte alignment, as malloc does on 64-bit platforms.
+*/
+template<size_t N>
+class PackedVector {
+	static_assert(N == 3 || N == 4, "Only 3- and 4-vectors are packed");
+	typedef Vector<N,float> Derived;
+public:
+	/// Raw data. m_Data[3] is unused by 3-vectors.
+	alignas(16) float m_Data[4];
+protected:
+	constexpr PackedVector(float a, float b, float c, float d) : m_Data{ a, b, c, d } { }
+	Float4 Load() const {
+		return Float4Load(m_Data);
+	}
+	static Derived Make(Float4 packed) {
+		Derived ret;
+		Float4Store(ret.m_Data, packed);
+		return ret;
+	}
+public:
+	/// Accessor
+	inline float& operator[](size_t i) {
+		return m_Data[i];
+	}
+	/// Const accessor
+	inline constexpr const float& operator[](size_t i) const {
+		return m_Data[i];
+	}
+	// Operators (unary)
+	Derived& operator+=(const Derived& p) {
+		Float4Store(m_Data, Float4Add(this->Load(), p.Load()));
+		return static_cast<Derived&>(*this);
+	}
+	Derived& operator-=(const Derived& p) {
+		Float4Store(m_Data, Float4Sub(this->Load(), p.Load()));
+		return static_cast<Derived&>(*this);
+	}
+	Derived& operator*=(float f) {
+		Float4Store(m_Data, Float4Mul(this->Load(), Float4Splat(f)));
+		return static_cast<Derived&>(*this);
+	}
+	Derived& operator/=(float f) {
+		Float4Store(m_Data, Float4Div(this->Load(), Float4Splat(f)));
+		return static_cast<Derived&>(*this);
+	}
+	/// Negation operator
+	Derived operator-() const {
+		return Make(Float4Negate(this->Load()));
+	}
+	// Operators (binary)
+	Derived operator+(const Derived& p) const {
+		return Make(Float4Add(this->Load(), p.Load()));
+	}
+	Derived operator-(const Derived& p) const {
+		return Make(Float4Sub(this->Load(), p.Load()));
+	}
+	Derived operator*(double f) const {
+		return Make(Float4Mul(this->Load(), Float4Splat((float)f)));
+	}
+	Derived operator/(double f) const {
+		return Make(Float4Div(this->Load(), Float4Splat((float)f)));
+	}
+
+	/// Get the dot product with another vector
+	float dot(const Derived& p) const {
+		Float4 products = Float4Mul(this->Load(), p.Load());
+		return (N == 3) ? Float4Sum3(products) : Float4Sum4(products);
+	}
+	/// Get the length/magnitude of the vector (For later normalization)
+	float length() const {
+		return std::sqrt(this->dot(static_cast<const Derived&>(*this)));
+	}
+	/// Get the normalized form of this vector
+	Derived normalize() const {
+		return Make(Float4Div(this->Load(), Float4Splat(this->length())));
+	}
+	/// normalize using a reciprocal square root estimate. Faster, but only good to about 22 bits.
+	Derived fastNormalize() const {
+		return Make(Float4Mul(this->Load(), Float4ReciprocalSqrt(this->dot(static_cast<const Derived&>(*this)))));
+	}
+	/**
+		\brief Project this vector along another.
+		\param projectAlong	The vector to project this one along.
+		\return				The projected form of this vector.
+	*/
+	Derived project(const Derived& projectAlong) const {
+		float bLength = projectAlong.dot(projectAlong);
+		if(bLength == 0.0f) {
+			// Uh oh! Can't divide by zero.
+			return static_cast<const Derived&>(*this);
+		}
+		return projectAlong * (this->dot(projectAlong) / bLength);
+	}
+
+	friend Vector<3,float> cross(const Vector<3,float>& v1, const Vector<3,float>& v2);
+	friend Vector<4,float> cross(const Vector<4,float>& v1, const Vector<4,float>& v2);
+};
+
+/// A 3-vector of floats, packed for SIMD.
+template<>
+class Vector<3,float> : public PackedVector<3> {
+public:
+	/// Basic constructor
+	constexpr Vector() : PackedVector<3>(0.0f, 0.0f, 0.0f, 0.0f) { }
+	/// 2-vector cons, leaving z 0
+	constexpr Vector(float a, float b) : PackedVector<3>(a, b, 0.0f, 0.0f) { }
+	/// 3-Vector cons
+	constexpr Vector(float a, float b, float c) : PackedVector<3>(a, b, c, 0.0f) { }
+	/// 3-Vector cons
+	constexpr Vector(const Vector<2,float>& v, float c) : PackedVector<3>(v.m_Data[0], v.m_Data[1], c, 0.0f) { }
+};
+
+/// A 4-vector of floats, packed for SIMD.
+template<>
+class Vector<4,float> : public PackedVector<4> {
+public:
+	/// Basic constructor
+	constexpr Vector() : PackedVector<4>(0.0f, 0.0f, 0.0f, 0.0f) { }
+	/// 2-vector cons, leaving z and w 0
+	constexpr Vector(float a, float b) : PackedVector<4>(a, b, 0.0f, 0.0f) { }
+	/// 3-Vector cons, leaving w 0
+	constexpr Vector(float a, float b, float c) : PackedVector<4>(a, b, c, 0.0f) { }
+	/// 3-Vector cons, leaving w 0
+	constexpr Vector(const Vector<2,float>& v, float c) : PackedVector<4>(v.m_Data[0], v.m_Data[1], c, 0.0f) { }
+	/// 4-vector cons
+	constexpr Vector(float a, float b, float c, float d) : PackedVector<4>(a, b, c, d) { }
+};
+
+/// Cross product
+inline Vector<3,float> cross(const Vector<3,float>& v1, const Vector<3,float>& v2) {
+	return PackedVector<3>::Make(Float4Cross(v1.Load(), v2.Load()));
+}
+
+/// Cross product for 4-vector, ignoring the w-component.
+inline Vector<4,float> cross(const Vector<4,float>& v1, const Vector<4,float>& v2) {
+	return PackedVector<4>::Make(Float4Cross(v1.Load(), v2.Load()));
+}
+
+/// Scale with l-value double
+inline Vector<3,float> operator*(double s, const Vector<3,float>& v) {
+	return v * s;
+}
+
+/// Scale with l-value double
+inline Vector<4,float> operator*(double s, const Vector<4,float>& v) {
+	return v * s;
+}
+
+#endif
@@ -2,7 +2,13 @@
 #define _VERTEXBUFFER_H_
 
 #include <vector>
+#include <map>
 #include "IndexBuffer.h"
+#include "BufferShadow.h"
+#include "CheckedSize.h"
+#include "MemoryAccounting.h"
+#include "RenderCounters.h"
+#include "VertexLayout.h"
 #include "GLee.h"
 
 #ifndef __APPLE__
@@ -12,55 +18,195 @@
 #endif
 
 #include <cassert>
-
-/// An enumeration representing various fixed vertex formats
-enum VertexFormat {
-	/// 2D vertex data only
-	Vertex2 = 0,
-	/// 3D vertex data only
-	Vertex3 = 1,
-	/// 3D vertex data, 2D texture coordinate, 3D normal
-	Vertex3Texture2Normal3 = 2,
-	/// 3D vertex data, 2D texture coordinate, 3D normal, RGBA colour
-	Vertex3Texture2Normal3Colour4 = 3,
-	/// 3D vertex data, 3D normal, RGBA Colour
-	Vertex3Normal3Colour4 = 4
-};
+#include <cstring>
+#include <algorithm>
 
 /**
-	\brief A class representing a native vertex buffer representation.
-	Vertex buffers are significantly faster than immediate mode.
+	\brief The storage half of a vertex buffer: the shadow array, the GL handle and uploading.
+	Knows nothing about what the components mean; see TypedVertexBuffer for that.
+	Building a buffer makes no GL calls, so buffers can be built and filled on any thread; the GL
+	handle and the GPU storage are made by the first Commit or draw, on the GL thread.
 */
-class VertexBuffer {
+class VertexBufferStorage {
 public:
 	/// Whether or not the vertex buffer is supported in hardware.
 	static bool IsSupported() {
-		return (_GLEE_ARB_vertex_buffer_object != 0); 
+		return (_GLEE_ARB_vertex_buffer_object != 0);
+	}
+	/// Whether vertex array objects are supported, for SetUseVertexArrays.
+	static bool IsVertexArraySupported() {
+		return (_GLEE_ARB_vertex_array_object != 0);
+	}
+	/// Whether MapForWriting can map without waiting on the GPU. It falls back to glMapBufferARB otherwise.
+	static bool IsMapRangeSupported() {
+		return IndexBuffer::IsMapRangeSupported(); // The same GL feature maps both kinds of buffer
 	}
 public:
 	/// Indexed const fetch for an individual vertex component.
 	float operator[](size_t index) const {
 		assert(index >= 0 && index < this->size);
+		this->EnsureShadow();
 		return this->rawStorage[index];
 	}
 	/// Indexed fetch for an individual vertex component.
 	float& operator[](size_t index) {
 		assert(index >= 0 && index < this->size);
+		this->EnsureShadow();
 		return this->rawStorage[index];
 	}
 	/// Indexed fetch
 	float Get(size_t index) {
 		assert(index >= 0 && index < this->size);
+		this->EnsureShadow();
 		return this->rawStorage[index];
 	}
 	/// Writes "our" vertex buffer to the GPU. Do this after changing this instance.
 	void Commit() const {
+		assert(this->mapping == NULL);
+		if(this->rawStorage == NULL && this->isCommitted) {
+			// The shadow was released and never touched since, so the GPU copy is current.
+			return;
+		}
+		this->EnsureShadow(); // A deferred shadow goes up blank
+		this->Upload();
+
+		if(this->shadowPolicy == ShadowReleasedAfterCommit) {
+			this->ReleaseShadow();
+		}
+	}
+	/// Commit if the vertices have never gone to the GPU, so a draw doesn't read storage GL never allocated.
+	void EnsureCommitted() const {
+		if(!this->isCommitted) {
+			this->Commit();
+		}
+	}
+	/**
+		\brief Writes a run of components to the GPU, for when only part of the buffer changed.
+		The rest of the buffer must already be current on the GPU; before the first upload the whole
+		buffer goes up instead. Keeps the shadow array whatever
+		the shadow policy, so several runs can go up in a row; Commit or ReleaseShadow afterwards.
+		\param firstComponent	The first component to upload.
+		\param count			The number of components to upload.
+	*/
+	void CommitRange(size_t firstComponent, size_t count) const {
+		assert(IsRangeWithin(firstComponent, count, this->size));
+		if(this->rawStorage == NULL || count == 0) {
+			return;
+		}
+		if(!this->isCommitted) {
+			// Nothing on the GPU yet, so the first upload has to be all of it
+			this->Upload();
+			return;
+		}
 		this->Bind();
-		glBufferDataARB(GL_ARRAY_BUFFER_ARB, this->size * sizeof(float), this->rawStorage, GL_STATIC_DRAW_ARB);
+		glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, firstComponent * sizeof(float), count * sizeof(float), this->rawStorage + firstComponent);
+		RENDER_COUNT(CountUpload(count * sizeof(float)));
+	}
+	/**
+		\brief Allocate fresh GL storage and map all of it, so the whole buffer can be written straight into
+		GPU-visible memory instead of through the shadow array and Commit. Everything in the buffer is replaced,
+		so the shadow array is dropped. With ShadowRetained the shadow array is what's handed out, and Unmap
+		commits it. Nothing else may touch the buffer until Unmap.
+		\return	Where to write all GetSize() components, or NULL if GL couldn't map the buffer. The buffer keeps
+				its shadow array then (blank if it had none) to be written the usual way.
+	*/
+	float* MapForWriting() {
+		assert(this->mapping == NULL);
+		if(this->shadowPolicy == ShadowRetained) {
+			// The shadow array is kept anyway, so it's written instead and goes up on Unmap, rather than
+			// the mapping being read back into it later. Everything is replaced, so it needn't be zeroed.
+			if(this->rawStorage == NULL) {
+				this->rawStorage = new float[this->size];
+				MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
+			}
+			this->mapping = this->rawStorage;
+			return this->mapping;
+		}
+		this->Bind();
+		size_t bytes = this->size * sizeof(float);
+		// The storage is brand new, so nothing can be drawing from it and the mapping needn't wait for the GPU
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, bytes, NULL, GL_STATIC_DRAW_ARB);
+		MemoryAccounting::ChangeGPUBytes(this->memoryTag, (ptrdiff_t)bytes - (ptrdiff_t)this->gpuBytes);
+		this->gpuBytes = bytes;
+		if(VertexBufferStorage::IsMapRangeSupported()) {
+			this->mapping = (float*)glMapBufferRange(GL_ARRAY_BUFFER_ARB, 0, bytes,
+													 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		}
+		else {
+			this->mapping = (float*)glMapBufferARB(GL_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+		}
+		if(this->mapping == NULL) {
+			// The new storage is blank, so whatever the shadow array holds has to go up again
+			this->isCommitted = false;
+			if(this->rawStorage == NULL) {
+				this->CreateBlankShadow();
+			}
+			return NULL;
+		}
+
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, -(ptrdiff_t)this->GetShadowBytes());
+		delete[] this->rawStorage;
+		this->rawStorage = NULL;
+		this->mappedComponents = this->size;
+		return this->mapping;
+	}
+	/**
+		\brief Map a run of components of a buffer that's only on the GPU, to change some of them in place
+		without reading the buffer back into a shadow array. Components left unwritten keep their values.
+		Nothing else may touch the buffer until Unmap.
+		\param firstComponent	The first component to map.
+		\param count			The number of components to map.
+		\return	Where to write the count components, or NULL if GL couldn't map them; write them the usual way then.
+	*/
+	float* MapRangeForWriting(size_t firstComponent, size_t count) {
+		assert(this->mapping == NULL);
+		assert(this->isCommitted && this->rawStorage == NULL); // With a shadow array, write that and CommitRange instead
+		assert(count > 0 && IsRangeWithin(firstComponent, count, this->size));
+		this->Bind();
+		if(VertexBufferStorage::IsMapRangeSupported()) {
+			// No invalidation: the components in the run that aren't written have to survive
+			this->mapping = (float*)glMapBufferRange(GL_ARRAY_BUFFER_ARB, firstComponent * sizeof(float), count * sizeof(float), GL_MAP_WRITE_BIT);
+		}
+		else {
+			float* buffer = (float*)glMapBufferARB(GL_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+			this->mapping = (buffer != NULL) ? buffer + firstComponent : NULL;
+		}
+		this->mappedComponents = count;
+		return this->mapping;
+	}
+	/**
+		\brief Finish writing through MapForWriting or MapRangeForWriting. The vertices are then only on the GPU, as if the shadow
+		had been released, unless the shadow array was written under ShadowRetained.
+		\return	False if GL lost the contents while they were mapped. The buffer is then blank, with a shadow
+				array, and has to be written again.
+	*/
+	bool Unmap() {
+		assert(this->mapping != NULL);
+		if(this->mapping == this->rawStorage) {
+			// MapForWriting handed out the retained shadow array
+			this->mapping = NULL;
+			this->Upload();
+			return true;
+		}
+		this->Bind();
+		this->mapping = NULL;
+		if(glUnmapBufferARB(GL_ARRAY_BUFFER_ARB) == GL_FALSE) {
+			this->CreateBlankShadow();
+			this->isCommitted = false;
+			return false;
+		}
+		RENDER_COUNT(CountUpload(this->mappedComponents * sizeof(float)));
+		this->isCommitted = true;
+		return true;
+	}
+	/// Whether the buffer is mapped by MapForWriting or MapRangeForWriting
+	bool IsMapped() const {
+		return this->mapping != NULL;
 	}
 	/// Sets a specific vertex component's value
 	void Set(size_t index, float value) {
 		assert(index >= 0 && index < this->size);
+		this->EnsureShadow();
 		this->rawStorage[index] = value;
 	}
 public:
@@ -68,56 +214,281 @@ public:
 	void Read(const std::vector<float>& vertexData) {
 		// Can't put in more vertices than the buffer holds.
 		assert(vertexData.size() <= this->size);
-		// Load 'em
-		for(size_t i = 0; i < vertexData.size(); i++) {
-			this->rawStorage[i] = vertexData[i];
+		if(!vertexData.empty()) {
+			this->Write(0, &vertexData[0], vertexData.size());
+		}
+	}
+	/**
+		\brief Copy a run of components into the buffer. Will not commit.
+		\param firstComponent	The component to start writing at.
+		\param components		The components to write.
+		\param count			The number of components to write.
+	*/
+	void Write(size_t firstComponent, const float* components, size_t count) {
+		assert(IsRangeWithin(firstComponent, count, this->size));
+		this->EnsureShadow();
+		memcpy(this->rawStorage + firstComponent, components, count * sizeof(float));
+	}
+	/**
+		\brief Copy an element of a few components into each of a run of strided slots, such as one
+		attribute of each of a run of vertices. Will not commit.
+		\param firstComponent	The component the first element goes at.
+		\param stride			The number of components from one slot in the buffer to the next.
+		\param source			The first element to copy.
+		\param sourceStride		The number of floats from one element in the source to the next.
+		\param count			The number of elements to copy.
+		\param components		The number of floats in each element.
+	*/
+	void WriteStrided(size_t firstComponent, size_t stride, const float* source, size_t sourceStride,
+					  size_t count, size_t components) {
+		assert(components <= stride && components <= sourceStride);
+		// The last element must end within the buffer, worked out without the offset wrapping
+		assert(count == 0 || (IsRangeWithin(firstComponent, components, this->size)
+							  && (stride == 0 || count - 1 <= (this->size - firstComponent - components) / stride)));
+		this->EnsureShadow();
+		float* destination = this->rawStorage + firstComponent;
+		for(size_t i = 0; i < count; i++) {
+			for(size_t c = 0; c < components; c++) {
+				destination[c] = source[c];
+			}
+			destination += stride;
+			source += sourceStride;
 		}
 	}
+	/// Set a run of components to the same value. Will not commit.
+	void Fill(size_t firstComponent, size_t count, float value) {
+		assert(IsRangeWithin(firstComponent, count, this->size));
+		this->EnsureShadow();
+		std::fill(this->rawStorage + firstComponent, this->rawStorage + firstComponent + count, value);
+	}
+	/**
+		\brief Move a run of components within the buffer. The runs may overlap. Will not commit.
+		\param destination	The component to move the run to.
+		\param source		The first component of the run.
+		\param count		The number of components to move.
+	*/
+	void Move(size_t destination, size_t source, size_t count) {
+		assert(IsRangeWithin(destination, count, this->size) && IsRangeWithin(source, count, this->size));
+		this->EnsureShadow();
+		memmove(this->rawStorage + destination, this->rawStorage + source, count * sizeof(float));
+	}
+	/// Get the size of the vertex buffer, in components
+	size_t GetSize() const {
+		return this->size;
+	}
+public:
+	/// Change what happens to the shadow array on the next Commit.
+	void SetShadowPolicy(ShadowPolicy shadowPolicy) {
+		this->shadowPolicy = shadowPolicy;
+	}
+	/// Get what happens to the shadow array on Commit.
+	ShadowPolicy GetShadowPolicy() const {
+		return this->shadowPolicy;
+	}
+	/// Where the vertex data currently lives.
+	BufferResidency GetResidency() const {
+		if(!this->isCommitted) {
+			return ResidentCPU;
+		}
+		return (this->rawStorage != NULL) ? ResidentCPUAndGPU : ResidentGPU;
+	}
+	/// The number of bytes of main memory held by the shadow array right now.
+	size_t GetShadowBytes() const {
+		return (this->rawStorage != NULL) ? this->size * sizeof(float) : 0;
+	}
+	/**
+		\brief Free the shadow array, leaving the vertices only on the GPU.
+		The buffer must have been committed first. Touching the vertices afterwards reads them back.
+	*/
+	void ReleaseShadow() const {
+		assert(this->isCommitted); // We'd be throwing the only copy away
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, -(ptrdiff_t)this->GetShadowBytes());
+		delete[] this->rawStorage;
+		this->rawStorage = NULL;
+	}
+public:
+	/// Count this buffer's memory under a tag, such as the asset it was loaded from. See MemoryAccounting.
+	void SetMemoryTag(MemoryTag* memoryTag) {
+		MemoryAccounting::Retag(this->memoryTag, memoryTag, this->GetShadowBytes(), this->gpuBytes);
+		this->memoryTag = memoryTag;
+	}
+	MemoryTag* GetMemoryTag() const {
+		return this->memoryTag;
+	}
+protected:
+	VertexBufferStorage(size_t size, ShadowPolicy shadowPolicy, ShadowStart shadowStart) {
+		assert(size > 0);
+		assert(size <= (size_t)-1 / sizeof(float)); // So every byte offset into the buffer fits a size_t
+
+		// Set our parameters
+		this->size = size;
+		this->isCommitted = false;
+		this->mapping = NULL;
+		this->mappedComponents = 0;
+		this->shadowPolicy = shadowPolicy;
+		this->handle = 0;
+		this->memoryTag = MemoryAccounting::GetDefaultTag();
+		this->gpuBytes = 0;
+		MemoryAccounting::AddBuffer(this->memoryTag);
+
+		// Create & initialize local shadow storage
+		this->rawStorage = NULL;
+		if(shadowStart == ShadowZeroed) {
+			this->rawStorage = new float[this->size];
+			for(size_t i = 0; i < this->size; i++) {
+				this->rawStorage[i] = 0;
+			}
+			MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
+		}
+		// No GL calls here: the handle and the GPU storage wait for the first Commit or draw.
+	}
+
+	~VertexBufferStorage() {
+		// Delete the vertex buffer from GPU-side, if it ever got there.
+		if(this->handle != 0) {
+			glDeleteBuffersARB(1, &this->handle);
+		}
+		// Toss our shadow array
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, -(ptrdiff_t)this->GetShadowBytes());
+		delete[] this->rawStorage;
+		MemoryAccounting::ChangeGPUBytes(this->memoryTag, -(ptrdiff_t)this->gpuBytes);
+		MemoryAccounting::RemoveBuffer(this->memoryTag);
+	}
+protected:
+	void Bind() const {
+		// Bind the vertex buffer for drawing on the GPU
+		// If you're not rendering the right data, it may be because you forgot to Commit.
+		if(this->handle == 0) {
+			// Ask OpenGL to create a new vertex buffer handle for us
+			glGenBuffersARB(1, &this->handle);
+			assert(this->handle != 0); // GL screwed us.
+		}
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, this->handle);
+		RENDER_COUNT(CountBind());
+	}
+
+	/// Hand the whole shadow array to GL, allocating the GPU storage.
+	void Upload() const {
+		this->Bind();
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, this->size * sizeof(float), this->rawStorage, GL_STATIC_DRAW_ARB);
+		RENDER_COUNT(CountUpload(this->size * sizeof(float)));
+		this->isCommitted = true;
+		MemoryAccounting::ChangeGPUBytes(this->memoryTag, (ptrdiff_t)(this->size * sizeof(float)) - (ptrdiff_t)this->gpuBytes);
+		this->gpuBytes = this->size * sizeof(float);
+	}
+	/// Start a zeroed shadow array, for when the GPU copy is gone.
+	void CreateBlankShadow() {
+		assert(this->rawStorage == NULL);
+		this->rawStorage = new float[this->size];
+		std::fill(this->rawStorage, this->rawStorage + this->size, 0.0f);
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
+	}
+	/// Bring the shadow array back from the GPU if it was released.
+	void EnsureShadow() const {
+		assert(this->mapping == NULL); // Write through the mapping until Unmap
+		if(this->rawStorage != NULL) {
+			return;
+		}
+		this->rawStorage = new float[this->size];
+		MemoryAccounting::ChangeShadowBytes(this->memoryTag, this->GetShadowBytes());
+		if(!this->isCommitted) {
+			// The shadow was deferred and there's nothing on the GPU to read back
+			std::fill(this->rawStorage, this->rawStorage + this->size, 0.0f);
+			return;
+		}
+		this->Bind();
+		glGetBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, this->size * sizeof(float), this->rawStorage);
+	}
+private:
+	// Buffers own GL objects, so they can't be copied.
+	VertexBufferStorage(const VertexBufferStorage&);
+	VertexBufferStorage& operator=(const VertexBufferStorage&);
+private:
+	/// The shadow array. NULL while the vertices only live on the GPU.
+	mutable float* rawStorage;
+	/// Whether the GPU has a copy of the vertices yet
+	mutable bool isCommitted;
+	/// Where MapForWriting or MapRangeForWriting mapped the GL storage, or NULL while it isn't mapped
+	float* mapping;
+	/// How many components the mapping covers
+	size_t mappedComponents;
+	ShadowPolicy shadowPolicy;
+	/// The GL buffer, or 0 until the first Commit or draw creates it
+	mutable GLuint handle;
+	/// Size (in components)
+	size_t size;
+	/// Where this buffer's memory is counted
+	MemoryTag* memoryTag;
+	/// The bytes of GL storage counted against memoryTag
+	mutable size_t gpuBytes;
+};
+
+/**
+	\brief A class representing a native vertex buffer representation.
+	Vertex buffers are significantly faster than immediate mode.
+	The layout (see VertexLayout.h) is fixed at compile time, so stride math and pointer setup
+	involve no runtime dispatch.
+*/
+template<class Layout>
+class TypedVertexBuffer : public VertexBufferStorage, private IndexBufferUser {
+public:
+	/**
+		\brief Create a vertex buffer.
+		\param size			The number of vertex components (not vertices) to store.
+		\param shadowPolicy	What to do with the shadow array once the buffer is committed.
+		\param shadowStart	Whether to skip making the shadow array, for a buffer about to go through MapForWriting.
+	*/
+	TypedVertexBuffer(size_t size, ShadowPolicy shadowPolicy = ShadowRetained, ShadowStart shadowStart = ShadowZeroed)
+		: VertexBufferStorage(size, shadowPolicy, shadowStart), layout() {
+		assert(size % this->layout.Stride() == 0); // Partial vertices are a mistake
+		this->useVertexArrays = false;
+		this->isVertexArrayBound = false;
+		this->isRebased = false;
+	}
+
+	~TypedVertexBuffer() {
+		this->ReleaseVertexArrays();
+	}
 public:
 	/// Draw the vertex buffer as a certain kind of primitive.
 	void Draw(GLenum primitiveType = GL_TRIANGLES) {
 		glPushAttrib(GL_ALL_ATTRIB_BITS); // slow
+		RENDER_COUNT(CountPushAttrib());
+
+		// Bind and point the GPU at our vertices
+		this->BeginDraw();
 
-		// Bind the vertex buffer to prepare it for being read by the GPU
-		Bind();
-				
-		glEnableClientState(GL_VERTEX_ARRAY);
-		// Prepare the client states we need (and set this->componentsPerVertex)
-		SetUpStreams();
-		
-		// Set up the "striping" style to tell the GPU how to expect the data
-		SetUpPointers(this->format);
-		
 		// Draw the array
-		glDrawArrays(primitiveType, 0, this->size / this->componentsPerVertex);
+		assert(FitsDrawCount(this->GetVertexCount())); // GL counts vertices in an int
+		glDrawArrays(primitiveType, 0, (GLsizei)this->GetVertexCount());
+		RENDER_COUNT(CountDraw(primitiveType, this->GetVertexCount()));
+
+		this->EndDraw();
 
-		glDisableClientState(GL_VERTEX_ARRAY);
-		
 		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-		
+		RENDER_COUNT(CountBind());
+
 		glPopAttrib(); // Dog slow.
+		RENDER_COUNT(CountPopAttrib());
 	}
-	
+
 	/**
 		\brief Draw the vertex buffer using an index buffer to control which vertices are drawn.
 		\param indices			The index buffer to use. Ensure it is committed to the GPU.
 		\param primitiveType	The OpenGL geometric primitive type to render these vertices as.
 	*/
-	void DrawIndexed(IndexBuffer& indices, GLenum primitiveType = GL_TRIANGLES) {	
+	void DrawIndexed(IndexBuffer& indices, GLenum primitiveType = GL_TRIANGLES) {
 		glPushAttrib(GL_ALL_ATTRIB_BITS);
-		glEnableClientState(GL_VERTEX_ARRAY);
-		
-		this->SetUpStreams();
-		
-		indices.Bind();
-		this->Bind();
-		this->SetUpPointers(this->format);
+		RENDER_COUNT(CountPushAttrib());
+
+		this->BeginDraw(&indices);
 		indices.DrawAll(primitiveType);
-		
-		glDisableClientState(GL_VERTEX_ARRAY);
+		this->EndDraw();
+
 		glPopAttrib();
+		RENDER_COUNT(CountPopAttrib());
 	}
-	
+
 	/**
 		\brief 	Draw the vertex buffer using a range of indices from the index buffer to control which
 				vertices are drawn.
@@ -126,135 +497,212 @@ public:
 		\param vertexCount		The number of vertices from the index buffer to render.
 		\param primitiveType	The OpenGL geometric primitive type to render these vertices as.
 	*/
-	void DrawIndexed(IndexBuffer& indices, unsigned int startIndex, unsigned int vertexCount,
-	 				 GLenum primitiveType = GL_TRIANGLES) {	
+	void DrawIndexed(IndexBuffer& indices, size_t startIndex, size_t vertexCount,
+	 				 GLenum primitiveType = GL_TRIANGLES) {
 		glPushAttrib(GL_ALL_ATTRIB_BITS);
-		glEnableClientState(GL_VERTEX_ARRAY);
-		
-		this->SetUpStreams();
-		
-		indices.Bind();
-		this->Bind();
-		this->SetUpPointers(this->format);
+		RENDER_COUNT(CountPushAttrib());
+
+		this->BeginDraw(&indices);
 		indices.DrawRange(primitiveType, startIndex, vertexCount);
-		
-		glDisableClientState(GL_VERTEX_ARRAY);
+		this->EndDraw();
+
 		glPopAttrib();
+		RENDER_COUNT(CountPopAttrib());
 	}
 public:
-	/// Get how "big" each vertex is in terms of components.
-	int GetVertexStride() const {
-		switch(this->format) {
-			case Vertex2:
-				return 2;
-			case Vertex3:
-				return 3;
-			case Vertex3Texture2Normal3:
-				return 8;
-			case Vertex3Texture2Normal3Colour4:
-				return 12;
-			default:
-				return 0; // Unknown format
+	/**
+		\brief Bind the buffer and point GL at its attributes, ready for any number of draw calls.
+		Doesn't save any GL state; pair it with EndDraw. Used by the Draw methods and BatchRenderer.
+		\param indices	The index buffer the draws will use, or NULL for non-indexed draws.
+	*/
+	void BeginDraw(const IndexBuffer* indices = NULL) const {
+		// Buffers never committed get their first upload here, before any vertex array is bound
+		this->EnsureCommitted();
+		if(indices != NULL) {
+			indices->EnsureCommitted();
+		}
+		if(this->useVertexArrays && VertexBufferStorage::IsVertexArraySupported()) {
+			// Everything below was captured the first time we drew with these indices
+			glBindVertexArray(this->GetVertexArray(indices));
+			RENDER_COUNT(CountBind());
+			this->isVertexArrayBound = true;
+			return;
 		}
-	}
 
-	/// Get the number of vertices in the vertex buffer
-	size_t GetVertexCount() const {
-		return this->size / this->GetVertexStride();
+		if(indices != NULL) {
+			indices->Bind();
+		}
+		// Bind the vertex buffer to prepare it for being read by the GPU
+		this->Bind();
+		// Prepare the client states we need
+		this->layout.EnableStreams();
+		// Set up the "striping" style to tell the GPU how to expect the data
+		this->layout.SetUpPointers(0);
+	}
+	/**
+		\brief Re-point the attributes so that index 0 refers to the given vertex.
+		Lets suballocated meshes draw with their own indices where glDrawElementsBaseVertex isn't available.
+	*/
+	void SetBaseVertex(size_t baseVertex) const {
+		this->Bind();
+		this->layout.SetUpPointers((const void*)(baseVertex * this->layout.Stride() * sizeof(float)));
+		this->isRebased = (baseVertex != 0);
+	}
+	/// Undo the client state set up by BeginDraw.
+	void EndDraw() const {
+		if(this->isVertexArrayBound) {
+			if(this->isRebased) {
+				// SetBaseVertex wrote into the vertex array object; put it back the way it was captured
+				this->SetBaseVertex(0);
+			}
+			glBindVertexArray(0);
+			RENDER_COUNT(CountBind());
+			this->isVertexArrayBound = false;
+			return;
+		}
+		this->layout.DisableStreams();
 	}
 public:
-	VertexBuffer(unsigned int size, VertexFormat format) {
-		assert(size > 0);
-		
-		// Set our parameters
-		this->size = size;
-		this->format = format;
-		
-		// Create & initialize local shadow storage
-		this->rawStorage = new float[this->size];
-		for(size_t i = 0; i < this->size; i++) {
-			this->rawStorage[i] = 0;
+	/**
+		\brief Capture the attribute setup in a vertex array object per index buffer, so BeginDraw
+		becomes a single bind. Ignored where vertex array objects aren't supported.
+		Don't commit other index buffers between BeginDraw and EndDraw while this is on, since the
+		element array binding belongs to the bound vertex array object.
+	*/
+	void SetUseVertexArrays(bool useVertexArrays) {
+		this->useVertexArrays = useVertexArrays;
+		if(!useVertexArrays) {
+			this->ReleaseVertexArrays();
 		}
-
-		// Ask OpenGL to create a new vertex buffer handle for us
-		glGenBuffersARB(1, &this->handle);
-		assert(this->handle != 0); // GL screwed us.
-		// Write the "blank" vertex buffer out to GPU memory, causing it to allocate
-		// the proper space for us.
-		this->Commit();
-		
-		this->componentsPerVertex = 1;
 	}
-
-	~VertexBuffer() {
-		// Delete the vertex buffer from GPU-side.
-		glDeleteBuffersARB(1, &this->handle);
-		// Toss our shadow array
-		delete[] this->rawStorage;
+	bool IsUsingVertexArrays() const {
+		return this->useVertexArrays && VertexBufferStorage::IsVertexArraySupported();
 	}
-private:
-	void Bind() const {
-		// Bind the vertex buffer for drawing on the GPU
-		// If you're not rendering the right data, it may be because you forgot to Commit.
-		glBindBufferARB(GL_ARRAY_BUFFER_ARB, this->handle);
+	/// Delete every captured vertex array object. They're recaptured on the next draw.
+	void ReleaseVertexArrays() {
+		for(typename std::map<unsigned int, CapturedVertexArray>::iterator vertexArray = this->vertexArrays.begin(); vertexArray != this->vertexArrays.end(); ++vertexArray) {
+			glDeleteVertexArrays(1, &vertexArray->second.vertexArray);
+			if(vertexArray->second.indices != NULL) {
+				vertexArray->second.indices->RemoveUser(this);
+			}
+		}
+		this->vertexArrays.clear();
 	}
-
-	void SetUpPointers(VertexFormat format) {
-		switch(format) {
-			case Vertex2:
-				glVertexPointer(2, GL_FLOAT, 0, 0);
-				this->componentsPerVertex = 2;
-				break;
-			case Vertex3:
-				glVertexPointer(3, GL_FLOAT, 0, 0);
-				this->componentsPerVertex = 3;
-				break;
-			case Vertex3Texture2Normal3:
-				glVertexPointer(3, GL_FLOAT,	8 * sizeof(float),	0);
-				glTexCoordPointer(2, GL_FLOAT,	8 * sizeof(float),	(void*)(3 * sizeof(float)));
-				glNormalPointer(GL_FLOAT,		8 * sizeof(float),	(void*)(5 * sizeof(float)));
-				this->componentsPerVertex = 8;
-				break;
-			case Vertex3Texture2Normal3Colour4:
-				glVertexPointer(3, GL_FLOAT,	12 * sizeof(float),	0);
-				glTexCoordPointer(2, GL_FLOAT,	12 * sizeof(float),	(void*)(3 * sizeof(float)));
-				glNormalPointer(GL_FLOAT,		12 * sizeof(float),	(void*)(5 * sizeof(float)));
-				glColorPointer(4, GL_FLOAT,		12 * sizeof(float),	(void*)(8 * sizeof(float)));
-				this->componentsPerVertex = 12;
-				break;
-			case Vertex3Normal3Colour4:
-				glVertexPointer(3, GL_FLOAT,	10 * sizeof(float),0);
-				glNormalPointer(GL_FLOAT,		10 * sizeof(float), (void*)(3 * sizeof(float)));
-				glColorPointer(4, GL_FLOAT,		10 * sizeof(float), (void*)(6 * sizeof(float)));
-				break;
-			default:
-				assert(false); // Unknown vertex type
-				break;
+public:
+	/**
+		\brief Copy whole vertices into the buffer from an array of structs laid out like Layout. Will not commit.
+		\param firstVertex	The vertex to start writing at.
+		\param vertices		The vertices to write. sizeof(Vertex) must be one vertex of the layout.
+		\param count		The number of vertices to write.
+	*/
+	template<class Vertex>
+	void WriteVertices(size_t firstVertex, const Vertex* vertices, size_t count) {
+		assert(sizeof(Vertex) == this->layout.Stride() * sizeof(float));
+		this->Write(firstVertex * this->layout.Stride(), (const float*)vertices, count * this->layout.Stride());
+	}
+	/// Copy whole vertices into the buffer from a vector of structs laid out like Layout. Will not commit.
+	template<class Vertex>
+	void WriteVertices(size_t firstVertex, const std::vector<Vertex>& vertices) {
+		if(!vertices.empty()) {
+			this->WriteVertices(firstVertex, &vertices[0], vertices.size());
 		}
 	}
+public:
+	/// Get how "big" each vertex is in terms of components.
+	int GetVertexStride() const {
+		return this->layout.Stride();
+	}
 
-	inline void SetUpStreams() const {
-		if(this->format == Vertex3Texture2Normal3 || this->format == Vertex3Texture2Normal3Colour4) {
-			// Enable the texture client state, since we need textures.
-			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	/// Get the number of vertices in the vertex buffer
+	size_t GetVertexCount() const {
+		return this->GetSize() / this->GetVertexStride();
+	}
+protected:
+	/// For layouts that carry runtime state (RuntimeVertexLayout).
+	TypedVertexBuffer(size_t size, const Layout& layout, ShadowPolicy shadowPolicy, ShadowStart shadowStart)
+		: VertexBufferStorage(size, shadowPolicy, shadowStart), layout(layout) {
+		assert(size % this->layout.Stride() == 0);
+		this->useVertexArrays = false;
+		this->isVertexArrayBound = false;
+		this->isRebased = false;
+	}
+private:
+	/// A vertex array object captured for one index buffer
+	struct CapturedVertexArray {
+		GLuint vertexArray;
+		/// The index buffer it captured, which tells us when it's destroyed; NULL for none
+		const IndexBuffer* indices;
+	};
+	/// Find or capture the vertex array object for drawing with the given indices. Leaves it bound.
+	GLuint GetVertexArray(const IndexBuffer* indices) const {
+		unsigned int key = (indices != NULL) ? indices->GetSerial() : 0;
+		typename std::map<unsigned int, CapturedVertexArray>::const_iterator existing = this->vertexArrays.find(key);
+		if(existing != this->vertexArrays.end()) {
+			return existing->second.vertexArray;
 		}
-		if(this->format == Vertex3Texture2Normal3 || this->format == Vertex3Texture2Normal3Colour4 || this->format == Vertex3Normal3Colour4) {	
-			// Enable the normal client state too.
-			glEnableClientState(GL_NORMAL_ARRAY);
+
+		GLuint vertexArray = 0;
+		glGenVertexArrays(1, &vertexArray);
+		assert(vertexArray != 0);
+		glBindVertexArray(vertexArray);
+		RENDER_COUNT(CountBind());
+		if(indices != NULL) {
+			indices->Bind();
 		}
-		if(this->format == Vertex3Texture2Normal3Colour4 ||	this->format == Vertex3Normal3Colour4) {
-			// We'll need colour too
-			glEnableClientState(GL_COLOR_ARRAY);
+		this->Bind();
+		this->layout.EnableStreams();
+		this->layout.SetUpPointers(0);
+
+		CapturedVertexArray captured;
+		captured.vertexArray = vertexArray;
+		captured.indices = indices;
+		this->vertexArrays[key] = captured;
+		if(indices != NULL) {
+			// So the vertex array object goes when the index buffer does, rather than piling up
+			indices->AddUser(const_cast<TypedVertexBuffer*>(this));
 		}
+		return vertexArray;
 	}
+	/// An index buffer we captured a vertex array object for is going away, so its serial can never be drawn again
+	virtual void IndexBufferDestroyed(unsigned int serial) {
+		typename std::map<unsigned int, CapturedVertexArray>::iterator vertexArray = this->vertexArrays.find(serial);
+		if(vertexArray != this->vertexArrays.end()) {
+			glDeleteVertexArrays(1, &vertexArray->second.vertexArray);
+			this->vertexArrays.erase(vertexArray);
+		}
+	}
+protected:
+	/// Empty for compile-time layouts
+	Layout layout;
 private:
-	VertexFormat format;
-	float* rawStorage;
-	GLuint handle;
-	/// Size (in components)
-	unsigned int size;
-	/// The number of components per vertex
-	unsigned int componentsPerVertex;
+	bool useVertexArrays;
+	/// Vertex array objects, keyed by the serial of the index buffer they capture (0 for none)
+	mutable std::map<unsigned int, CapturedVertexArray> vertexArrays;
+	mutable bool isVertexArrayBound;
+	/// Whether SetBaseVertex moved the pointers away from vertex 0
+	mutable bool isRebased;
+};
+
+/**
+	\brief A vertex buffer whose layout is one of the stock VertexFormats, picked at runtime.
+	Use a TypedVertexBuffer when the layout is known at compile time.
+*/
+class VertexBuffer : public TypedVertexBuffer<RuntimeVertexLayout> {
+public:
+	/**
+		\brief Create a vertex buffer.
+		\param size			The number of vertex components (not vertices) to store.
+		\param format			The layout of each vertex.
+		\param shadowPolicy	What to do with the shadow array once the buffer is committed.
+		\param shadowStart	Whether to skip making the shadow array, for a buffer about to go through MapForWriting.
+	*/
+	VertexBuffer(size_t size, VertexFormat format, ShadowPolicy shadowPolicy = ShadowRetained, ShadowStart shadowStart = ShadowZeroed)
+		: TypedVertexBuffer<RuntimeVertexLayout>(size, RuntimeVertexLayout(format), shadowPolicy, shadowStart) {
+	}
+	/// Get the layout of each vertex.
+	VertexFormat GetFormat() const {
+		return this->layout.GetFormat();
+	}
 };
 
 #endif
@@ -0,0 +1,243 @@
+#ifndef _585_VERTEXLAYOUT_H_
+#define _585_VERTEXLAYOUT_H_
+
+#include "GLee.h"
+#include "RenderCounters.h"
+
+#ifndef __APPLE__
+#include <GL/gl.h>
+#else
+#include <OpenGL/gl.h>
+#endif
+
+#include <cstddef>
+#include <cassert>
+
+/*
+	Vertex layouts are described once, as types. A layout is a list of attributes in the order they
+	are interleaved in each vertex, so the stride, the offset of every attribute and the calls that
+	point GL at them are all worked out by the compiler:
+
+		typedef VertexLayout<Position3, Colour4> MyVertexLayout;
+		TypedVertexBuffer<MyVertexLayout> buffer(vertexCount * MyVertexLayout::Stride());
+
+	The VertexFormat enumeration only names the stock layouts for code that picks one at runtime.
+*/
+
+/// What an attribute means to the fixed-function pipeline.
+enum VertexAttributeSemantic {
+	SemanticPosition = 0,
+	SemanticTextureCoordinate = 1,
+	SemanticNormal = 2,
+	SemanticColour = 3
+};
+
+/// A single attribute of an interleaved vertex, made of N floats.
+template<VertexAttributeSemantic S, unsigned int N>
+struct VertexAttribute;
+
+template<unsigned int N>
+struct VertexAttribute<SemanticPosition, N> {
+	static_assert(N >= 2 && N <= 4, "Positions have 2 to 4 components");
+	static const VertexAttributeSemantic semantic = SemanticPosition;
+	static const unsigned int components = N;
+	static const GLenum clientState = GL_VERTEX_ARRAY;
+	static void SetUpPointer(GLsizei strideBytes, const void* address) {
+		glVertexPointer(N, GL_FLOAT, strideBytes, address);
+	}
+};
+
+template<unsigned int N>
+struct VertexAttribute<SemanticTextureCoordinate, N> {
+	static_assert(N >= 1 && N <= 4, "Texture coordinates have 1 to 4 components");
+	static const VertexAttributeSemantic semantic = SemanticTextureCoordinate;
+	static const unsigned int components = N;
+	static const GLenum clientState = GL_TEXTURE_COORD_ARRAY;
+	static void SetUpPointer(GLsizei strideBytes, const void* address) {
+		glTexCoordPointer(N, GL_FLOAT, strideBytes, address);
+	}
+};
+
+template<unsigned int N>
+struct VertexAttribute<SemanticNormal, N> {
+	static_assert(N == 3, "Normals always have 3 components");
+	static const VertexAttributeSemantic semantic = SemanticNormal;
+	static const unsigned int components = N;
+	static const GLenum clientState = GL_NORMAL_ARRAY;
+	static void SetUpPointer(GLsizei strideBytes, const void* address) {
+		glNormalPointer(GL_FLOAT, strideBytes, address);
+	}
+};
+
+template<unsigned int N>
+struct VertexAttribute<SemanticColour, N> {
+	static_assert(N == 3 || N == 4, "Colours have 3 or 4 components");
+	static const VertexAttributeSemantic semantic = SemanticColour;
+	static const unsigned int components = N;
+	static const GLenum clientState = GL_COLOR_ARRAY;
+	static void SetUpPointer(GLsizei strideBytes, const void* address) {
+		glColorPointer(N, GL_FLOAT, strideBytes, address);
+	}
+};
+
+typedef VertexAttribute<SemanticPosition, 2> Position2;
+typedef VertexAttribute<SemanticPosition, 3> Position3;
+typedef VertexAttribute<SemanticTextureCoordinate, 2> TextureCoordinate2;
+typedef VertexAttribute<SemanticNormal, 3> Normal3;
+typedef VertexAttribute<SemanticColour, 4> Colour4;
+
+//--------------------------------------------------------------------------
+
+/// An interleaved vertex made of the given attributes, in order.
+template<class... Attributes>
+struct VertexLayout;
+
+template<>
+struct VertexLayout<> {
+	static constexpr unsigned int Stride() { return 0; }
+	static constexpr bool Has(VertexAttributeSemantic) { return false; }
+	static constexpr unsigned int OffsetOf(VertexAttributeSemantic) { return 0; }
+	static void SetUpPointers(GLsizei, const char*) { }
+	static void EnableStreams() { }
+	static void DisableStreams() { }
+};
+
+template<class First, class... Rest>
+struct VertexLayout<First, Rest...> {
+	typedef VertexLayout<Rest...> Tail;
+
+	/// The size of one vertex, in components.
+	static constexpr unsigned int Stride() {
+		return First::components + Tail::Stride();
+	}
+	/// Whether the layout carries an attribute with the given semantic.
+	static constexpr bool Has(VertexAttributeSemantic semantic) {
+		return First::semantic == semantic || Tail::Has(semantic);
+	}
+	/// The offset of the first attribute with the given semantic, in components.
+	static constexpr unsigned int OffsetOf(VertexAttributeSemantic semantic) {
+		return (First::semantic == semantic) ? 0 : First::components + Tail::OffsetOf(semantic);
+	}
+
+	/// Point GL at every attribute of vertices starting at the given buffer offset.
+	static void SetUpPointers(const void* base) {
+		SetUpPointers(Stride() * sizeof(float), (const char*)base);
+	}
+	static void SetUpPointers(GLsizei strideBytes, const char* address) {
+		First::SetUpPointer(strideBytes, address);
+		Tail::SetUpPointers(strideBytes, address + First::components * sizeof(float));
+	}
+	/// Enable the client states this layout needs.
+	static void EnableStreams() {
+		glEnableClientState(First::clientState);
+		RENDER_COUNT(CountClientStateToggle());
+		Tail::EnableStreams();
+	}
+	/// Disable the client states this layout enabled.
+	static void DisableStreams() {
+		glDisableClientState(First::clientState);
+		RENDER_COUNT(CountClientStateToggle());
+		Tail::DisableStreams();
+	}
+};
+
+//--------------------------------------------------------------------------
+
+/// An enumeration naming the stock vertex layouts, for picking one at runtime
+enum VertexFormat {
+	/// 2D vertex data only
+	Vertex2 = 0,
+	/// 3D vertex data only
+	Vertex3 = 1,
+	/// 3D vertex data, 2D texture coordinate, 3D normal
+	Vertex3Texture2Normal3 = 2,
+	/// 3D vertex data, 2D texture coordinate, 3D normal, RGBA colour
+	Vertex3Texture2Normal3Colour4 = 3,
+	/// 3D vertex data, 3D normal, RGBA Colour
+	Vertex3Normal3Colour4 = 4,
+	/// The number of stock formats
+	VertexFormatCount = 5
+};
+
+/// Maps a VertexFormat onto the layout type that describes it.
+template<VertexFormat F> struct VertexFormatLayout;
+
+template<> struct VertexFormatLayout<Vertex2> {
+	typedef VertexLayout<Position2> Type;
+};
+template<> struct VertexFormatLayout<Vertex3> {
+	typedef VertexLayout<Position3> Type;
+};
+template<> struct VertexFormatLayout<Vertex3Texture2Normal3> {
+	typedef VertexLayout<Position3, TextureCoordinate2, Normal3> Type;
+};
+template<> struct VertexFormatLayout<Vertex3Texture2Normal3Colour4> {
+	typedef VertexLayout<Position3, TextureCoordinate2, Normal3, Colour4> Type;
+};
+template<> struct VertexFormatLayout<Vertex3Normal3Colour4> {
+	typedef VertexLayout<Position3, Normal3, Colour4> Type;
+};
+
+//--------------------------------------------------------------------------
+
+/// A layout captured as data, for code that only knows the VertexFormat at runtime.
+struct VertexLayoutDescriptor {
+	/// The size of one vertex, in components
+	unsigned int stride;
+	void (*setUpPointers)(const void* base);
+	void (*enableStreams)();
+	void (*disableStreams)();
+
+	/// Capture a compile-time layout.
+	template<class Layout>
+	static VertexLayoutDescriptor Describe() {
+		VertexLayoutDescriptor descriptor;
+		descriptor.stride = Layout::Stride();
+		descriptor.setUpPointers = &Layout::SetUpPointers;
+		descriptor.enableStreams = &Layout::EnableStreams;
+		descriptor.disableStreams = &Layout::DisableStreams;
+		return descriptor;
+	}
+};
+
+/// Look up the descriptor for one of the stock formats.
+inline const VertexLayoutDescriptor& GetVertexLayoutDescriptor(VertexFormat format) {
+	static const VertexLayoutDescriptor descriptors[VertexFormatCount] = {
+		VertexLayoutDescriptor::Describe<VertexFormatLayout<Vertex2>::Type>(),
+		VertexLayoutDescriptor::Describe<VertexFormatLayout<Vertex3>::Type>(),
+		VertexLayoutDescriptor::Describe<VertexFormatLayout<Vertex3Texture2Normal3>::Type>(),
+		VertexLayoutDescriptor::Describe<VertexFormatLayout<Vertex3Texture2Normal3Colour4>::Type>(),
+		VertexLayoutDescriptor::Describe<VertexFormatLayout<Vertex3Normal3Colour4>::Type>()
+	};
+	assert(format >= 0 && format < VertexFormatCount); // Unknown vertex type
+	return descriptors[format];
+}
+
+/// A layout chosen at runtime from the stock formats. Each call goes through the descriptor table.
+class RuntimeVertexLayout {
+public:
+	RuntimeVertexLayout(VertexFormat format) {
+		this->format = format;
+		this->descriptor = &GetVertexLayoutDescriptor(format);
+	}
+	VertexFormat GetFormat() const {
+		return this->format;
+	}
+	unsigned int Stride() const {
+		return this->descriptor->stride;
+	}
+	void SetUpPointers(const void* base) const {
+		this->descriptor->setUpPointers(base);
+	}
+	void EnableStreams() const {
+		this->descriptor->enableStreams();
+	}
+	void DisableStreams() const {
+		this->descriptor->disableStreams();
+	}
+private:
+	VertexFormat format;
+	const VertexLayoutDescriptor* descriptor;
+};
+
+#endif